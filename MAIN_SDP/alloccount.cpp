@@ -0,0 +1,97 @@
+#include "alloccount.h"
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+AllocationCheck allocCheck;
+
+// Plain integers, so counting needs no locks and never allocates itself
+static thread_local uint64_t allocationCount = 0;
+static thread_local uint64_t allocationBytes = 0;
+
+AllocationCounts threadAllocations() {
+    return AllocationCounts{allocationCount, allocationBytes};
+}
+
+#ifndef ECOQUEST_NO_ALLOC_COUNT
+
+// The array and nothrow forms call these, so they get counted too
+void* operator new(std::size_t size) {
+    allocationCount++;
+    allocationBytes += size;
+    void* memory = malloc(size ? size : 1);
+    if (!memory) throw std::bad_alloc();
+    return memory;
+}
+
+void* operator new(std::size_t size, std::align_val_t align) {
+    allocationCount++;
+    allocationBytes += size;
+    std::size_t alignment = (std::size_t)align;
+#ifdef _WIN32
+    // MinGW's msvcrt has no aligned_alloc, and this has to be freed with _aligned_free
+    void* memory = _aligned_malloc(size ? size : 1, alignment);
+#else
+    // aligned_alloc wants the size to be a multiple of the alignment
+    void* memory = aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+    if (!memory) throw std::bad_alloc();
+    return memory;
+}
+
+static void freeAligned(void* memory) {
+#ifdef _WIN32
+    _aligned_free(memory);
+#else
+    free(memory);
+#endif
+}
+
+void operator delete(void* memory) noexcept { free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { freeAligned(memory); }
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept { freeAligned(memory); }
+
+#endif
+
+void AllocationCheck::startFromEnvironment() {
+    const char* check = getenv("ECOQUEST_ALLOC_CHECK");
+    enabled = check && check[0] != '\0' && check[0] != '0';
+#ifdef ECOQUEST_NO_ALLOC_COUNT
+    if (enabled) printf("AllocationCheck: built with ECOQUEST_NO_ALLOC_COUNT, nothing to check\n");
+    enabled = false;
+#endif
+}
+
+void AllocationCheck::beginFrame() {
+    if (!enabled) return;
+    start = threadAllocations();
+}
+
+void AllocationCheck::endFrame(const char* state, bool steady) {
+    if (!enabled) return;
+    AllocationCounts now = threadAllocations();
+    uint64_t allocations = now.allocations - start.allocations;
+    frames++;
+    if (!steady) {
+        if (allocations > mostOnEnter) mostOnEnter = allocations;
+        return;
+    }
+    steadyFrames++;
+    if (allocations > 0) {
+        failures++;
+        printf("AllocationCheck: frame %d (%s) allocated %llu times, %llu bytes\n",
+               frames, state, (unsigned long long)allocations,
+               (unsigned long long)(now.bytes - start.bytes));
+    }
+}
+
+void AllocationCheck::printReport() const {
+    if (!enabled) return;
+    printf("AllocationCheck: %d of %d steady-state frames allocated, "
+           "building a screen took at most %llu allocations\n",
+           failures, steadyFrames, (unsigned long long)mostOnEnter);
+}
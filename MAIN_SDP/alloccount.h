@@ -0,0 +1,55 @@
+#ifndef ALLOCCOUNT_H
+#define ALLOCCOUNT_H
+
+#include <cstdint>
+
+// Heap allocation counting, to keep the frame loop off the heap. The
+// embedded target's heap is small and fragments over a long uptime, so once
+// a screen is up, redrawing it and handling touches shouldn't allocate at
+// all. Building a screen (onEnter) still may.
+//
+// Global operator new and delete are replaced to count every allocation
+// made by the calling thread. Build with -DECOQUEST_NO_ALLOC_COUNT to leave
+// the standard ones alone, the counts are then always zero.
+//
+//   ECOQUEST_ALLOC_CHECK=1   report every steady-state frame that allocates,
+//                            and make a replay exit with an error if any did
+//                            (make check_alloc)
+
+struct AllocationCounts {
+    uint64_t allocations;
+    uint64_t bytes;
+};
+
+// Everything this thread has allocated so far
+AllocationCounts threadAllocations();
+
+class AllocationCheck {
+public:
+    AllocationCheck()
+        : enabled(false), frames(0), steadyFrames(0), failures(0), mostOnEnter(0), start{0, 0} {}
+
+    // Turns the check on if ECOQUEST_ALLOC_CHECK is set
+    void startFromEnvironment();
+
+    // Bracket one frame of the game loop. steady is false for a frame that
+    // built a new screen, those are allowed to allocate.
+    void beginFrame();
+    void endFrame(const char* state, bool steady);
+
+    bool failed() const { return failures > 0; }
+    void printReport() const;
+
+    bool enabled;
+
+private:
+    int frames;
+    int steadyFrames;
+    int failures;
+    uint64_t mostOnEnter;
+    AllocationCounts start;
+};
+
+extern AllocationCheck allocCheck;
+
+#endif
@@ -0,0 +1,601 @@
+#include "ambient.h"
+#include "input.h"
+#include "scene.h"
+#include "profiler.h"
+#include "png.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define PARTICLES_X86 1
+#include <immintrin.h>
+#endif
+
+SpriteAtlas spriteAtlas;
+
+struct WeatherStyle {
+    int particles;              // how many to start with
+    int width, height;          // of one particle
+    float speedX[2], speedY[2];  // pixels per second, lowest and highest
+    float sway, swayRate;
+    unsigned int colors[4];
+};
+
+static const WeatherStyle weatherStyles[] = {
+    // WEATHER_NONE
+    {0, 0, 0, {0, 0}, {0, 0}, 0, 0, {0, 0, 0, 0}},
+    // Sand: lots of fine grains blown sideways, fast
+    {3000, 1, 1, {90, 220}, {-6, 14}, 10, 0.7f, {0xFFE3C58A, 0xFFD9B26F, 0xFFC99A5B, 0xFFF0D9A8}},
+    // Snow: slow flakes drifting down
+    {1200, 2, 2, {-8, 8}, {20, 45}, 18, 0.35f, {0xFFFFFFFF, 0xFFF2F6FF, 0xFFDDE8F5, 0xFFFFFFFF}},
+    // Leaves: a few, tumbling down with a lot of sway
+    {300, 3, 2, {-10, 20}, {18, 35}, 40, 0.5f, {0xFFD9822B, 0xFFB5521B, 0xFF8FA33B, 0xFFC9A227}},
+};
+
+// Scalar kernels
+
+static void advanceScalar(float* x, float* y, float* phase, const float* vx, const float* vy,
+                          int count, const ParticleStep& step) {
+    float phaseStep = step.dt * step.swayRate;
+    for (int i = 0; i < count; i++) {
+        float p = phase[i] + phaseStep;
+        p = p - floorf(p);
+        phase[i] = p;
+        // Triangle wave, -1 to 1 and back over one cycle
+        float wave = fabsf(p * 2.0f - 1.0f) * 2.0f - 1.0f;
+        float nx = x[i] + (vx[i] + step.sway * wave) * step.dt;
+        float ny = y[i] + vy[i] * step.dt;
+        x[i] = nx - floorf(nx * step.invWidth) * step.width;
+        y[i] = ny - floorf(ny * step.invHeight) * step.height;
+    }
+}
+
+static void locateScalar(const float* x, const float* y, int* offsets, int count, const ParticleClip& clip) {
+    for (int i = 0; i < count; i++) {
+        float px = (float)(int)x[i];
+        float py = (float)(int)y[i];
+        bool inside = px >= clip.left && px <= clip.right && py >= clip.top && py <= clip.bottom;
+        offsets[i] = inside ? (int)((py - clip.top) * clip.stride + (px - clip.left)) : -1;
+    }
+}
+
+static const ParticleKernels scalarParticles = {"scalar", advanceScalar, locateScalar};
+
+#ifdef PARTICLES_X86
+
+// SSE2 has no floor, truncate and step down where that went up
+__attribute__((target("sse2")))
+static inline __m128 floorSse2(__m128 v) {
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, v), _mm_set1_ps(1.0f)));
+}
+
+__attribute__((target("sse2")))
+static void advanceSse2(float* x, float* y, float* phase, const float* vx, const float* vy,
+                        int count, const ParticleStep& step) {
+    float phaseStep = step.dt * step.swayRate;
+    __m128 phaseAdd = _mm_set1_ps(phaseStep);
+    __m128 dt = _mm_set1_ps(step.dt);
+    __m128 sway = _mm_set1_ps(step.sway);
+    __m128 width = _mm_set1_ps(step.width), invWidth = _mm_set1_ps(step.invWidth);
+    __m128 height = _mm_set1_ps(step.height), invHeight = _mm_set1_ps(step.invHeight);
+    __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f);
+    __m128 sign = _mm_set1_ps(-0.0f);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 p = _mm_add_ps(_mm_loadu_ps(phase + i), phaseAdd);
+        p = _mm_sub_ps(p, floorSse2(p));
+        _mm_storeu_ps(phase + i, p);
+        __m128 wave = _mm_sub_ps(_mm_mul_ps(_mm_andnot_ps(sign, _mm_sub_ps(_mm_mul_ps(p, two), one)), two), one);
+        __m128 nx = _mm_add_ps(_mm_loadu_ps(x + i),
+                               _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(vx + i), _mm_mul_ps(sway, wave)), dt));
+        __m128 ny = _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(_mm_loadu_ps(vy + i), dt));
+        _mm_storeu_ps(x + i, _mm_sub_ps(nx, _mm_mul_ps(floorSse2(_mm_mul_ps(nx, invWidth)), width)));
+        _mm_storeu_ps(y + i, _mm_sub_ps(ny, _mm_mul_ps(floorSse2(_mm_mul_ps(ny, invHeight)), height)));
+    }
+    advanceScalar(x + i, y + i, phase + i, vx + i, vy + i, count - i, step);
+}
+
+__attribute__((target("sse2")))
+static void locateSse2(const float* x, const float* y, int* offsets, int count, const ParticleClip& clip) {
+    __m128 left = _mm_set1_ps(clip.left), right = _mm_set1_ps(clip.right);
+    __m128 top = _mm_set1_ps(clip.top), bottom = _mm_set1_ps(clip.bottom);
+    __m128 stride = _mm_set1_ps(clip.stride);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 px = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_loadu_ps(x + i)));
+        __m128 py = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_loadu_ps(y + i)));
+        __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(px, left), _mm_cmple_ps(px, right)),
+                                   _mm_and_ps(_mm_cmpge_ps(py, top), _mm_cmple_ps(py, bottom)));
+        __m128i offset = _mm_cvttps_epi32(
+            _mm_add_ps(_mm_mul_ps(_mm_sub_ps(py, top), stride), _mm_sub_ps(px, left)));
+        __m128i mask = _mm_castps_si128(inside);
+        _mm_storeu_si128((__m128i*)(offsets + i),
+                         _mm_or_si128(_mm_and_si128(mask, offset), _mm_andnot_si128(mask, _mm_set1_epi32(-1))));
+    }
+    locateScalar(x + i, y + i, offsets + i, count - i, clip);
+}
+
+static const ParticleKernels sse2Particles = {"sse2", advanceSse2, locateSse2};
+
+__attribute__((target("avx2")))
+static void advanceAvx2(float* x, float* y, float* phase, const float* vx, const float* vy,
+                        int count, const ParticleStep& step) {
+    float phaseStep = step.dt * step.swayRate;
+    __m256 phaseAdd = _mm256_set1_ps(phaseStep);
+    __m256 dt = _mm256_set1_ps(step.dt);
+    __m256 sway = _mm256_set1_ps(step.sway);
+    __m256 width = _mm256_set1_ps(step.width), invWidth = _mm256_set1_ps(step.invWidth);
+    __m256 height = _mm256_set1_ps(step.height), invHeight = _mm256_set1_ps(step.invHeight);
+    __m256 one = _mm256_set1_ps(1.0f), two = _mm256_set1_ps(2.0f);
+    __m256 sign = _mm256_set1_ps(-0.0f);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 p = _mm256_add_ps(_mm256_loadu_ps(phase + i), phaseAdd);
+        p = _mm256_sub_ps(p, _mm256_floor_ps(p));
+        _mm256_storeu_ps(phase + i, p);
+        __m256 wave = _mm256_sub_ps(
+            _mm256_mul_ps(_mm256_andnot_ps(sign, _mm256_sub_ps(_mm256_mul_ps(p, two), one)), two), one);
+        __m256 nx = _mm256_add_ps(_mm256_loadu_ps(x + i),
+                                  _mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(vx + i), _mm256_mul_ps(sway, wave)), dt));
+        __m256 ny = _mm256_add_ps(_mm256_loadu_ps(y + i), _mm256_mul_ps(_mm256_loadu_ps(vy + i), dt));
+        _mm256_storeu_ps(x + i, _mm256_sub_ps(nx, _mm256_mul_ps(_mm256_floor_ps(_mm256_mul_ps(nx, invWidth)), width)));
+        _mm256_storeu_ps(y + i, _mm256_sub_ps(ny, _mm256_mul_ps(_mm256_floor_ps(_mm256_mul_ps(ny, invHeight)), height)));
+    }
+    advanceScalar(x + i, y + i, phase + i, vx + i, vy + i, count - i, step);
+}
+
+__attribute__((target("avx2")))
+static void locateAvx2(const float* x, const float* y, int* offsets, int count, const ParticleClip& clip) {
+    __m256 left = _mm256_set1_ps(clip.left), right = _mm256_set1_ps(clip.right);
+    __m256 top = _mm256_set1_ps(clip.top), bottom = _mm256_set1_ps(clip.bottom);
+    __m256 stride = _mm256_set1_ps(clip.stride);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 px = _mm256_cvtepi32_ps(_mm256_cvttps_epi32(_mm256_loadu_ps(x + i)));
+        __m256 py = _mm256_cvtepi32_ps(_mm256_cvttps_epi32(_mm256_loadu_ps(y + i)));
+        __m256 inside = _mm256_and_ps(
+            _mm256_and_ps(_mm256_cmp_ps(px, left, _CMP_GE_OQ), _mm256_cmp_ps(px, right, _CMP_LE_OQ)),
+            _mm256_and_ps(_mm256_cmp_ps(py, top, _CMP_GE_OQ), _mm256_cmp_ps(py, bottom, _CMP_LE_OQ)));
+        __m256i offset = _mm256_cvttps_epi32(
+            _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(py, top), stride), _mm256_sub_ps(px, left)));
+        __m256i mask = _mm256_castps_si256(inside);
+        _mm256_storeu_si256((__m256i*)(offsets + i),
+                            _mm256_or_si256(_mm256_and_si256(mask, offset),
+                                            _mm256_andnot_si256(mask, _mm256_set1_epi32(-1))));
+    }
+    locateScalar(x + i, y + i, offsets + i, count - i, clip);
+}
+
+static const ParticleKernels avx2Particles = {"avx2", advanceAvx2, locateAvx2};
+
+#endif
+
+static std::vector<const ParticleKernels*> supportedParticleSets() {
+    std::vector<const ParticleKernels*> sets = {&scalarParticles};
+#ifdef PARTICLES_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) sets.push_back(&sse2Particles);
+    if (__builtin_cpu_supports("avx2")) sets.push_back(&avx2Particles);
+#endif
+    return sets;
+}
+
+int particleKernelSetCount() {
+    return (int)supportedParticleSets().size();
+}
+
+const ParticleKernels& particleKernelSet(int index) {
+    return *supportedParticleSets()[index];
+}
+
+const ParticleKernels& particleKernels() {
+    static const ParticleKernels* chosen = [] {
+        std::vector<const ParticleKernels*> sets = supportedParticleSets();
+        const char* wanted = getenv("ECOQUEST_BLIT");
+        if (wanted) {
+            for (const ParticleKernels* set : sets) {
+                if (strcmp(set->name, wanted) == 0) return set;
+            }
+        }
+        // Sets are listed from slowest to fastest
+        return sets.back();
+    }();
+    return *chosen;
+}
+
+// ParticleField
+
+ParticleField::ParticleField() : style(&weatherStyles[WEATHER_NONE]), width(0), height(0), activeCount(0) {}
+
+void ParticleField::reset(Weather weather, int count, uint32_t seed, int fieldWidth, int fieldHeight) {
+    style = &weatherStyles[weather];
+    width = fieldWidth;
+    height = fieldHeight;
+    count = std::max(0, std::min(count, AMBIENT_MAX_PARTICLES));
+    x.resize(count);
+    y.resize(count);
+    vx.resize(count);
+    vy.resize(count);
+    phase.resize(count);
+    shade.resize(count);
+    offsets.resize(count);
+
+    // Same weather every time for the same seed
+    uint32_t state = seed * 2654435761u + 1;
+    auto next = [&state]() {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) * (1.0f / 16777216.0f);
+    };
+    for (int i = 0; i < count; i++) {
+        x[i] = next() * width;
+        y[i] = next() * height;
+        vx[i] = style->speedX[0] + next() * (style->speedX[1] - style->speedX[0]);
+        vy[i] = style->speedY[0] + next() * (style->speedY[1] - style->speedY[0]);
+        phase[i] = next();
+        shade[i] = (uint8_t)(next() * 4) & 3;
+    }
+    activeCount = count;
+}
+
+void ParticleField::clear() {
+    style = &weatherStyles[WEATHER_NONE];
+    activeCount = 0;
+}
+
+void ParticleField::setActive(int count) {
+    activeCount = std::max(0, std::min(count, capacity()));
+}
+
+void ParticleField::advance(float dt) {
+    if (activeCount == 0) return;
+    ParticleStep step;
+    step.dt = dt;
+    step.sway = style->sway;
+    step.swayRate = style->swayRate;
+    step.width = (float)width;
+    step.height = (float)height;
+    step.invWidth = 1.0f / width;
+    step.invHeight = 1.0f / height;
+    particleKernels().advance(x.data(), y.data(), phase.data(), vx.data(), vy.data(), activeCount, step);
+}
+
+void ParticleField::compose(const Canvas& canvas) const {
+    if (activeCount == 0) return;
+    ParticleClip clip;
+    clip.left = (float)canvas.x;
+    clip.top = (float)canvas.y;
+    clip.right = (float)(canvas.x + canvas.width - style->width);
+    clip.bottom = (float)(canvas.y + canvas.height - style->height);
+    clip.stride = (float)canvas.width;
+    particleKernels().locate(x.data(), y.data(), offsets.data(), activeCount, clip);
+
+    // Plotting scatters all over the canvas, that part stays scalar
+    bool straddles = style->width > 1 || style->height > 1;
+    for (int i = 0; i < activeCount; i++) {
+        int offset = offsets[i];
+        unsigned int color = style->colors[shade[i]];
+        if (offset < 0) {
+            // Dirty cells cut canvases between particles, so one hanging
+            // over the edge draws the part that's on it
+            if (straddles) {
+                Rect part = Rect{(int)x[i], (int)y[i], style->width, style->height}.intersection(
+                    Rect{canvas.x, canvas.y, canvas.width, canvas.height});
+                if (!part.isEmpty()) canvasFill(canvas, part.x, part.y, part.width, part.height, color);
+            }
+            continue;
+        }
+        unsigned int* pixel = canvas.pixels + offset;
+        for (int row = 0; row < style->height; row++, pixel += canvas.width) {
+            for (int col = 0; col < style->width; col++) pixel[col] = color;
+        }
+    }
+}
+
+void ParticleField::markCells(uint8_t* cells) const {
+    for (int i = 0; i < activeCount; i++) {
+        // Positions are wrapped onto the screen, never negative
+        int left = (int)x[i];
+        int top = (int)y[i];
+        int firstColumn = left / AMBIENT_CELL;
+        int lastColumn = std::min(AMBIENT_CELL_COLUMNS - 1, (left + style->width - 1) / AMBIENT_CELL);
+        int firstRow = top / AMBIENT_CELL;
+        int lastRow = std::min(AMBIENT_CELL_ROWS - 1, (top + style->height - 1) / AMBIENT_CELL);
+        for (int row = firstRow; row <= lastRow; row++) {
+            for (int column = firstColumn; column <= lastColumn; column++) {
+                cells[row * AMBIENT_CELL_COLUMNS + column] = 1;
+            }
+        }
+    }
+}
+
+// SpriteAtlas
+
+SpriteAtlas::SpriteAtlas(int atlasWidth, int atlasHeight)
+    : width(atlasWidth), height(atlasHeight), shelfX(0), shelfY(0), shelfHeight(0) {}
+
+int SpriteAtlas::addFrame(const unsigned int* source, int stride, int frameWidth, int frameHeight) {
+    if (frameWidth <= 0 || frameHeight <= 0 || frameWidth > width) return -1;
+    // Next shelf down when this one's full
+    if (shelfX + frameWidth > width) {
+        shelfY += shelfHeight;
+        shelfX = 0;
+        shelfHeight = 0;
+    }
+    if (shelfY + frameHeight > height) return -1;
+    if (pixels.empty()) pixels.assign((size_t)width * height, 0);
+
+    for (int row = 0; row < frameHeight; row++) {
+        std::copy(source + (size_t)row * stride, source + (size_t)row * stride + frameWidth,
+                  pixels.begin() + (size_t)(shelfY + row) * width + shelfX);
+    }
+    frames.push_back(Rect{shelfX, shelfY, frameWidth, frameHeight});
+    shelfX += frameWidth;
+    shelfHeight = std::max(shelfHeight, frameHeight);
+    return (int)frames.size() - 1;
+}
+
+int SpriteAtlas::addSheet(const PngImage& sheet, int frameWidth, int frameHeight, int count) {
+    int columns = frameWidth > 0 ? sheet.width / frameWidth : 0;
+    if (columns == 0 || count <= 0 || (count + columns - 1) / columns * frameHeight > sheet.height) return -1;
+    int first = -1;
+    for (int i = 0; i < count; i++) {
+        const unsigned int* source = sheet.pixels.data() + (size_t)(i / columns) * frameHeight * sheet.width +
+                                     (i % columns) * frameWidth;
+        int id = addFrame(source, sheet.width, frameWidth, frameHeight);
+        if (id < 0) return -1;
+        if (i == 0) first = id;
+    }
+    return first;
+}
+
+int SpriteAtlas::find(const std::string& animation) const {
+    auto found = names.find(animation);
+    return found == names.end() ? -1 : found->second;
+}
+
+void SpriteAtlas::name(const std::string& animation, int firstFrame) {
+    names[animation] = firstFrame;
+}
+
+void SpriteAtlas::draw(int id, const Canvas& canvas, int x, int y) const {
+    if (id < 0 || id >= (int)frames.size()) return;
+    const Rect& source = frames[id];
+    int left = std::max(x, canvas.x);
+    int top = std::max(y, canvas.y);
+    int right = std::min(x + source.width, canvas.x + canvas.width);
+    int bottom = std::min(y + source.height, canvas.y + canvas.height);
+    if (left >= right || top >= bottom) return;
+
+    const BlitKernels& kernels = blitKernels();
+    for (int row = top; row < bottom; row++) {
+        kernels.blend(pixels.data() + (size_t)(source.y + row - y) * width + source.x + (left - x),
+                      canvas.pixels + (size_t)(row - canvas.y) * canvas.width + (left - canvas.x),
+                      right - left);
+    }
+}
+
+size_t SpriteAtlas::usedPixels() const {
+    size_t used = 0;
+    for (const Rect& frame : frames) used += (size_t)frame.width * frame.height;
+    return used;
+}
+
+int addIdleFrames(SpriteAtlas& atlas, const PngImage& background, const Rect& bounds) {
+    Rect image = {0, 0, background.width, background.height};
+    Rect area = bounds.intersection(image);
+    if (area.isEmpty()) return -1;
+
+    // Each frame stretches the animal up a little more, anchored at its feet
+    std::vector<unsigned int> frame((size_t)area.width * area.height);
+    int first = -1;
+    for (int i = 0; i < IDLE_FRAMES; i++) {
+        float stretch = 1.0f + 0.02f * i;
+        for (int row = 0; row < area.height; row++) {
+            int fromBottom = (int)((area.height - 1 - row) / stretch);
+            int source = area.y + area.height - 1 - fromBottom;
+            std::copy(background.pixels.begin() + (size_t)source * background.width + area.x,
+                      background.pixels.begin() + (size_t)source * background.width + area.x + area.width,
+                      frame.begin() + (size_t)row * area.width);
+        }
+        int id = atlas.addFrame(frame.data(), area.width, area.width, area.height);
+        if (id < 0) return -1;
+        if (i == 0) first = id;
+    }
+    return first;
+}
+
+// AmbientLayer
+
+AmbientLayer::AmbientLayer()
+    : weather(WEATHER_NONE), target(0), weatherInterval(1), weatherTicks(0), weatherTime(0), averageFrame(0),
+      settle(0), frames(0), framesOver(0), frameTotal(0), updateTotal(0), fewest(), cuts(0) {
+    memset(drawnCells, 0, sizeof(drawnCells));
+}
+
+bool AmbientLayer::enabled(bool virtualClock) {
+    static const bool wanted = [] {
+        const char* setting = getenv("ECOQUEST_AMBIENT");
+        return !setting || strcmp(setting, "0") != 0;
+    }();
+    return wanted && !virtualClock;
+}
+
+void AmbientLayer::start(Weather newWeather, uint32_t seed) {
+    weather = newWeather;
+    const WeatherStyle& style = weatherStyles[weather];
+    if (weather == WEATHER_NONE) {
+        particles.clear();
+        return;
+    }
+    particles.reset(weather, style.particles, seed, SCREEN_WIDTH, SCREEN_HEIGHT);
+    target = particles.capacity();
+    // Start from what the budget allowed last time on this weather rather
+    // than from the top, sand's floor says nothing about leaves
+    int& lowest = fewest[weather];
+    if (lowest > 0 && lowest < target) particles.setActive(lowest);
+    if (lowest == 0) lowest = particles.active();
+    // The whole screen gets drawn with the layer's first frame, after that
+    // it's where particles were
+    memset(drawnCells, 0, sizeof(drawnCells));
+    particles.markCells(drawnCells);
+    weatherInterval = 1;
+    weatherTicks = 0;
+    weatherTime = 0;
+    averageFrame = 0;
+    settle = AMBIENT_SETTLE_FRAMES;
+}
+
+void AmbientLayer::addSprite(int firstFrame, int frameCount, double fps, int x, int y) {
+    Sprite sprite;
+    sprite.firstFrame = firstFrame;
+    sprite.frameCount = frameCount;
+    sprite.fps = fps;
+    // Staggered, so the animals don't all breathe together
+    sprite.time = sprites.size() * 0.37;
+    sprite.shown = -1;
+    sprite.x = x;
+    sprite.y = y;
+    sprites.push_back(sprite);
+}
+
+void AmbientLayer::clear() {
+    weather = WEATHER_NONE;
+    particles.clear();
+    sprites.clear();
+}
+
+// Dirty cells go to the scene as rectangles: runs along each row, stacked
+// up while the rows below have a run in just the same place. Mostly dirty
+// is cheaper redrawn as one screen than as lots of pieces.
+static void markCellsDirty(Scene& scene, const uint8_t* cells) {
+    int dirtyCount = 0;
+    for (int i = 0; i < AMBIENT_CELL_ROWS * AMBIENT_CELL_COLUMNS; i++) dirtyCount += cells[i];
+    if (dirtyCount * 4 >= AMBIENT_CELL_ROWS * AMBIENT_CELL_COLUMNS * 3) {
+        scene.markDirty(Rect{0, 0, SCREEN_WIDTH, SCREEN_HEIGHT});
+        return;
+    }
+
+    Rect open[AMBIENT_CELL_COLUMNS];
+    int openCount = 0;
+    for (int row = 0; row <= AMBIENT_CELL_ROWS; row++) {
+        Rect runs[AMBIENT_CELL_COLUMNS];
+        int runCount = 0;
+        // One row past the end, so the last runs get flushed
+        if (row < AMBIENT_CELL_ROWS) {
+            const uint8_t* line = cells + row * AMBIENT_CELL_COLUMNS;
+            for (int column = 0; column < AMBIENT_CELL_COLUMNS; column++) {
+                if (!line[column]) continue;
+                int first = column;
+                while (column + 1 < AMBIENT_CELL_COLUMNS && line[column + 1]) column++;
+                runs[runCount++] = Rect{first * AMBIENT_CELL, row * AMBIENT_CELL,
+                                        (column - first + 1) * AMBIENT_CELL, AMBIENT_CELL};
+            }
+        }
+        for (int i = 0; i < openCount; i++) {
+            bool carriedOn = false;
+            for (int j = 0; j < runCount && !carriedOn; j++) {
+                if (runs[j].x == open[i].x && runs[j].width == open[i].width) {
+                    runs[j] = open[i];
+                    runs[j].height += AMBIENT_CELL;
+                    carriedOn = true;
+                }
+            }
+            if (!carriedOn) scene.markDirty(open[i]);
+        }
+        std::copy(runs, runs + runCount, open);
+        openCount = runCount;
+    }
+}
+
+void AmbientLayer::update(double dt, Scene& scene) {
+    PROFILE_SCOPE("AmbientLayer::update");
+    double start = inputClock();
+    weatherTime += dt;
+    if (weather != WEATHER_NONE && ++weatherTicks >= weatherInterval) {
+        particles.advance((float)weatherTime);
+        weatherTicks = 0;
+        weatherTime = 0;
+        // Cells particles left need the background back, the ones they're
+        // in now need them drawn
+        uint8_t dirty[AMBIENT_CELL_ROWS * AMBIENT_CELL_COLUMNS];
+        memcpy(dirty, drawnCells, sizeof(dirty));
+        memset(drawnCells, 0, sizeof(drawnCells));
+        particles.markCells(drawnCells);
+        for (size_t i = 0; i < sizeof(dirty); i++) dirty[i] |= drawnCells[i];
+        markCellsDirty(scene, dirty);
+    }
+    for (Sprite& sprite : sprites) {
+        sprite.time += dt;
+        // Forwards then back, so a loop never jumps
+        int cycle = std::max(1, 2 * sprite.frameCount - 2);
+        int step = (int)(sprite.time * sprite.fps) % cycle;
+        int shown = step < sprite.frameCount ? step : cycle - step;
+        if (shown == sprite.shown) continue;
+        sprite.shown = shown;
+        const Rect& frame = spriteAtlas.frame(sprite.firstFrame + shown);
+        scene.markDirty(Rect{sprite.x, sprite.y, frame.width, frame.height});
+    }
+    updateTotal += inputClock() - start;
+}
+
+void AmbientLayer::compose(const Canvas& canvas) const {
+    for (const Sprite& sprite : sprites) {
+        spriteAtlas.draw(sprite.firstFrame + std::max(sprite.shown, 0), canvas, sprite.x, sprite.y);
+    }
+    particles.compose(canvas);
+}
+
+void AmbientLayer::frameTook(double seconds) {
+    // Only weather can be scaled back
+    if (weather == WEATHER_NONE) return;
+    frames++;
+    frameTotal += seconds;
+    if (seconds > AMBIENT_FRAME_BUDGET) framesOver++;
+    averageFrame = averageFrame == 0 ? seconds : averageFrame * 0.8 + seconds * 0.2;
+
+    // Give the last change a few frames to show up in the average
+    if (settle > 0) {
+        settle--;
+        return;
+    }
+    // Particles go first, then how often they move. Winning back is the
+    // other way round.
+    int active = particles.active();
+    if (averageFrame > AMBIENT_FRAME_BUDGET) {
+        if (active > AMBIENT_MIN_PARTICLES) {
+            particles.setActive(std::max(AMBIENT_MIN_PARTICLES, active * 3 / 4));
+        } else if (weatherInterval < AMBIENT_MAX_WEATHER_INTERVAL) {
+            weatherInterval *= 2;
+        } else {
+            return;
+        }
+        cuts++;
+        settle = AMBIENT_SETTLE_FRAMES;
+    } else if (averageFrame < AMBIENT_FRAME_BUDGET / 2) {
+        if (weatherInterval > 1) {
+            weatherInterval /= 2;
+        } else if (active < target) {
+            particles.setActive(std::min(target, active + target / 16));
+        } else {
+            return;
+        }
+        settle = AMBIENT_SETTLE_FRAMES;
+    }
+    fewest[weather] = std::min(fewest[weather], particles.active());
+}
+
+void AmbientLayer::printStats() const {
+    if (frames == 0) return;
+    printf("Ambient: %lld frames, %.2f ms average, %lld over the %.1f ms budget, update %.3f ms average (%s)\n",
+           frames, frameTotal * 1e3 / frames, framesOver, AMBIENT_FRAME_BUDGET * 1e3,
+           updateTotal * 1e3 / frames, particleKernels().name);
+    printf("Ambient: %d particles now moving every %d ticks, fewest sand %d, snow %d, leaves %d, "
+           "cut back %d times; atlas %d frames, %.0f%% full\n",
+           particles.active(), weatherInterval, fewest[WEATHER_SAND], fewest[WEATHER_SNOW],
+           fewest[WEATHER_LEAVES], cuts, spriteAtlas.frameCount(),
+           100.0 * spriteAtlas.usedPixels() / (ATLAS_WIDTH * ATLAS_HEIGHT));
+}
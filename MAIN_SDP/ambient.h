@@ -0,0 +1,216 @@
+#ifndef AMBIENT_H
+#define AMBIENT_H
+
+#include "blit.h"
+#include "drawlist.h"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+class Scene;
+
+// Life on the biome screens: weather blowing across them and the animals
+// breathing. The layer is composed over the background and under
+// everything else, and moves on AMBIENT_FPS times a second off a
+// scheduler timer while a biome is up.
+//
+// It runs on the real clock only. Replays and the session host run on a
+// virtual clock and leave it off, so their frames stay exactly
+// reproducible and a finished replay isn't kept alive by the timer.
+//
+//   ECOQUEST_AMBIENT=0   no weather or idle animations at all
+//
+// Particle counts follow a frame budget: when frames with the layer up
+// average more than AMBIENT_FRAME_BUDGET, particles are shed until they
+// fit, and won back slowly once there's room again. Weather only redraws
+// the cells its particles were in and moved into, so fewer particles is
+// less of the screen to redraw. Down at AMBIENT_MIN_PARTICLES and still
+// over, the weather moves on less often instead.
+
+#define AMBIENT_FPS 30
+#define AMBIENT_MAX_PARTICLES 4096
+#define AMBIENT_MIN_PARTICLES 64
+// A third of a frame at AMBIENT_FPS, the rest is for everything else
+#define AMBIENT_FRAME_BUDGET 0.011
+// Frames to wait after changing the particle count before judging it again
+#define AMBIENT_SETTLE_FRAMES 8
+// Ticks the weather can be held still for at most, when particles alone
+// can't fit the budget
+#define AMBIENT_MAX_WEATHER_INTERVAL 4
+// Weather marks the screen dirty in AMBIENT_CELL x AMBIENT_CELL squares
+#define AMBIENT_CELL 16
+#define AMBIENT_CELL_COLUMNS (SCREEN_WIDTH / AMBIENT_CELL)
+#define AMBIENT_CELL_ROWS (SCREEN_HEIGHT / AMBIENT_CELL)
+
+// Shared sheet every sprite frame lives in
+#define ATLAS_WIDTH 1024
+#define ATLAS_HEIGHT 512
+
+enum Weather { WEATHER_NONE, WEATHER_SAND, WEATHER_SNOW, WEATHER_LEAVES, WEATHER_COUNT };
+
+// One step of particle movement, see ParticleKernels::advance
+struct ParticleStep {
+    float dt;
+    float sway;       // pixels per second at the top of a sway
+    float swayRate;   // sway cycles per second
+    float width, height;
+    float invWidth, invHeight;
+};
+
+// Where particles can land on a canvas, see ParticleKernels::locate
+struct ParticleClip {
+    float left, top;     // canvas origin on screen
+    float right, bottom;  // last position a whole particle fits at
+    float stride;         // canvas width
+};
+
+// Kernels over the particle arrays, with the same scalar / SSE2 / AVX2
+// sets and CPU check as blit.h. ECOQUEST_BLIT picks the set here too.
+// Every set gives exactly the same results.
+struct ParticleKernels {
+    const char* name;
+    // Move each particle by its velocity plus a triangle wave sway, and
+    // wrap it back onto the width x height screen
+    void (*advance)(float* x, float* y, float* phase, const float* vx, const float* vy,
+                    int count, const ParticleStep& step);
+    // Canvas pixel offset of each particle, -1 where it doesn't fit
+    void (*locate)(const float* x, const float* y, int* offsets, int count, const ParticleClip& clip);
+};
+
+const ParticleKernels& particleKernels();
+int particleKernelSetCount();
+const ParticleKernels& particleKernelSet(int index);
+
+struct WeatherStyle;
+
+// Particles as a structure of arrays, so moving them is a pass over plain
+// float arrays 4 or 8 at a time. Nothing is ever spawned or killed, a
+// particle leaving one edge comes back in at the other.
+class ParticleField {
+public:
+    ParticleField();
+
+    // Up to count particles of weather spread over a width x height screen.
+    // The arrays are sized here, the frames after never allocate.
+    void reset(Weather weather, int count, uint32_t seed, int width, int height);
+    void clear();
+
+    void advance(float dt);
+    void compose(const Canvas& canvas) const;
+    // Set every AMBIENT_CELL square a particle covers any of, cells is
+    // AMBIENT_CELL_ROWS rows of AMBIENT_CELL_COLUMNS
+    void markCells(uint8_t* cells) const;
+
+    int capacity() const { return (int)x.size(); }
+    int active() const { return activeCount; }
+    // Only the first count are moved and drawn
+    void setActive(int count);
+
+private:
+    const WeatherStyle* style;
+    int width, height;
+    int activeCount;
+    std::vector<float> x, y, vx, vy, phase;
+    std::vector<uint8_t> shade;
+    mutable std::vector<int> offsets;
+};
+
+// Sprite frames packed into one shared sheet on shelves, so any number of
+// animations cost one allocation. Frames are added when a screen is built
+// and stay for good. Game thread only.
+class SpriteAtlas {
+public:
+    SpriteAtlas(int width = ATLAS_WIDTH, int height = ATLAS_HEIGHT);
+
+    // Copy a frame in, returns its id or -1 if it's full
+    int addFrame(const unsigned int* pixels, int stride, int width, int height);
+    // Every frame of a sprite sheet, left to right then top to bottom.
+    // Returns the first frame's id, the rest follow on from it.
+    int addSheet(const PngImage& sheet, int frameWidth, int frameHeight, int frames);
+
+    // Animations by name, so each one is only ever added once
+    int find(const std::string& name) const;
+    void name(const std::string& name, int firstFrame);
+
+    int frameCount() const { return (int)frames.size(); }
+    const Rect& frame(int id) const { return frames[id]; }
+    // Blend frame id onto canvas with its top left corner at screen x, y
+    void draw(int id, const Canvas& canvas, int x, int y) const;
+
+    size_t usedPixels() const;
+
+private:
+    int width, height;
+    std::vector<unsigned int> pixels;  // allocated with the first frame
+    std::vector<Rect> frames;
+    std::map<std::string, int> names;
+    int shelfX, shelfY, shelfHeight;
+};
+
+extern SpriteAtlas spriteAtlas;
+
+// Animal idle loop made from the animal's part of the background, gently
+// stretching up and settling back. Returns the first of IDLE_FRAMES frames,
+// -1 if the atlas is full.
+#define IDLE_FRAMES 3
+int addIdleFrames(SpriteAtlas& atlas, const PngImage& background, const Rect& bounds);
+
+// Weather and sprites for one screen
+class AmbientLayer {
+public:
+    AmbientLayer();
+
+    // Off on a virtual clock or with ECOQUEST_AMBIENT=0
+    static bool enabled(bool virtualClock);
+
+    void start(Weather weather, uint32_t seed);
+    // A sprite looping frameCount atlas frames from firstFrame at fps
+    void addSprite(int firstFrame, int frameCount, double fps, int x, int y);
+    void clear();
+    bool isActive() const { return weather != WEATHER_NONE || !sprites.empty(); }
+    // Particles being drawn right now, after the budget's had its say
+    int particleCount() const { return particles.active(); }
+    // Ticks between weather moves, more than 1 once particles alone didn't fit
+    int weatherEvery() const { return weatherInterval; }
+
+    // Move everything on by dt seconds and mark what changed dirty
+    void update(double dt, Scene& scene);
+    void compose(const Canvas& canvas) const;
+
+    // How long the last frame took, to keep particles within the budget
+    void frameTook(double seconds);
+
+    void printStats() const;
+
+private:
+    struct Sprite {
+        int firstFrame, frameCount;
+        double fps, time;
+        int shown;
+        int x, y;
+    };
+
+    Weather weather;
+    ParticleField particles;
+    int target;  // particles wanted, the budget may allow fewer
+    // Cells the particles were drawn in last time they moved
+    uint8_t drawnCells[AMBIENT_CELL_ROWS * AMBIENT_CELL_COLUMNS];
+    // Weather moves every weatherInterval ticks, by all the time since it last did
+    int weatherInterval;
+    int weatherTicks;
+    double weatherTime;
+    std::vector<Sprite> sprites;
+
+    double averageFrame;
+    int settle;
+
+    long long frames;
+    long long framesOver;
+    double frameTotal;
+    double updateTotal;
+    int fewest[WEATHER_COUNT];  // lowest the budget went on each, 0 before the first visit
+    int cuts;
+};
+
+#endif
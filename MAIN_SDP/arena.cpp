@@ -0,0 +1,48 @@
+#include "arena.h"
+#include <cstdint>
+#include <cstring>
+
+Arena::Arena(size_t chunkSize) : chunkSize(chunkSize), current(0), offset(0), used(0), peak(0) {}
+
+void* Arena::allocate(size_t bytes, size_t align) {
+    for (;;) {
+        if (current < chunks.size()) {
+            Chunk& chunk = chunks[current];
+            uintptr_t base = (uintptr_t)chunk.memory.get();
+            size_t start = ((base + offset + align - 1) & ~(uintptr_t)(align - 1)) - base;
+            if (start + bytes <= chunk.size) {
+                used += start + bytes - offset;
+                offset = start + bytes;
+                if (used > peak) peak = used;
+                return chunk.memory.get() + start;
+            }
+            // Doesn't fit, the rest of this chunk goes unused until the reset
+            used += chunk.size - offset;
+            current++;
+            offset = 0;
+            continue;
+        }
+        // Out of chunks, only happens while the arena is still growing
+        size_t size = bytes + align > chunkSize ? bytes + align : chunkSize;
+        chunks.push_back(Chunk{std::unique_ptr<unsigned char[]>(new unsigned char[size]), size});
+    }
+}
+
+std::string_view Arena::copy(std::string_view text) {
+    char* memory = allocate<char>(text.size() + 1);
+    memcpy(memory, text.data(), text.size());
+    memory[text.size()] = '\0';
+    return std::string_view(memory, text.size());
+}
+
+void Arena::reset() {
+    current = 0;
+    offset = 0;
+    used = 0;
+}
+
+size_t Arena::capacity() const {
+    size_t total = 0;
+    for (const auto& chunk : chunks) total += chunk.size;
+    return total;
+}
@@ -0,0 +1,55 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Bump allocator for data that all dies at the same time, like everything a
+// frame needs only while it's being drawn. Allocating is moving a pointer,
+// and reset() frees it all at once by moving it back.
+//
+// Memory comes in chunks that are kept across resets, so once the arena has
+// grown to what a frame needs, frames stop touching the heap. Nothing
+// allocated here gets its destructor run, so only put plain data in it.
+class Arena {
+public:
+    explicit Arena(size_t chunkSize = 16384);
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t bytes, size_t align = alignof(std::max_align_t));
+
+    // Uninitialized room for count T's
+    template <typename T>
+    T* allocate(size_t count) {
+        return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    // A copy of text that lives until the next reset, '\0' terminated so
+    // data() can go straight to the LCD
+    std::string_view copy(std::string_view text);
+
+    // Free everything allocated since the last reset
+    void reset();
+
+    // Most bytes in use between two resets, and what the chunks add up to
+    size_t highWater() const { return peak; }
+    size_t capacity() const;
+
+private:
+    struct Chunk {
+        std::unique_ptr<unsigned char[]> memory;
+        size_t size;
+    };
+
+    std::vector<Chunk> chunks;
+    size_t chunkSize;
+    size_t current;  // chunk being allocated from
+    size_t offset;   // into it
+    size_t used;     // in the chunks before current, plus offset
+    size_t peak;
+};
+
+#endif
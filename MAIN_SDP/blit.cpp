@@ -0,0 +1,290 @@
+#include "blit.h"
+#include "profiler.h"
+#include <FEHLCD.h>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define BLIT_X86 1
+#include <immintrin.h>
+#endif
+
+// Blend one channel pair, divides by 255 with rounding without a divide
+static inline unsigned int blendChannel(unsigned int src, unsigned int dst, unsigned int alpha) {
+    unsigned int t = src * alpha + dst * (255 - alpha) + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+// Scalar kernels
+
+static void expand8Scalar(const unsigned char* indices, const unsigned int* palette,
+                          unsigned int* out, int count) {
+    for (int i = 0; i < count; i++) out[i] = palette[indices[i]];
+}
+
+static void expand16Scalar(const unsigned short* indices, const unsigned int* palette,
+                           unsigned int* out, int count) {
+    for (int i = 0; i < count; i++) out[i] = palette[indices[i]];
+}
+
+static void copyScalar(const unsigned int* src, unsigned int* dst, int count) {
+    memcpy(dst, src, (size_t)count * sizeof(unsigned int));
+}
+
+static void fillScalar(unsigned int color, unsigned int* dst, int count) {
+    for (int i = 0; i < count; i++) dst[i] = color;
+}
+
+static void blendScalar(const unsigned int* src, unsigned int* dst, int count) {
+    for (int i = 0; i < count; i++) {
+        unsigned int s = src[i];
+        unsigned int alpha = s >> 24;
+        if (alpha == 255) {
+            dst[i] = s;
+        } else if (alpha != 0) {
+            unsigned int d = dst[i];
+            dst[i] = 0xff000000 |
+                     blendChannel((s >> 16) & 0xff, (d >> 16) & 0xff, alpha) << 16 |
+                     blendChannel((s >> 8) & 0xff, (d >> 8) & 0xff, alpha) << 8 |
+                     blendChannel(s & 0xff, d & 0xff, alpha);
+        }
+    }
+}
+
+static const BlitKernels scalarKernels = {
+    "scalar", expand8Scalar, expand16Scalar, copyScalar, fillScalar, blendScalar
+};
+
+#ifdef BLIT_X86
+
+// SSE2 has no gather, so palette expansion stays scalar in this set
+
+__attribute__((target("sse2")))
+static void copySse2(const unsigned int* src, unsigned int* dst, int count) {
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_loadu_si128((const __m128i*)(src + i)));
+    }
+    for (; i < count; i++) dst[i] = src[i];
+}
+
+__attribute__((target("sse2")))
+static void fillSse2(unsigned int color, unsigned int* dst, int count) {
+    __m128i value = _mm_set1_epi32((int)color);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) _mm_storeu_si128((__m128i*)(dst + i), value);
+    for (; i < count; i++) dst[i] = color;
+}
+
+// Two pixels widened to 16 bits per channel, blended the same way as blendChannel
+__attribute__((target("sse2")))
+static inline __m128i blendHalfSse2(__m128i src, __m128i dst) {
+    __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(src, _MM_SHUFFLE(3, 3, 3, 3)),
+                                        _MM_SHUFFLE(3, 3, 3, 3));
+    __m128i inverse = _mm_sub_epi16(_mm_set1_epi16(255), alpha);
+    __m128i t = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(src, alpha), _mm_mullo_epi16(dst, inverse)),
+                              _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+__attribute__((target("sse2")))
+static void blendSse2(const unsigned int* src, unsigned int* dst, int count) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i opaque = _mm_set1_epi32((int)0xff000000);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+        __m128i lo = blendHalfSse2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+        __m128i hi = blendHalfSse2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(_mm_packus_epi16(lo, hi), opaque));
+    }
+    blendScalar(src + i, dst + i, count - i);
+}
+
+static const BlitKernels sse2Kernels = {
+    "sse2", expand8Scalar, expand16Scalar, copySse2, fillSse2, blendSse2
+};
+
+__attribute__((target("avx2")))
+static void expand8Avx2(const unsigned char* indices, const unsigned int* palette,
+                        unsigned int* out, int count) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(indices + i)));
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_i32gather_epi32((const int*)palette, index, 4));
+    }
+    for (; i < count; i++) out[i] = palette[indices[i]];
+}
+
+__attribute__((target("avx2")))
+static void expand16Avx2(const unsigned short* indices, const unsigned int* palette,
+                         unsigned int* out, int count) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i index = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(indices + i)));
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_i32gather_epi32((const int*)palette, index, 4));
+    }
+    for (; i < count; i++) out[i] = palette[indices[i]];
+}
+
+__attribute__((target("avx2")))
+static void copyAvx2(const unsigned int* src, unsigned int* dst, int count) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_loadu_si256((const __m256i*)(src + i)));
+    }
+    for (; i < count; i++) dst[i] = src[i];
+}
+
+__attribute__((target("avx2")))
+static void fillAvx2(unsigned int color, unsigned int* dst, int count) {
+    __m256i value = _mm256_set1_epi32((int)color);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) _mm256_storeu_si256((__m256i*)(dst + i), value);
+    for (; i < count; i++) dst[i] = color;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i blendHalfAvx2(__m256i src, __m256i dst) {
+    __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(src, _MM_SHUFFLE(3, 3, 3, 3)),
+                                           _MM_SHUFFLE(3, 3, 3, 3));
+    __m256i inverse = _mm256_sub_epi16(_mm256_set1_epi16(255), alpha);
+    __m256i t = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(src, alpha),
+                                                  _mm256_mullo_epi16(dst, inverse)),
+                                 _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+__attribute__((target("avx2")))
+static void blendAvx2(const unsigned int* src, unsigned int* dst, int count) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i opaque = _mm256_set1_epi32((int)0xff000000);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+        // Unpack and pack both work within 128-bit lanes, so pixel order comes back out right
+        __m256i lo = blendHalfAvx2(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero));
+        __m256i hi = blendHalfAvx2(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_or_si256(_mm256_packus_epi16(lo, hi), opaque));
+    }
+    blendScalar(src + i, dst + i, count - i);
+}
+
+static const BlitKernels avx2Kernels = {
+    "avx2", expand8Avx2, expand16Avx2, copyAvx2, fillAvx2, blendAvx2
+};
+
+#endif
+
+static std::vector<const BlitKernels*> supportedSets() {
+    std::vector<const BlitKernels*> sets = {&scalarKernels};
+#ifdef BLIT_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) sets.push_back(&sse2Kernels);
+    if (__builtin_cpu_supports("avx2")) sets.push_back(&avx2Kernels);
+#endif
+    return sets;
+}
+
+int blitKernelSetCount() {
+    return (int)supportedSets().size();
+}
+
+const BlitKernels& blitKernelSet(int index) {
+    return *supportedSets()[index];
+}
+
+const BlitKernels& blitKernels() {
+    static const BlitKernels* chosen = [] {
+        std::vector<const BlitKernels*> sets = supportedSets();
+        const char* wanted = getenv("ECOQUEST_BLIT");
+        if (wanted) {
+            for (const BlitKernels* set : sets) {
+                if (strcmp(set->name, wanted) == 0) return set;
+            }
+        }
+        // Sets are listed from slowest to fastest
+        return sets.back();
+    }();
+    return *chosen;
+}
+
+// Part of a screen rectangle that lands on the canvas, false if none does
+static bool clipToCanvas(const Canvas& canvas, int& x, int& y, int& width, int& height,
+                         int& skipCols, int& skipRows) {
+    int left = x > canvas.x ? x : canvas.x;
+    int top = y > canvas.y ? y : canvas.y;
+    int right = x + width < canvas.x + canvas.width ? x + width : canvas.x + canvas.width;
+    int bottom = y + height < canvas.y + canvas.height ? y + height : canvas.y + canvas.height;
+    if (right <= left || bottom <= top) return false;
+    skipCols = left - x;
+    skipRows = top - y;
+    x = left;
+    y = top;
+    width = right - left;
+    height = bottom - top;
+    return true;
+}
+
+void canvasFill(const Canvas& canvas, int x, int y, int width, int height, unsigned int color) {
+    int skipCols, skipRows;
+    if (!clipToCanvas(canvas, x, y, width, height, skipCols, skipRows)) return;
+    const BlitKernels& kernels = blitKernels();
+    for (int row = 0; row < height; row++) {
+        unsigned int* dst = canvas.pixels + (size_t)(y - canvas.y + row) * canvas.width + (x - canvas.x);
+        kernels.fill(color | 0xff000000, dst, width);
+    }
+}
+
+static void canvasImage(const Canvas& canvas, const PngImage& image, int x, int y, bool blend) {
+    int width = image.width, height = image.height;
+    int skipCols, skipRows;
+    if (!clipToCanvas(canvas, x, y, width, height, skipCols, skipRows)) return;
+    const BlitKernels& kernels = blitKernels();
+    for (int row = 0; row < height; row++) {
+        const unsigned int* src = image.pixels.data() + (size_t)(skipRows + row) * image.width + skipCols;
+        unsigned int* dst = canvas.pixels + (size_t)(y - canvas.y + row) * canvas.width + (x - canvas.x);
+        if (blend) {
+            kernels.blend(src, dst, width);
+        } else {
+            kernels.copy(src, dst, width);
+        }
+    }
+}
+
+void canvasCopyImage(const Canvas& canvas, const PngImage& image, int x, int y) {
+    canvasImage(canvas, image, x, y, false);
+}
+
+void canvasBlendImage(const Canvas& canvas, const PngImage& image, int x, int y) {
+    canvasImage(canvas, image, x, y, true);
+}
+
+void pushPixels(const unsigned int* pixels, int stride, int x, int y, int width, int height) {
+    PROFILE_SCOPE("pushPixels");
+    // Draw each row as runs of the same color so we only change the
+    // font color and call into the LCD once per run instead of per pixel
+    unsigned int currentColor = 0xffffffff;
+    for (int row = 0; row < height; row++) {
+        const unsigned int* line = pixels + (size_t)row * stride;
+        int col = 0;
+        while (col < width) {
+            unsigned int pixel = line[col];
+            int runEnd = col + 1;
+            while (runEnd < width && line[runEnd] == pixel) runEnd++;
+
+            if ((pixel >> 24) != 0) {
+                unsigned int color = pixel & 0x00ffffff;
+                if (color != currentColor) {
+                    LCD.SetFontColor(color);
+                    currentColor = color;
+                }
+                LCD.DrawHorizontalLine(y + row, x + col, x + runEnd - 1);
+            }
+            col = runEnd;
+        }
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef BLIT_H
+#define BLIT_H
+
+#include "png.h"
+
+// Pixel kernels over rows of 0xAARRGGBB pixels. There is a plain C++
+// version of each, plus SSE2 and AVX2 ones on x86 builds with GCC or
+// clang. The best set the CPU supports is picked the first time
+// blitKernels() is called; ECOQUEST_BLIT=scalar|sse2|avx2 overrides it.
+// Every set produces exactly the same pixels.
+struct BlitKernels {
+    const char* name;
+    // out[i] = palette[indices[i]]
+    void (*expand8)(const unsigned char* indices, const unsigned int* palette, unsigned int* out, int count);
+    void (*expand16)(const unsigned short* indices, const unsigned int* palette, unsigned int* out, int count);
+    void (*copy)(const unsigned int* src, unsigned int* dst, int count);
+    void (*fill)(unsigned int color, unsigned int* dst, int count);
+    // src over dst by src alpha. dst is treated as opaque and stays that way.
+    void (*blend)(const unsigned int* src, unsigned int* dst, int count);
+};
+
+const BlitKernels& blitKernels();
+
+// Every kernel set this build has, for the benchmark. Sets the CPU
+// can't run are left out.
+int blitKernelSetCount();
+const BlitKernels& blitKernelSet(int index);
+
+// An off-screen block of the screen to compose into before it goes to the LCD
+struct Canvas {
+    unsigned int* pixels;  // width * height, row major
+    int x, y;              // where the top left pixel is on screen
+    int width, height;
+};
+
+// Screen coordinates, clipped to the canvas
+void canvasFill(const Canvas& canvas, int x, int y, int width, int height, unsigned int color);
+void canvasCopyImage(const Canvas& canvas, const PngImage& image, int x, int y);
+void canvasBlendImage(const Canvas& canvas, const PngImage& image, int x, int y);
+
+// Send pixels to the LCD as runs of one color, skipping fully transparent ones
+void pushPixels(const unsigned int* pixels, int stride, int x, int y, int width, int height);
+
+#endif
@@ -0,0 +1,162 @@
+#include "content.h"
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+ContentPack::ContentPack()
+    : data(nullptr), size(0), header(nullptr), biomes(nullptr), rects(nullptr),
+      animals(nullptr), answers(nullptr), strings(nullptr) {
+#ifdef _WIN32
+    fileHandle = nullptr;
+    mappingHandle = nullptr;
+#endif
+}
+
+ContentPack::~ContentPack() {
+    close();
+}
+
+bool ContentPack::open(const char* filename) {
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        printf("ContentPack: can't open %s\n", filename);
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view) {
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        printf("ContentPack: can't map %s\n", filename);
+        return false;
+    }
+    fileHandle = file;
+    mappingHandle = mapping;
+    size = (size_t)fileSize.QuadPart;
+#else
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0) {
+        printf("ContentPack: can't open %s\n", filename);
+        return false;
+    }
+    struct stat info;
+    const void* view = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    // The mapping keeps the file alive on its own
+    ::close(fd);
+    if (view == MAP_FAILED) {
+        printf("ContentPack: can't map %s\n", filename);
+        return false;
+    }
+    size = (size_t)info.st_size;
+#endif
+
+    data = (const unsigned char*)view;
+    header = (const PackHeader*)data;
+    if (!validate()) {
+        printf("ContentPack: %s is not a valid version %d content pack\n", filename, CONTENT_VERSION);
+        close();
+        return false;
+    }
+
+    biomes = (const PackBiome*)(data + header->biomeOffset);
+    rects = (const PackRect*)(data + header->rectOffset);
+    animals = (const PackAnimal*)(data + header->animalOffset);
+    answers = (const uint32_t*)(data + header->answerOffset);
+    strings = (const char*)(data + header->stringOffset);
+    return true;
+}
+
+void ContentPack::close() {
+    if (!data) return;
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+    CloseHandle((HANDLE)mappingHandle);
+    CloseHandle((HANDLE)fileHandle);
+    fileHandle = nullptr;
+    mappingHandle = nullptr;
+#else
+    munmap((void*)data, size);
+#endif
+    data = nullptr;
+    size = 0;
+    header = nullptr;
+    biomes = nullptr;
+    rects = nullptr;
+    animals = nullptr;
+    answers = nullptr;
+    strings = nullptr;
+}
+
+// Only checks the header and section bounds, so it costs the same no matter
+// how much content there is. Offsets inside the tables are range checked
+// when they are used.
+bool ContentPack::validate() const {
+    if (size < sizeof(PackHeader)) return false;
+    if (header->magic != CONTENT_MAGIC || header->version != CONTENT_VERSION) return false;
+    if (header->fileSize != size) return false;
+
+    auto sectionFits = [this](uint32_t offset, uint64_t bytes) {
+        return offset % 4 == 0 && offset + bytes <= size;
+    };
+    return sectionFits(header->biomeOffset, (uint64_t)header->biomeCount * sizeof(PackBiome)) &&
+           sectionFits(header->rectOffset, (uint64_t)header->animalCount * sizeof(PackRect)) &&
+           sectionFits(header->animalOffset, (uint64_t)header->animalCount * sizeof(PackAnimal)) &&
+           sectionFits(header->answerOffset, (uint64_t)header->answerCount * sizeof(uint32_t)) &&
+           sectionFits(header->stringOffset, header->stringBytes) &&
+           header->stringBytes >= 3 &&
+           // so a bad offset can never read past the end of the pool
+           data[header->stringOffset + header->stringBytes - 1] == '\0';
+}
+
+const PackBiome* ContentPack::findBiome(int state) const {
+    for (uint32_t i = 0; i < header->biomeCount; i++) {
+        if ((int)biomes[i].state == state) return &biomes[i];
+    }
+    return nullptr;
+}
+
+uint32_t ContentPack::animalId(int index) const {
+    return animalNameId(string(animals[index].name));
+}
+
+int ContentPack::firstAnimal(const PackBiome& biome) const {
+    return biome.firstAnimal < header->animalCount ? (int)biome.firstAnimal : (int)header->animalCount;
+}
+
+int ContentPack::endAnimal(const PackBiome& biome) const {
+    uint64_t end = (uint64_t)biome.firstAnimal + biome.animalCount;
+    return end < header->animalCount ? (int)end : (int)header->animalCount;
+}
+
+const char* ContentPack::string(uint32_t offset) const {
+    if ((uint64_t)offset + 3 > header->stringBytes) return "";
+    return strings + offset + 2;
+}
+
+int ContentPack::stringLength(uint32_t offset) const {
+    if ((uint64_t)offset + 3 > header->stringBytes) return 0;
+    const unsigned char* p = (const unsigned char*)strings + offset;
+    return p[0] | (p[1] << 8);
+}
+
+const char* ContentPack::answer(const PackAnimal& animal, int index) const {
+    uint32_t slot = animal.firstAnswer + (uint32_t)index;
+    if (index < 0 || index >= animal.answerCount || slot >= header->answerCount) return "";
+    return string(answers[slot]);
+}
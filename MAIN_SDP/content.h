@@ -0,0 +1,123 @@
+#ifndef CONTENT_H
+#define CONTENT_H
+
+#include <cstdint>
+#include <cstddef>
+
+// Binary content pack holding the biomes, animals, questions and answers.
+// content/animals.txt is compiled into content.pack by tools/packcontent.cpp,
+// and the game maps the pack read-only and reads everything in place, so
+// adding content doesn't add startup work or heap allocations.
+//
+// Layout (little endian, every section 4-byte aligned):
+//   PackHeader
+//   PackBiome[biomeCount]
+//   PackRect[animalCount]             where each animal is on screen
+//   PackAnimal[animalCount]           everything else about it
+//   uint32_t answers[answerCount]     string offsets
+//   string pool                       uint16_t length, bytes, '\0'
+// Animal geometry is kept apart from the text so scans over a biome (hit
+// map building, progress) only walk 16 bytes per animal.
+// Strings are referred to by their offset into the string pool and are
+// interned, so each distinct string is stored once. Offset 0 is "".
+
+#define CONTENT_MAGIC 0x50435145  // "EQCP"
+#define CONTENT_VERSION 2
+
+// Most answers one question can have, they all have to fit on the screen
+#define CONTENT_MAX_ANSWERS 8
+
+struct PackHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t fileSize;
+    uint32_t biomeCount;
+    uint32_t biomeOffset;
+    uint32_t animalCount;
+    uint32_t rectOffset;
+    uint32_t animalOffset;
+    uint32_t answerCount;
+    uint32_t answerOffset;
+    uint32_t stringBytes;
+    uint32_t stringOffset;
+};
+
+struct PackBiome {
+    uint32_t state;  // game state this biome is shown in
+    uint32_t name;
+    uint32_t image;
+    uint32_t firstAnimal;
+    uint32_t animalCount;
+};
+
+struct PackRect {
+    int32_t x, y, width, height;
+};
+
+struct PackAnimal {
+    uint32_t name;
+    uint32_t question;
+    uint32_t firstAnswer;
+    uint16_t answerCount;
+    uint16_t correctAnswer;  // index into this animal's answers
+};
+
+// FNV-1a of an animal's name, its ID in saves and stats (see
+// ContentPack::animalId). packcontent refuses names that hash the same.
+inline uint32_t animalNameId(const char* name) {
+    uint32_t hash = 2166136261u;
+    for (const char* c = name; *c; c++) {
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+    }
+    return hash;
+}
+
+class ContentPack {
+public:
+    ContentPack();
+    ~ContentPack();
+
+    // Map the pack file. Returns false if it is missing or doesn't look right.
+    bool open(const char* filename);
+    void close();
+
+    int biomeCount() const { return (int)header->biomeCount; }
+    const PackBiome& biome(int index) const { return biomes[index]; }
+    // The biome shown in a game state, or nullptr
+    const PackBiome* findBiome(int state) const;
+
+    int animalCount() const { return (int)header->animalCount; }
+    const PackRect& animalRect(int index) const { return rects[index]; }
+    const PackAnimal& animal(int index) const { return animals[index]; }
+    // Hash of the animal's name. Indices shift whenever content is added,
+    // this stays put as long as the animal isn't renamed, so saves use it.
+    uint32_t animalId(int index) const;
+    // Range of animal indices in a biome, clamped to the animal table
+    int firstAnimal(const PackBiome& biome) const;
+    int endAnimal(const PackBiome& biome) const;
+
+    const char* string(uint32_t offset) const;
+    int stringLength(uint32_t offset) const;
+    const char* answer(const PackAnimal& animal, int index) const;
+
+    size_t sizeBytes() const { return size; }
+
+private:
+    bool validate() const;
+
+    const unsigned char* data;
+    size_t size;
+    const PackHeader* header;
+    const PackBiome* biomes;
+    const PackRect* rects;
+    const PackAnimal* animals;
+    const uint32_t* answers;
+    const char* strings;
+
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#endif
+};
+
+#endif
@@ -0,0 +1,200 @@
+#include "drawlist.h"
+#include "blit.h"
+#include "profiler.h"
+#include "textlayout.h"
+#include <FEHLCD.h>
+#include <cstdio>
+
+bool Rect::intersects(const Rect& other) const {
+    return x < other.x + other.width && other.x < x + width &&
+           y < other.y + other.height && other.y < y + height;
+}
+
+bool Rect::contains(const Rect& other) const {
+    return other.x >= x && other.y >= y &&
+           other.x + other.width <= x + width && other.y + other.height <= y + height;
+}
+
+Rect Rect::intersection(const Rect& other) const {
+    int left = x > other.x ? x : other.x;
+    int top = y > other.y ? y : other.y;
+    int right = x + width < other.x + other.width ? x + width : other.x + other.width;
+    int bottom = y + height < other.y + other.height ? y + height : other.y + other.height;
+    return {left, top, right - left, bottom - top};
+}
+
+Rect Rect::unite(const Rect& other) const {
+    if (isEmpty()) return other;
+    if (other.isEmpty()) return *this;
+    int left = x < other.x ? x : other.x;
+    int top = y < other.y ? y : other.y;
+    int right = x + width > other.x + other.width ? x + width : other.x + other.width;
+    int bottom = y + height > other.y + other.height ? y + height : other.y + other.height;
+    return {left, top, right - left, bottom - top};
+}
+
+// Commands a frame usually records, so recording doesn't allocate
+#define DRAW_LIST_RESERVE 256
+
+DrawList::DrawList()
+    : arena(65536), color(0), lcdColor(0), lcdColorKnown(false),
+      recorded(0), submitted(0), overdrawn(0), colorCalls(0), colorsSent(0) {
+    commands.reserve(DRAW_LIST_RESERVE);
+    done.reserve(DRAW_LIST_RESERVE);
+}
+
+void DrawList::add(const Command& command) {
+    commands.push_back(command);
+    recorded++;
+}
+
+void DrawList::setFontColor(unsigned int newColor) {
+    color = newColor;
+    colorCalls++;
+}
+
+void DrawList::clear() {
+    Command command = {{0, 0, SCREEN_WIDTH, SCREEN_HEIGHT}, 0, DRAW_CLEAR, true, false, true,
+                       nullptr, nullptr, 0};
+    add(command);
+}
+
+void DrawList::clear(unsigned int clearColor) {
+    Command command = {{0, 0, SCREEN_WIDTH, SCREEN_HEIGHT}, clearColor, DRAW_CLEAR, true, false,
+                       false, nullptr, nullptr, 0};
+    add(command);
+}
+
+void DrawList::fillRectangle(int x, int y, int width, int height) {
+    if (width <= 0 || height <= 0) return;
+    add(Command{{x, y, width, height}, color, DRAW_FILL, true, true, false, nullptr, nullptr, 0});
+}
+
+void DrawList::drawRectangle(int x, int y, int width, int height) {
+    // The LCD draws the right and bottom edges at x + width and y + height
+    add(Command{{x, y, width + 1, height + 1}, color, DRAW_RECT, false, true, false, nullptr, nullptr, 0});
+}
+
+void DrawList::writeAt(std::string_view text, int x, int y) {
+    if (text.empty()) return;
+    Rect bounds = {x, y, measureText((int)text.length()), FONT_HEIGHT};
+    add(Command{bounds, color, DRAW_TEXT, false, true, false, arena.copy(text).data(), nullptr, 0});
+}
+
+void DrawList::writeAt(int value, int x, int y) {
+    // Same formatting as the LCD's own WriteAt(int)
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%d", value);
+    writeAt(std::string_view(buffer), x, y);
+}
+
+void DrawList::pushPixels(const unsigned int* pixels, int stride, int x, int y, int width, int height) {
+    if (width <= 0 || height <= 0) return;
+    // Fully transparent pixels are skipped when pushed, so only a block
+    // without any can hide what's under it
+    bool opaque = true;
+    for (int row = 0; row < height && opaque; row++) {
+        const unsigned int* line = pixels + (size_t)row * stride;
+        for (int col = 0; col < width; col++) {
+            if ((line[col] >> 24) == 0) {
+                opaque = false;
+                break;
+            }
+        }
+    }
+    add(Command{{x, y, width, height}, 0, DRAW_PIXELS, opaque, false, false, nullptr, pixels, stride});
+}
+
+unsigned int* DrawList::allocatePixels(int width, int height) {
+    return arena.allocate<unsigned int>((size_t)width * height);
+}
+
+void DrawList::execute(const Command& command) {
+    if (command.usesColor && (!lcdColorKnown || lcdColor != command.color)) {
+        LCD.SetFontColor(command.color);
+        lcdColor = command.color;
+        lcdColorKnown = true;
+        colorsSent++;
+    }
+    switch (command.type) {
+        case DRAW_CLEAR:
+            if (command.backgroundClear) LCD.Clear();
+            else LCD.Clear(command.color);
+            break;
+        case DRAW_FILL:
+            LCD.FillRectangle(command.bounds.x, command.bounds.y, command.bounds.width, command.bounds.height);
+            break;
+        case DRAW_RECT:
+            LCD.DrawRectangle(command.bounds.x, command.bounds.y,
+                              command.bounds.width - 1, command.bounds.height - 1);
+            break;
+        case DRAW_TEXT:
+            LCD.WriteAt(command.text, command.bounds.x, command.bounds.y);
+            break;
+        case DRAW_PIXELS:
+            ::pushPixels(command.pixels, command.stride, command.bounds.x, command.bounds.y,
+                         command.bounds.width, command.bounds.height);
+            // Sets colors of its own as it goes
+            lcdColorKnown = false;
+            break;
+    }
+    submitted++;
+}
+
+void DrawList::submit() {
+    PROFILE_SCOPE("DrawList::submit");
+    int count = (int)commands.size();
+    done.assign(count, 0);
+
+    // Anything an opaque command after it covers completely never shows
+    for (int i = 0; i < count; i++) {
+        for (int j = i + 1; j < count; j++) {
+            if (commands[j].opaque && commands[j].bounds.contains(commands[i].bounds)) {
+                done[i] = 1;
+                overdrawn++;
+                break;
+            }
+        }
+    }
+
+    // Send every command that's ready in the current color, then switch to
+    // the color of the earliest one left. A command is ready once nothing
+    // recorded before it that overlaps it is still waiting.
+    int first = 0;
+    for (;;) {
+        while (first < count && done[first]) first++;
+        if (first >= count) break;
+
+        const Command& head = commands[first];
+        unsigned int batchColor = lcdColorKnown ? lcdColor : head.color;
+        bool sentAny = false;
+        for (int i = first; i < count; i++) {
+            const Command& command = commands[i];
+            if (done[i] || (command.usesColor && command.color != batchColor)) continue;
+            bool ready = true;
+            for (int j = first; j < i && ready; j++) {
+                if (!done[j] && commands[j].bounds.intersects(command.bounds)) ready = false;
+            }
+            if (!ready) continue;
+            execute(command);
+            done[i] = 1;
+            sentAny = true;
+            // Pixel blocks change the color, the batch ends there
+            if (command.type == DRAW_PIXELS) break;
+        }
+        // Nothing matched the color, the earliest command is always ready
+        if (!sentAny) {
+            execute(head);
+            done[first] = 1;
+        }
+    }
+
+    commands.clear();
+    arena.reset();
+}
+
+void DrawList::printStats() const {
+    printf("DrawList: %lld commands recorded, %lld sent (%lld overdrawn), "
+           "%lld of %lld font color changes sent\n",
+           recorded, submitted, overdrawn, colorsSent, colorCalls);
+}
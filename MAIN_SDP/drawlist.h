@@ -0,0 +1,91 @@
+#ifndef DRAWLIST_H
+#define DRAWLIST_H
+
+#include "arena.h"
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// The Proteus screen, what a clear covers
+#define SCREEN_WIDTH 320
+#define SCREEN_HEIGHT 240
+
+struct Rect {
+    int x, y, width, height;
+
+    bool isEmpty() const { return width <= 0 || height <= 0; }
+    bool intersects(const Rect& other) const;
+    bool contains(const Rect& other) const;
+    Rect intersection(const Rect& other) const;
+    Rect unite(const Rect& other) const;
+};
+
+// Records a frame's drawing instead of sending it straight to the LCD, then
+// sends it all in one go from submit(). The calls mirror the LCD ones.
+//
+// Every LCD call costs a trip over the bus, so before anything is sent:
+//   - commands that something opaque drawn later covers completely are
+//     dropped, like a Clear under a full screen fill
+//   - commands are grouped by font color, as far as they can be without
+//     moving anything past a command it overlaps, and the color is only
+//     set when it actually changes
+// Neither changes a single pixel of the result.
+//
+// Text and pixel blocks are referenced rather than copied where possible,
+// so pixels passed to pushPixels have to stay put until submit. Text and
+// allocatePixels memory come from an arena that submit resets.
+class DrawList {
+public:
+    DrawList();
+
+    void setFontColor(unsigned int color);
+    void clear();  // to the LCD's background color
+    void clear(unsigned int color);
+    void fillRectangle(int x, int y, int width, int height);
+    void drawRectangle(int x, int y, int width, int height);
+    void writeAt(std::string_view text, int x, int y);
+    void writeAt(int value, int x, int y);
+
+    // A block of pixels drawn as with the blit.h pushPixels
+    void pushPixels(const unsigned int* pixels, int stride, int x, int y, int width, int height);
+    // Room for width * height pixels that lasts until submit
+    unsigned int* allocatePixels(int width, int height);
+
+    // Send everything recorded since the last submit to the LCD
+    void submit();
+
+    void printStats() const;
+
+private:
+    enum CommandType { DRAW_CLEAR, DRAW_FILL, DRAW_RECT, DRAW_TEXT, DRAW_PIXELS };
+
+    struct Command {
+        Rect bounds;           // every pixel it may touch
+        unsigned int color;    // font color it draws with
+        uint8_t type;
+        bool opaque;           // sets every pixel in bounds
+        bool usesColor;        // needs the font color set first
+        bool backgroundClear;  // DRAW_CLEAR with the LCD's own background color
+        const char* text;
+        const unsigned int* pixels;
+        int stride;
+    };
+
+    void add(const Command& command);
+    void execute(const Command& command);
+
+    std::vector<Command> commands;
+    std::vector<uint8_t> done;
+    Arena arena;
+    unsigned int color;
+    unsigned int lcdColor;  // what the LCD is set to, when known
+    bool lcdColorKnown;
+
+    long long recorded;
+    long long submitted;
+    long long overdrawn;
+    long long colorCalls;  // setFontColor calls recorded
+    long long colorsSent;  // SetFontColor calls that reached the LCD
+};
+
+#endif
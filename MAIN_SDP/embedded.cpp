@@ -0,0 +1,67 @@
+#include "embedded.h"
+#include "blit.h"
+#include <cstring>
+
+#ifdef ECOQUEST_EMBED_ASSETS
+// Generated by make assets, defines embeddedImages[]
+#include "assets.h"
+#endif
+
+const EmbeddedImage* findEmbeddedImage(const char* filename) {
+#ifdef ECOQUEST_EMBED_ASSETS
+    for (const EmbeddedImage& image : embeddedImages) {
+        if (strcmp(image.name, filename) == 0) return &image;
+    }
+#else
+    (void)filename;
+#endif
+    return nullptr;
+}
+
+// Indices are all checked before the lookup, the vector kernels don't bounds check
+template <typename T>
+static bool checkIndexed(const EmbeddedImage& embedded, size_t total) {
+    const T* data = (const T*)embedded.data;
+    if ((size_t)embedded.dataCount != total) return false;
+    T largest = 0;
+    for (size_t i = 0; i < total; i++) largest = data[i] > largest ? data[i] : largest;
+    return total == 0 || largest < embedded.paletteSize;
+}
+
+template <typename T>
+static bool expandRuns(const EmbeddedImage& embedded, unsigned int* out, size_t total) {
+    const T* data = (const T*)embedded.data;
+    size_t written = 0;
+    for (int i = 0; i + 1 < embedded.dataCount; i += 2) {
+        size_t count = data[i];
+        if (data[i + 1] >= embedded.paletteSize || written + count > total) return false;
+        blitKernels().fill(embedded.palette[data[i + 1]], out + written, (int)count);
+        written += count;
+    }
+    return written == total;
+}
+
+bool expandEmbeddedImage(const EmbeddedImage& embedded, PngImage& out) {
+    size_t total = (size_t)embedded.width * embedded.height;
+    out.width = embedded.width;
+    out.height = embedded.height;
+    out.pixels.resize(total);
+
+    switch (embedded.format) {
+        case EMBED_INDEX8:
+            if (!checkIndexed<unsigned char>(embedded, total)) return false;
+            blitKernels().expand8((const unsigned char*)embedded.data, embedded.palette,
+                                  out.pixels.data(), (int)total);
+            return true;
+        case EMBED_INDEX16:
+            if (!checkIndexed<unsigned short>(embedded, total)) return false;
+            blitKernels().expand16((const unsigned short*)embedded.data, embedded.palette,
+                                   out.pixels.data(), (int)total);
+            return true;
+        case EMBED_RLE8:
+            return expandRuns<unsigned char>(embedded, out.pixels.data(), total);
+        case EMBED_RLE16:
+            return expandRuns<unsigned short>(embedded, out.pixels.data(), total);
+    }
+    return false;
+}
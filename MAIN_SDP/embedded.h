@@ -0,0 +1,34 @@
+#ifndef EMBEDDED_H
+#define EMBEDDED_H
+
+#include "png.h"
+
+// Images compiled into the binary by tools/assetcompiler.cpp (make assets).
+// Each one is a palette plus one index per pixel, optionally run-length
+// encoded, so loading it is a table lookup instead of a file read and a
+// PNG decode. Only builds with ECOQUEST_EMBED_ASSETS (make embedded)
+// have any; everywhere else findEmbeddedImage always returns nullptr.
+
+#define EMBED_INDEX8 0   // unsigned char index per pixel
+#define EMBED_INDEX16 1  // unsigned short index per pixel
+#define EMBED_RLE8 2     // unsigned char (count, index) pairs
+#define EMBED_RLE16 3    // unsigned short (count, index) pairs
+
+struct EmbeddedImage {
+    const char* name;  // the PNG it came from, as the game asks for it
+    int width;
+    int height;
+    int format;
+    const unsigned int* palette;  // 0xAARRGGBB
+    int paletteSize;
+    const void* data;
+    int dataCount;  // entries in data, not bytes
+};
+
+// The embedded copy of an image file, or nullptr
+const EmbeddedImage* findEmbeddedImage(const char* filename);
+
+// Expand to one 0xAARRGGBB value per pixel. False if the data is inconsistent.
+bool expandEmbeddedImage(const EmbeddedImage& embedded, PngImage& out);
+
+#endif
@@ -0,0 +1,25 @@
+#include "FEHImages.h"
+#include "FEHLCD.h"
+#include <cstdio>
+
+void FEHImage::Open(const char* filename) {
+    if (!loadPng(filename, image)) {
+        printf("FEHImage: failed to open %s\n", filename);
+        image = PngImage();
+    }
+}
+
+void FEHImage::Draw(int x, int y) {
+    for (int row = 0; row < image.height; row++) {
+        for (int col = 0; col < image.width; col++) {
+            unsigned int pixel = image.pixels[(size_t)row * image.width + col];
+            if ((pixel >> 24) == 0) continue;
+            LCD.SetFontColor(pixel & 0x00ffffff);
+            LCD.DrawPixel(x + col, y + row);
+        }
+    }
+}
+
+void FEHImage::Close() {
+    image = PngImage();
+}
@@ -0,0 +1,20 @@
+#ifndef FEHIMAGES_H
+#define FEHIMAGES_H
+
+#include "../png.h"
+
+// Headless stand-in for the simulator's FEHImage, decodes with our own png.cpp
+class FEHImage {
+public:
+    FEHImage() {}
+    FEHImage(const char* filename) { Open(filename); }
+
+    void Open(const char* filename);
+    void Draw(int x, int y);
+    void Close();
+
+private:
+    PngImage image;
+};
+
+#endif
@@ -0,0 +1,266 @@
+#include "FEHLCD.h"
+#include "FEHUtility.h"
+#include "../profiler.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+FEHLCD screenLCD;
+thread_local FEHLCD* activeLCD = &screenLCD;
+
+// Character cell size, same as the simulator's font
+#define CHAR_WIDTH 12
+#define CHAR_HEIGHT 17
+
+// Classic 5x7 font for ASCII 32-126. One byte per column, bit 0 is the top row.
+// Glyphs are drawn scaled up by 2 in the middle of each 12x17 cell.
+static const unsigned char font5x7[95][5] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x5F, 0x00, 0x00}, {0x00, 0x07, 0x00, 0x07, 0x00},
+    {0x14, 0x7F, 0x14, 0x7F, 0x14}, {0x24, 0x2A, 0x7F, 0x2A, 0x12}, {0x23, 0x13, 0x08, 0x64, 0x62},
+    {0x36, 0x49, 0x55, 0x22, 0x50}, {0x00, 0x05, 0x03, 0x00, 0x00}, {0x00, 0x1C, 0x22, 0x41, 0x00},
+    {0x00, 0x41, 0x22, 0x1C, 0x00}, {0x08, 0x2A, 0x1C, 0x2A, 0x08}, {0x08, 0x08, 0x3E, 0x08, 0x08},
+    {0x00, 0x50, 0x30, 0x00, 0x00}, {0x08, 0x08, 0x08, 0x08, 0x08}, {0x00, 0x60, 0x60, 0x00, 0x00},
+    {0x20, 0x10, 0x08, 0x04, 0x02}, {0x3E, 0x51, 0x49, 0x45, 0x3E}, {0x00, 0x42, 0x7F, 0x40, 0x00},
+    {0x42, 0x61, 0x51, 0x49, 0x46}, {0x21, 0x41, 0x45, 0x4B, 0x31}, {0x18, 0x14, 0x12, 0x7F, 0x10},
+    {0x27, 0x45, 0x45, 0x45, 0x39}, {0x3C, 0x4A, 0x49, 0x49, 0x30}, {0x01, 0x71, 0x09, 0x05, 0x03},
+    {0x36, 0x49, 0x49, 0x49, 0x36}, {0x06, 0x49, 0x49, 0x29, 0x1E}, {0x00, 0x36, 0x36, 0x00, 0x00},
+    {0x00, 0x56, 0x36, 0x00, 0x00}, {0x08, 0x14, 0x22, 0x41, 0x00}, {0x14, 0x14, 0x14, 0x14, 0x14},
+    {0x00, 0x41, 0x22, 0x14, 0x08}, {0x02, 0x01, 0x51, 0x09, 0x06}, {0x32, 0x49, 0x79, 0x41, 0x3E},
+    {0x7E, 0x11, 0x11, 0x11, 0x7E}, {0x7F, 0x49, 0x49, 0x49, 0x36}, {0x3E, 0x41, 0x41, 0x41, 0x22},
+    {0x7F, 0x41, 0x41, 0x22, 0x1C}, {0x7F, 0x49, 0x49, 0x49, 0x41}, {0x7F, 0x09, 0x09, 0x01, 0x01},
+    {0x3E, 0x41, 0x41, 0x51, 0x32}, {0x7F, 0x08, 0x08, 0x08, 0x7F}, {0x00, 0x41, 0x7F, 0x41, 0x00},
+    {0x20, 0x40, 0x41, 0x3F, 0x01}, {0x7F, 0x08, 0x14, 0x22, 0x41}, {0x7F, 0x40, 0x40, 0x40, 0x40},
+    {0x7F, 0x02, 0x04, 0x02, 0x7F}, {0x7F, 0x04, 0x08, 0x10, 0x7F}, {0x3E, 0x41, 0x41, 0x41, 0x3E},
+    {0x7F, 0x09, 0x09, 0x09, 0x06}, {0x3E, 0x41, 0x51, 0x21, 0x5E}, {0x7F, 0x09, 0x19, 0x29, 0x46},
+    {0x46, 0x49, 0x49, 0x49, 0x31}, {0x01, 0x01, 0x7F, 0x01, 0x01}, {0x3F, 0x40, 0x40, 0x40, 0x3F},
+    {0x1F, 0x20, 0x40, 0x20, 0x1F}, {0x7F, 0x20, 0x18, 0x20, 0x7F}, {0x63, 0x14, 0x08, 0x14, 0x63},
+    {0x03, 0x04, 0x78, 0x04, 0x03}, {0x61, 0x51, 0x49, 0x45, 0x43}, {0x00, 0x7F, 0x41, 0x41, 0x00},
+    {0x02, 0x04, 0x08, 0x10, 0x20}, {0x00, 0x41, 0x41, 0x7F, 0x00}, {0x04, 0x02, 0x01, 0x02, 0x04},
+    {0x40, 0x40, 0x40, 0x40, 0x40}, {0x00, 0x01, 0x02, 0x04, 0x00}, {0x20, 0x54, 0x54, 0x54, 0x78},
+    {0x7F, 0x48, 0x44, 0x44, 0x38}, {0x38, 0x44, 0x44, 0x44, 0x20}, {0x38, 0x44, 0x44, 0x48, 0x7F},
+    {0x38, 0x54, 0x54, 0x54, 0x18}, {0x08, 0x7E, 0x09, 0x01, 0x02}, {0x08, 0x14, 0x54, 0x54, 0x3C},
+    {0x7F, 0x08, 0x04, 0x04, 0x78}, {0x00, 0x44, 0x7D, 0x40, 0x00}, {0x20, 0x40, 0x44, 0x3D, 0x00},
+    {0x00, 0x7F, 0x10, 0x28, 0x44}, {0x00, 0x41, 0x7F, 0x40, 0x00}, {0x7C, 0x04, 0x18, 0x04, 0x78},
+    {0x7C, 0x08, 0x04, 0x04, 0x78}, {0x38, 0x44, 0x44, 0x44, 0x38}, {0x7C, 0x14, 0x14, 0x14, 0x08},
+    {0x08, 0x14, 0x14, 0x18, 0x7C}, {0x7C, 0x08, 0x04, 0x04, 0x08}, {0x48, 0x54, 0x54, 0x54, 0x20},
+    {0x04, 0x3F, 0x44, 0x40, 0x20}, {0x3C, 0x40, 0x40, 0x20, 0x7C}, {0x1C, 0x20, 0x40, 0x20, 0x1C},
+    {0x3C, 0x40, 0x30, 0x40, 0x3C}, {0x44, 0x28, 0x10, 0x28, 0x44}, {0x0C, 0x50, 0x50, 0x50, 0x3C},
+    {0x44, 0x64, 0x54, 0x4C, 0x44}, {0x00, 0x08, 0x36, 0x41, 0x00}, {0x00, 0x00, 0x7F, 0x00, 0x00},
+    {0x00, 0x41, 0x36, 0x08, 0x00}, {0x08, 0x04, 0x08, 0x10, 0x08},
+};
+
+FEHLCD::FEHLCD() : FEHLCD(true) {}
+
+FEHLCD::FEHLCD(bool fromEnvironment)
+    : fontColor(WHITE), backgroundColor(BLACK),
+      scriptPos(0), touchDown(false), touchX(0), touchY(0), frameCount(0) {
+    for (int i = 0; i < LCD_WIDTH * LCD_HEIGHT; i++) framebuffer[i] = BLACK;
+    if (!fromEnvironment) return;
+
+    const char* scriptFile = getenv("ECOQUEST_TOUCH_SCRIPT");
+    if (scriptFile) LoadTouchScript(scriptFile);
+
+    const char* dir = getenv("ECOQUEST_FRAME_DIR");
+    if (dir) SetFrameDumpDirectory(dir);
+}
+
+bool FEHLCD::LoadTouchScript(const char* filename) {
+    FILE* file = fopen(filename, "r");
+    if (!file) {
+        printf("FEHLCD: can't open touch script %s\n", filename);
+        return false;
+    }
+
+    script.clear();
+    scriptPos = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        ScriptedTouch touch = {0, TOUCH_SCRIPT_PRESS, 0, 0};
+        char action[32];
+        if (line[0] == '#' || sscanf(line, "%lf %31s %f %f", &touch.time, action, &touch.x, &touch.y) < 2) {
+            continue;
+        }
+        if (strcmp(action, "press") == 0 || strcmp(action, "drag") == 0) {
+            touch.action = TOUCH_SCRIPT_PRESS;
+        } else if (strcmp(action, "release") == 0) {
+            touch.action = TOUCH_SCRIPT_RELEASE;
+        } else if (strcmp(action, "quit") == 0) {
+            touch.action = TOUCH_SCRIPT_QUIT;
+        } else {
+            printf("FEHLCD: unknown touch script action '%s'\n", action);
+            continue;
+        }
+        script.push_back(touch);
+    }
+    fclose(file);
+    return true;
+}
+
+void FEHLCD::SetFrameDumpDirectory(const char* directory) {
+    frameDir = directory;
+}
+
+bool FEHLCD::Touch(float* x_pos, float* y_pos) {
+    double now = TimeNow();
+    while (scriptPos < script.size() && script[scriptPos].time <= now) {
+        const ScriptedTouch& touch = script[scriptPos++];
+        switch (touch.action) {
+            case TOUCH_SCRIPT_PRESS:
+                touchDown = true;
+                touchX = touch.x;
+                touchY = touch.y;
+                break;
+            case TOUCH_SCRIPT_RELEASE:
+                touchDown = false;
+                break;
+            case TOUCH_SCRIPT_QUIT:
+                // Called from whatever thread polls the screen, so skip the
+                // static destructors rather than tear things down under the game loop
+                fflush(stdout);
+                std::quick_exit(0);
+        }
+    }
+
+    if (touchDown) {
+        *x_pos = touchX;
+        *y_pos = touchY;
+    }
+    return touchDown;
+}
+
+void FEHLCD::Clear() {
+    Clear(backgroundColor);
+}
+
+void FEHLCD::Clear(unsigned int color) {
+    PROFILE_SCOPE("LCD.Clear");
+    for (int i = 0; i < LCD_WIDTH * LCD_HEIGHT; i++) framebuffer[i] = color;
+}
+
+void FEHLCD::SetFontColor(unsigned int color) {
+    fontColor = color;
+}
+
+void FEHLCD::SetBackgroundColor(unsigned int color) {
+    backgroundColor = color;
+}
+
+void FEHLCD::plot(int x, int y) {
+    if (x < 0 || y < 0 || x >= LCD_WIDTH || y >= LCD_HEIGHT) return;
+    framebuffer[y * LCD_WIDTH + x] = fontColor;
+}
+
+void FEHLCD::hline(int y, int x1, int x2) {
+    if (x1 > x2) std::swap(x1, x2);
+    if (y < 0 || y >= LCD_HEIGHT) return;
+    if (x1 < 0) x1 = 0;
+    if (x2 >= LCD_WIDTH) x2 = LCD_WIDTH - 1;
+    unsigned int* row = framebuffer + y * LCD_WIDTH;
+    for (int x = x1; x <= x2; x++) row[x] = fontColor;
+}
+
+void FEHLCD::vline(int x, int y1, int y2) {
+    if (y1 > y2) std::swap(y1, y2);
+    if (x < 0 || x >= LCD_WIDTH) return;
+    if (y1 < 0) y1 = 0;
+    if (y2 >= LCD_HEIGHT) y2 = LCD_HEIGHT - 1;
+    for (int y = y1; y <= y2; y++) framebuffer[y * LCD_WIDTH + x] = fontColor;
+}
+
+void FEHLCD::DrawPixel(int x, int y) {
+    PROFILE_SCOPE("LCD.DrawPixel");
+    plot(x, y);
+}
+
+void FEHLCD::DrawHorizontalLine(int y, int x1, int x2) {
+    PROFILE_SCOPE("LCD.DrawHorizontalLine");
+    hline(y, x1, x2);
+}
+
+void FEHLCD::DrawVerticalLine(int x, int y1, int y2) {
+    PROFILE_SCOPE("LCD.DrawVerticalLine");
+    vline(x, y1, y2);
+}
+
+void FEHLCD::DrawRectangle(int x, int y, int width, int height) {
+    PROFILE_SCOPE("LCD.DrawRectangle");
+    hline(y, x, x + width);
+    hline(y + height, x, x + width);
+    vline(x, y, y + height);
+    vline(x + width, y, y + height);
+}
+
+void FEHLCD::FillRectangle(int x, int y, int width, int height) {
+    PROFILE_SCOPE("LCD.FillRectangle");
+    for (int row = y; row < y + height; row++) {
+        hline(row, x, x + width - 1);
+    }
+}
+
+void FEHLCD::drawChar(char c, int x, int y) {
+    if (c < 32 || c > 126) c = '?';
+    const unsigned char* glyph = font5x7[c - 32];
+    for (int col = 0; col < 5; col++) {
+        for (int row = 0; row < 7; row++) {
+            if (glyph[col] & (1 << row)) {
+                // 2x scale, centred in the 12x17 cell
+                int px = x + 1 + col * 2;
+                int py = y + 1 + row * 2;
+                plot(px, py);
+                plot(px + 1, py);
+                plot(px, py + 1);
+                plot(px + 1, py + 1);
+            }
+        }
+    }
+}
+
+void FEHLCD::WriteAt(const char* str, int x, int y) {
+    PROFILE_SCOPE("LCD.WriteAt");
+    for (int i = 0; str[i] != '\0'; i++) {
+        drawChar(str[i], x + i * CHAR_WIDTH, y);
+    }
+}
+
+void FEHLCD::WriteAt(int i, int x, int y) {
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%d", i);
+    WriteAt(buffer, x, y);
+}
+
+void FEHLCD::WriteAt(float f, int x, int y) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.3f", f);
+    WriteAt(buffer, x, y);
+}
+
+void FEHLCD::WriteAt(double d, int x, int y) {
+    WriteAt((float)d, x, y);
+}
+
+void FEHLCD::Update() {
+    PROFILE_SCOPE("LCD.Update");
+    frameCount++;
+    if (!frameDir.empty()) dumpFrame();
+}
+
+void FEHLCD::dumpFrame() {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/frame_%05d.ppm", frameDir.c_str(), frameCount);
+    FILE* file = fopen(path, "wb");
+    if (!file) return;
+
+    fprintf(file, "P6\n%d %d\n255\n", LCD_WIDTH, LCD_HEIGHT);
+    unsigned char row[LCD_WIDTH * 3];
+    for (int y = 0; y < LCD_HEIGHT; y++) {
+        for (int x = 0; x < LCD_WIDTH; x++) {
+            unsigned int pixel = framebuffer[y * LCD_WIDTH + x];
+            row[x * 3] = (pixel >> 16) & 0xff;
+            row[x * 3 + 1] = (pixel >> 8) & 0xff;
+            row[x * 3 + 2] = pixel & 0xff;
+        }
+        fwrite(row, 1, sizeof(row), file);
+    }
+    fclose(file);
+}
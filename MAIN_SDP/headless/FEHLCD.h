@@ -0,0 +1,100 @@
+#ifndef FEHLCD_H
+#define FEHLCD_H
+
+#include <string>
+#include <vector>
+
+// Headless stand-in for the simulator's FEHLCD. Everything is drawn into
+// an in-memory 320x240 RGB framebuffer instead of a window, so the game
+// can build and run on a plain Linux box with no simulator libraries.
+//
+// Configured through environment variables:
+//   ECOQUEST_TOUCH_SCRIPT  file of scripted touches (see TouchScript below)
+//   ECOQUEST_FRAME_DIR     if set, every LCD.Update() writes a .ppm there
+
+// Only this LCD can hand its pixels back (see Framebuffer())
+#define FEHLCD_HAS_FRAMEBUFFER
+
+#define BLACK 0x000000
+#define WHITE 0xFFFFFF
+#define RED 0xFF0000
+#define GREEN 0x00FF00
+#define BLUE 0x0000FF
+#define YELLOW 0xFFFF00
+#define GRAY 0x808080
+
+// One line of a touch script:
+//   <seconds> press <x> <y>    finger down (or moved) at x, y, "drag" works too
+//   <seconds> release          finger up
+//   <seconds> quit             exit the program
+// Times are seconds since start up. Blank lines and # comments are ignored.
+struct ScriptedTouch {
+    double time;
+    int action;
+    float x, y;
+};
+
+class FEHLCD {
+public:
+    enum { LCD_WIDTH = 320, LCD_HEIGHT = 240 };
+    enum { TOUCH_SCRIPT_PRESS, TOUCH_SCRIPT_RELEASE, TOUCH_SCRIPT_QUIT };
+
+    FEHLCD();
+    // Without the environment there's no touch script and no frame dumps
+    explicit FEHLCD(bool fromEnvironment);
+
+    bool Touch(float* x_pos, float* y_pos);
+
+    void Clear();
+    void Clear(unsigned int color);
+    void SetFontColor(unsigned int color);
+    void SetBackgroundColor(unsigned int color);
+
+    void DrawPixel(int x, int y);
+    void DrawHorizontalLine(int y, int x1, int x2);
+    void DrawVerticalLine(int x, int y1, int y2);
+    void DrawRectangle(int x, int y, int width, int height);
+    void FillRectangle(int x, int y, int width, int height);
+
+    void WriteAt(const char* str, int x, int y);
+    void WriteAt(int i, int x, int y);
+    void WriteAt(float f, int x, int y);
+    void WriteAt(double d, int x, int y);
+
+    void Update();
+
+    // Headless only
+    bool LoadTouchScript(const char* filename);
+    void SetFrameDumpDirectory(const char* directory);
+    const unsigned int* Framebuffer() const { return framebuffer; }
+    int FrameCount() const { return frameCount; }
+
+private:
+    // Unprofiled versions used internally so nested calls don't show up in traces
+    void plot(int x, int y);
+    void hline(int y, int x1, int x2);
+    void vline(int x, int y1, int y2);
+    void drawChar(char c, int x, int y);
+    void dumpFrame();
+
+    unsigned int framebuffer[LCD_WIDTH * LCD_HEIGHT];
+    unsigned int fontColor;
+    unsigned int backgroundColor;
+
+    std::vector<ScriptedTouch> script;
+    size_t scriptPos;
+    bool touchDown;
+    float touchX, touchY;
+
+    std::string frameDir;
+    int frameCount;
+};
+
+// LCD is whichever display the calling thread draws to. That's the one
+// screen unless a thread points activeLCD at a display of its own, which is
+// how the session host gives every session its own framebuffer.
+extern FEHLCD screenLCD;
+extern thread_local FEHLCD* activeLCD;
+#define LCD (*activeLCD)
+
+#endif
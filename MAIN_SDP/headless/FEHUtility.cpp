@@ -0,0 +1,17 @@
+#include "FEHUtility.h"
+#include <chrono>
+#include <thread>
+
+void Sleep(int msec) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(msec));
+}
+
+void Sleep(double seconds) {
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+}
+
+double TimeNow() {
+    using namespace std::chrono;
+    static const steady_clock::time_point start = steady_clock::now();
+    return duration<double>(steady_clock::now() - start).count();
+}
@@ -0,0 +1,15 @@
+#ifndef FEHUTILITY_H
+#define FEHUTILITY_H
+
+// Headless stand-in for the simulator's FEHUtility
+
+// Sleep for a number of milliseconds
+void Sleep(int msec);
+
+// Sleep for a number of seconds
+void Sleep(double seconds);
+
+// Seconds since the program started
+double TimeNow();
+
+#endif
@@ -0,0 +1,25 @@
+#include "hitmap.h"
+#include <algorithm>
+
+HitMap hitMap;
+
+HitMap::HitMap() : ids(HITMAP_WIDTH * HITMAP_HEIGHT, HIT_NONE) {}
+
+void HitMap::clear() {
+    std::fill(ids.begin(), ids.end(), (uint16_t)HIT_NONE);
+}
+
+void HitMap::addRect(uint16_t id, int x, int y, int width, int height) {
+    int left = std::max(x, 0);
+    int top = std::max(y, 0);
+    int right = std::min(x + width, HITMAP_WIDTH - 1);
+    int bottom = std::min(y + height, HITMAP_HEIGHT - 1);
+
+    for (int row = top; row <= bottom; row++) {
+        uint16_t* line = ids.data() + row * HITMAP_WIDTH;
+        for (int col = left; col <= right; col++) {
+            if (line[col] == HIT_NONE) line[col] = id;
+        }
+    }
+}
+
@@ -0,0 +1,42 @@
+#ifndef HITMAP_H
+#define HITMAP_H
+
+#include <vector>
+#include <cstdint>
+
+#define HITMAP_WIDTH 320
+#define HITMAP_HEIGHT 240
+
+// Id returned when a touch doesn't land on anything
+#define HIT_NONE 0
+
+// Region id for every pixel of the screen, so a touch resolves to whatever
+// it landed on with a single lookup no matter how many things are clickable.
+// Rebuilt when a screen is set up, looked up on every touch.
+//
+// Regions added first win where they overlap, so add things that sit on
+// top (like the back button) before what's under them.
+class HitMap {
+public:
+    HitMap();
+
+    void clear();
+
+    // Rectangle including its right and bottom edge, same as the old
+    // isTouchInRegion checks. id must be non-zero.
+    void addRect(uint16_t id, int x, int y, int width, int height);
+
+    // Region id at a touch position, HIT_NONE if there's nothing there
+    uint16_t lookup(float x, float y) const {
+        int px = (int)x, py = (int)y;
+        if (x < 0 || y < 0 || px >= HITMAP_WIDTH || py >= HITMAP_HEIGHT) return HIT_NONE;
+        return ids[py * HITMAP_WIDTH + px];
+    }
+
+private:
+    std::vector<uint16_t> ids;
+};
+
+extern HitMap hitMap;
+
+#endif
@@ -0,0 +1,187 @@
+#include "imagecache.h"
+#include "profiler.h"
+#include "embedded.h"
+#include "drawlist.h"
+#include <cstdio>
+#include <tuple>
+
+ImageCache imageCache;
+
+ImageCache::ImageCache()
+    : hitCount(0), missCount(0), stopping(false), jobCount(0),
+      prefetchReady(0), prefetchWaited(0), prefetchMissed(0) {}
+
+ImageCache::~ImageCache() {
+    stopPrefetch();
+}
+
+void ImageCache::decode(const std::string& filename, CachedImage& image) {
+    PROFILE_SCOPE("ImageCache::load");
+    // Images compiled into the binary skip the file and the PNG decode
+    PngImage decoded;
+    const EmbeddedImage* embedded = findEmbeddedImage(filename.c_str());
+    if (embedded ? expandEmbeddedImage(*embedded, decoded) : loadPng(filename.c_str(), decoded)) {
+        image.image = std::move(decoded);
+        image.state.store(IMAGE_READY, std::memory_order_release);
+    } else {
+        printf("ImageCache: failed to load %s\n", filename.c_str());
+        // A failed load is kept so we don't hit the disk again
+        image.state.store(IMAGE_FAILED, std::memory_order_release);
+    }
+}
+
+const PngImage* ImageCache::get(const char* filename) {
+    std::unique_lock<std::mutex> mapGuard(mapLock);
+    auto it = images.find(filename);
+    if (it == images.end()) {
+        missCount++;
+        // New entries start out loading, so anyone else asking waits for this decode
+        CachedImage& image = images[filename];
+        image.used = true;
+        mapGuard.unlock();
+        decode(filename, image);
+        { std::lock_guard<std::mutex> lock(jobLock); }
+        jobDone.notify_all();
+        return image.state.load(std::memory_order_relaxed) == IMAGE_READY ? &image.image : nullptr;
+    }
+    mapGuard.unlock();
+
+    CachedImage& image = it->second;
+    int state = image.state.load(std::memory_order_acquire);
+    bool firstUse = image.prefetched && !image.used.exchange(true);
+
+    if (state == IMAGE_QUEUED && image.state.compare_exchange_strong(state, IMAGE_LOADING)) {
+        // Needed before a worker got to it, decode it right here
+        missCount++;
+        if (firstUse) prefetchMissed++;
+        decode(it->first, image);
+        { std::lock_guard<std::mutex> lock(jobLock); }
+        jobDone.notify_all();
+        state = image.state.load(std::memory_order_relaxed);
+    } else {
+        hitCount++;
+        if (state == IMAGE_LOADING) {
+            // A worker is partway through it, finishing is quicker than starting over
+            PROFILE_SCOPE("ImageCache::wait");
+            if (firstUse) prefetchWaited++;
+            std::unique_lock<std::mutex> lock(jobLock);
+            jobDone.wait(lock, [&image] {
+                return image.state.load(std::memory_order_acquire) >= IMAGE_READY;
+            });
+            state = image.state.load(std::memory_order_relaxed);
+        } else if (firstUse) {
+            prefetchReady++;
+        }
+    }
+    return state == IMAGE_READY ? &image.image : nullptr;
+}
+
+bool ImageCache::draw(DrawList& list, const char* filename, int x, int y) {
+    const PngImage* image = get(filename);
+    if (!image) return false;
+    drawImage(list, *image, x, y);
+    return true;
+}
+
+void ImageCache::prefetch(const char* filename, int priority) {
+    std::unique_lock<std::mutex> mapGuard(mapLock);
+    if (images.find(filename) != images.end()) return;
+
+    auto inserted = images.emplace(std::piecewise_construct, std::forward_as_tuple(filename),
+                                   std::forward_as_tuple());
+    CachedImage& image = inserted.first->second;
+    image.prefetched = true;
+    image.state.store(IMAGE_QUEUED, std::memory_order_relaxed);
+    mapGuard.unlock();
+
+    {
+        std::lock_guard<std::mutex> lock(jobLock);
+        if (stopping) return;
+        jobs.push({priority, jobCount++, filename, &image});
+        while (workers.size() < PREFETCH_THREADS) {
+            workers.emplace_back(&ImageCache::runWorker, this);
+        }
+    }
+    jobReady.notify_one();
+}
+
+void ImageCache::runWorker() {
+    for (;;) {
+        PrefetchJob job;
+        {
+            std::unique_lock<std::mutex> lock(jobLock);
+            jobReady.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (stopping) return;
+            job = jobs.top();
+            jobs.pop();
+        }
+
+        // The render thread may have needed it first
+        int expected = IMAGE_QUEUED;
+        if (!job.image->state.compare_exchange_strong(expected, IMAGE_LOADING)) continue;
+        decode(job.filename, *job.image);
+
+        // Wake the render thread in case it is waiting on this one
+        { std::lock_guard<std::mutex> lock(jobLock); }
+        jobDone.notify_all();
+    }
+}
+
+void ImageCache::stopPrefetch() {
+    {
+        std::lock_guard<std::mutex> lock(jobLock);
+        stopping = true;
+    }
+    jobReady.notify_all();
+    for (auto& worker : workers) {
+        if (worker.joinable()) worker.join();
+    }
+    workers.clear();
+}
+
+size_t ImageCache::residentBytes() const {
+    std::lock_guard<std::mutex> guard(mapLock);
+    size_t total = 0;
+    for (const auto& entry : images) {
+        if (entry.second.state.load(std::memory_order_acquire) != IMAGE_READY) continue;
+        total += entry.second.image.pixels.size() * sizeof(unsigned int);
+    }
+    return total;
+}
+
+void ImageCache::printStats() const {
+    size_t count;
+    {
+        std::lock_guard<std::mutex> guard(mapLock);
+        count = images.size();
+    }
+    printf("ImageCache: %d hits, %d misses, %zu images, %zu bytes resident\n",
+           hitCount.load(), missCount.load(), count, residentBytes());
+    int ready = prefetchReady, waited = prefetchWaited, missed = prefetchMissed;
+    int used = ready + waited + missed;
+    if (jobCount > 0) {
+        printf("ImageCache: %d prefetched, %d used: %d ready, %d waited on, %d not started "
+               "(%.0f%% hit rate)\n",
+               jobCount, used, ready, waited, missed, used ? ready * 100.0 / used : 0.0);
+    }
+}
+
+void drawImage(DrawList& draw, const PngImage& image, int x, int y) {
+    drawImageClipped(draw, image, x, y, x, y, image.width, image.height);
+}
+
+void drawImageClipped(DrawList& draw, const PngImage& image, int x, int y,
+                      int clipX, int clipY, int clipWidth, int clipHeight) {
+    PROFILE_SCOPE("drawImage");
+    // Work out which part of the image falls inside the clip
+    int firstCol = clipX > x ? clipX - x : 0;
+    int firstRow = clipY > y ? clipY - y : 0;
+    int lastCol = clipX + clipWidth - x;
+    int lastRow = clipY + clipHeight - y;
+    if (lastCol > image.width) lastCol = image.width;
+    if (lastRow > image.height) lastRow = image.height;
+
+    if (firstCol >= lastCol || firstRow >= lastRow) return;
+    draw.pushPixels(image.pixels.data() + (size_t)firstRow * image.width + firstCol, image.width,
+                    x + firstCol, y + firstRow, lastCol - firstCol, lastRow - firstRow);
+}
@@ -0,0 +1,119 @@
+#ifndef IMAGECACHE_H
+#define IMAGECACHE_H
+
+#include "png.h"
+#include <string>
+#include <map>
+#include <queue>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+class DrawList;
+
+// Background decoder threads used by ImageCache::prefetch
+#define PREFETCH_THREADS 2
+
+// Where a cached image is. Prefetched images start out queued, a worker
+// (or the render thread, if it needs the image first) claims it by moving
+// it to loading, and whoever decoded it publishes ready or failed.
+#define IMAGE_QUEUED 0
+#define IMAGE_LOADING 1
+#define IMAGE_READY 2
+#define IMAGE_FAILED 3
+
+struct CachedImage {
+    CachedImage() : state(IMAGE_LOADING), prefetched(false), used(false) {}
+
+    std::atomic<int> state;
+    bool prefetched;         // set before the image is visible to anyone else
+    std::atomic<bool> used;  // drawn at least once
+    PngImage image;   // only read once state is IMAGE_READY
+};
+
+// Keeps every image we have drawn decoded in memory, keyed by filename.
+// The first draw of a file decodes it, every draw after that just
+// pushes the pixels we already have to the LCD.
+//
+// Images the game is about to need can be prefetched: they are decoded on
+// worker threads and handed over through the image's atomic state, so
+// getting a finished image never waits on a decode. The filename lookup
+// itself is behind a short lock so hosted sessions can share one cache.
+class ImageCache {
+public:
+    ImageCache();
+    ~ImageCache();
+
+    // Returns the decoded image, or nullptr if it couldn't be loaded.
+    // Waits for it if a worker is halfway through decoding it.
+    const PngImage* get(const char* filename);
+
+    // Draw the image with its top left corner at (x, y).
+    // Fully transparent pixels are skipped.
+    bool draw(DrawList& list, const char* filename, int x, int y);
+
+    // Start decoding an image in the background if it isn't cached yet.
+    // Higher priorities are decoded first.
+    void prefetch(const char* filename, int priority = 0);
+
+    // Stop the workers, anything still queued gets loaded on demand instead
+    void stopPrefetch();
+
+    int hits() const { return hitCount; }
+    int misses() const { return missCount; }
+    size_t residentBytes() const;
+
+    void printStats() const;
+
+private:
+    struct PrefetchJob {
+        int priority;
+        int order;
+        std::string filename;
+        CachedImage* image;
+    };
+
+    // Highest priority first, then first come first served
+    struct JobOrder {
+        bool operator()(const PrefetchJob& a, const PrefetchJob& b) const {
+            return a.priority < b.priority || (a.priority == b.priority && a.order > b.order);
+        }
+    };
+
+    void decode(const std::string& filename, CachedImage& image);
+    void runWorker();
+
+    // Map nodes never move, so workers can hold on to their CachedImage
+    // while render threads add more
+    std::map<std::string, CachedImage> images;
+    mutable std::mutex mapLock;
+    std::atomic<int> hitCount;
+    std::atomic<int> missCount;
+
+    std::priority_queue<PrefetchJob, std::vector<PrefetchJob>, JobOrder> jobs;
+    std::vector<std::thread> workers;
+    std::mutex jobLock;
+    std::condition_variable jobReady;
+    std::condition_variable jobDone;
+    bool stopping;
+    int jobCount;
+
+    // How prefetched images were doing by the time they were first drawn
+    std::atomic<int> prefetchReady;
+    std::atomic<int> prefetchWaited;
+    std::atomic<int> prefetchMissed;
+};
+
+// Draw a decoded image. The draw list refers to the cached pixels, which
+// stay put for as long as the cache does.
+void drawImage(DrawList& draw, const PngImage& image, int x, int y);
+
+// Same as drawImage but only touches pixels inside the clip rectangle
+void drawImageClipped(DrawList& draw, const PngImage& image, int x, int y,
+                      int clipX, int clipY, int clipWidth, int clipHeight);
+
+extern ImageCache imageCache;
+
+#endif
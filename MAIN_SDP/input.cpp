@@ -0,0 +1,186 @@
+#include "input.h"
+#include "replay.h"
+#include <FEHLCD.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+// See InputThread, only the headless LCD gets sampled off the game thread
+#ifdef FEHLCD_HAS_FRAMEBUFFER
+#define TOUCH_ON_INPUT_THREAD 1
+#else
+#define TOUCH_ON_INPUT_THREAD 0
+#endif
+
+InputThread input;
+
+double inputClock() {
+    using namespace std::chrono;
+    static const steady_clock::time_point start = steady_clock::now();
+    return duration<double>(steady_clock::now() - start).count();
+}
+
+InputThread::InputThread()
+    : running(false), polling(false), touchDown(false), lastX(-1), lastY(-1), recordFile(nullptr), replayPos(0), replaying(false), replayRealtime(false),
+      replayDone(false), droppedEvents(0), reactionCount(0), reactionTotal(0), reactionMax(0) {}
+
+InputThread::~InputThread() {
+    stop();
+    if (recordFile) fclose(recordFile);
+}
+
+bool InputThread::startRecording(const char* filename, uint64_t seed) {
+    if (running) {
+        printf("Input: recording has to start before the input thread\n");
+        return false;
+    }
+    recordFile = fopen(filename, "w");
+    if (!recordFile) {
+        printf("Input: can't record to %s\n", filename);
+        return false;
+    }
+    fprintf(recordFile, "seed %llu\n", (unsigned long long)seed);
+    fflush(recordFile);
+    return true;
+}
+
+void InputThread::startReplay(const std::vector<TouchEvent>& events, bool realtime) {
+    replayEvents = events;
+    replayPos = 0;
+    replaying = true;
+    replayRealtime = realtime;
+    replayDone = false;
+    // Fast replays are handed straight to waitEvent, no thread needed
+    if (realtime) start();
+}
+
+bool InputThread::replayFinished() const {
+    if (!replaying) return false;
+    if (replayRealtime) return replayDone && queue.empty();
+    return replayPos >= replayEvents.size();
+}
+
+bool InputThread::nextReplayTime(double& time) const {
+    if (!replaying || replayRealtime || replayPos >= replayEvents.size()) return false;
+    time = replayEvents[replayPos].time;
+    return true;
+}
+
+void InputThread::start() {
+    if (running) return;
+    running = true;
+    if (!replaying && !TOUCH_ON_INPUT_THREAD) {
+        polling = true;
+        return;
+    }
+    thread = std::thread(&InputThread::run, this);
+}
+
+void InputThread::stop() {
+    if (!running) return;
+    running = false;
+    polling = false;
+    if (thread.joinable()) thread.join();
+}
+
+void InputThread::pushEvent(int type, float x, float y) {
+    TouchEvent event = {type, x, y, inputClock()};
+    if (!queue.push(event)) {
+        droppedEvents++;
+        return;
+    }
+    if (recordFile) writeTouchEvent(recordFile, event);
+    // Taking the lock here means the consumer can't miss the wakeup
+    // between checking the ring and going to sleep
+    { std::lock_guard<std::mutex> lock(waitMutex); }
+    waitCond.notify_one();
+}
+
+void InputThread::runReplay() {
+    double start = inputClock();
+    double first = replayEvents.empty() ? 0 : replayEvents[0].time;
+    for (const auto& event : replayEvents) {
+        double due = start + event.time - first;
+        while (running && inputClock() < due) {
+            std::this_thread::sleep_for(std::chrono::duration<double>(INPUT_SAMPLE_INTERVAL));
+        }
+        if (!running) return;
+        pushEvent(event.type, event.x, event.y);
+    }
+    replayDone = true;
+    { std::lock_guard<std::mutex> lock(waitMutex); }
+    waitCond.notify_one();
+}
+
+void InputThread::sampleTouch() {
+    float x, y;
+    if (LCD.Touch(&x, &y)) {
+        if (!touchDown) {
+            pushEvent(TOUCH_PRESS, x, y);
+            touchDown = true;
+        } else if ((int)x != (int)lastX || (int)y != (int)lastY) {
+            pushEvent(TOUCH_DRAG, x, y);
+        }
+        lastX = x;
+        lastY = y;
+    } else if (touchDown) {
+        // Release reports where the finger was last seen
+        pushEvent(TOUCH_RELEASE, lastX, lastY);
+        touchDown = false;
+    }
+}
+
+void InputThread::run() {
+    if (replaying) {
+        runReplay();
+        return;
+    }
+    while (running) {
+        sampleTouch();
+        std::this_thread::sleep_for(std::chrono::duration<double>(INPUT_SAMPLE_INTERVAL));
+    }
+}
+
+bool InputThread::waitEvent(TouchEvent& event, double timeout) {
+    if (replaying && !replayRealtime) {
+        if (replayPos >= replayEvents.size()) return false;
+        event = replayEvents[replayPos++];
+        event.time = inputClock();
+        return true;
+    }
+
+    // Sampling on the game thread, at the same rate the thread would
+    if (polling) {
+        double end = inputClock() + timeout;
+        for (;;) {
+            sampleTouch();
+            if (queue.pop(event)) return true;
+            double left = end - inputClock();
+            if (left <= 0) return false;
+            std::this_thread::sleep_for(std::chrono::duration<double>(std::min(left, INPUT_SAMPLE_INTERVAL)));
+        }
+    }
+
+    if (queue.pop(event)) return true;
+    if (timeout <= 0) return false;
+
+    std::unique_lock<std::mutex> lock(waitMutex);
+    waitCond.wait_for(lock, std::chrono::duration<double>(timeout),
+                      [this] { return !queue.empty() || replayDone; });
+    return queue.pop(event);
+}
+
+void InputThread::noteReaction(const TouchEvent& event) {
+    double latency = inputClock() - event.time;
+    reactionCount++;
+    reactionTotal += latency;
+    if (latency > reactionMax) reactionMax = latency;
+}
+
+void InputThread::printStats() const {
+    printf("Input: %d taps handled, avg reaction %.2f ms, max %.2f ms, %d events dropped\n",
+           reactionCount,
+           reactionCount ? reactionTotal / reactionCount * 1000.0 : 0.0,
+           reactionMax * 1000.0,
+           droppedEvents.load());
+}
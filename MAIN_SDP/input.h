@@ -0,0 +1,137 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <cstdio>
+
+// Touch events produced by sampling the screen or replaying a log
+#define TOUCH_PRESS 0
+#define TOUCH_RELEASE 1
+#define TOUCH_DRAG 2
+
+// How often LCD.Touch is sampled
+#define INPUT_SAMPLE_INTERVAL 0.005
+
+struct TouchEvent {
+    int type;
+    float x, y;
+    double time;  // seconds, from inputClock()
+};
+
+// Monotonic clock in seconds used for event timestamps
+double inputClock();
+
+// Single producer / single consumer ring buffer.
+// The input thread is the only writer and the game loop the only reader,
+// so a pair of atomic indices is all the synchronisation we need.
+template <typename T, int Capacity>
+class SpscRing {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    SpscRing() : head(0), tail(0) {}
+
+    bool push(const T& item) {
+        unsigned int t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == Capacity) return false;
+        items[t & (Capacity - 1)] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item) {
+        unsigned int h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+        item = items[h & (Capacity - 1)];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+private:
+    T items[Capacity];
+    std::atomic<unsigned int> head;
+    std::atomic<unsigned int> tail;
+};
+
+// Samples the touch screen and turns it into press / drag / release
+// events for the game loop.
+//
+// The simulator's FEHLCD makes no promise about being called from two
+// threads, so there LCD.Touch stays on the game thread: waitEvent samples
+// it while it waits. The headless FEHLCD's Touch only reads its touch
+// script, which nothing drawing touches, so headless builds sample on a
+// thread of their own. Realtime replays always feed events from a thread.
+class InputThread {
+public:
+    InputThread();
+    ~InputThread();
+
+    void start();
+    void stop();
+
+    // Write every event to a touch log as it happens (see replay.h), after
+    // the seed the session's answer orders come from. The input thread may
+    // write to it, so call this before start or startReplay.
+    bool startRecording(const char* filename, uint64_t seed);
+
+    // Feed recorded events instead of sampling the screen. In realtime mode
+    // they arrive at their recorded times, otherwise as fast as the game asks.
+    void startReplay(const std::vector<TouchEvent>& events, bool realtime);
+    bool replayFinished() const;
+    // Recorded time of the next event of a fast replay, false if there isn't one
+    bool nextReplayTime(double& time) const;
+
+    // Pop the next event, waiting up to timeout seconds for one to arrive.
+    // Returns false if nothing came in before the timeout.
+    bool waitEvent(TouchEvent& event, double timeout);
+
+    // Call once the game has reacted to an event, records tap-to-reaction latency
+    void noteReaction(const TouchEvent& event);
+
+    void printStats() const;
+
+private:
+    void run();
+    void runReplay();
+    // Read LCD.Touch once and push whatever changed since the last time
+    void sampleTouch();
+    void pushEvent(int type, float x, float y);
+
+    SpscRing<TouchEvent, 64> queue;
+    std::thread thread;
+    std::atomic<bool> running;
+    bool polling;  // waitEvent samples the screen, there's no thread doing it
+
+    // Where the finger was at the last sample
+    bool touchDown;
+    float lastX, lastY;
+
+    // Only used to sleep the consumer when the ring is empty
+    std::mutex waitMutex;
+    std::condition_variable waitCond;
+
+    FILE* recordFile;
+    std::vector<TouchEvent> replayEvents;
+    size_t replayPos;
+    bool replaying;
+    bool replayRealtime;
+    std::atomic<bool> replayDone;
+
+    std::atomic<int> droppedEvents;
+    int reactionCount;
+    double reactionTotal;
+    double reactionMax;
+};
+
+extern InputThread input;
+
+#endif
@@ -0,0 +1,382 @@
+#include "png.h"
+#include <cstdio>
+#include <cstring>
+
+// ---- Inflate (zlib / deflate) ----
+// Straightforward canonical-huffman decoder, same approach as zlib's puff.c
+
+namespace {
+
+struct BitReader {
+    const unsigned char* data;
+    size_t size;
+    size_t pos;
+    unsigned int bitBuf;
+    int bitCount;
+    bool error;
+};
+
+int getBits(BitReader& br, int need) {
+    unsigned int val = br.bitBuf;
+    while (br.bitCount < need) {
+        if (br.pos >= br.size) {
+            br.error = true;
+            return 0;
+        }
+        val |= (unsigned int)br.data[br.pos++] << br.bitCount;
+        br.bitCount += 8;
+    }
+    br.bitBuf = val >> need;
+    br.bitCount -= need;
+    return (int)(val & ((1u << need) - 1));
+}
+
+#define MAX_BITS 15
+
+struct Huffman {
+    short count[MAX_BITS + 1];
+    short symbol[288];
+};
+
+int decodeSymbol(BitReader& br, const Huffman& h) {
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len <= MAX_BITS; len++) {
+        code |= getBits(br, 1);
+        if (br.error) return -1;
+        int count = h.count[len];
+        if (code - count < first) {
+            return h.symbol[index + (code - first)];
+        }
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+// Returns 0 for a complete code, >0 incomplete, <0 oversubscribed
+int buildHuffman(Huffman& h, const short* lengths, int n) {
+    for (int len = 0; len <= MAX_BITS; len++) h.count[len] = 0;
+    for (int s = 0; s < n; s++) h.count[lengths[s]]++;
+    if (h.count[0] == n) return 0;
+
+    int left = 1;
+    for (int len = 1; len <= MAX_BITS; len++) {
+        left <<= 1;
+        left -= h.count[len];
+        if (left < 0) return left;
+    }
+
+    short offs[MAX_BITS + 1];
+    offs[1] = 0;
+    for (int len = 1; len < MAX_BITS; len++) offs[len + 1] = offs[len] + h.count[len];
+    for (int s = 0; s < n; s++) {
+        if (lengths[s] != 0) h.symbol[offs[lengths[s]]++] = (short)s;
+    }
+    return left;
+}
+
+const short lengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+const short lengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const short distBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577};
+const short distExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+bool inflateCodes(BitReader& br, std::vector<unsigned char>& out,
+                  const Huffman& lencode, const Huffman& distcode) {
+    while (true) {
+        int symbol = decodeSymbol(br, lencode);
+        if (symbol < 0) return false;
+        if (symbol < 256) {
+            out.push_back((unsigned char)symbol);
+        } else if (symbol == 256) {
+            return true;
+        } else {
+            symbol -= 257;
+            if (symbol >= 29) return false;
+            int len = lengthBase[symbol] + getBits(br, lengthExtra[symbol]);
+            int dsym = decodeSymbol(br, distcode);
+            if (dsym < 0 || dsym >= 30) return false;
+            size_t dist = distBase[dsym] + getBits(br, distExtra[dsym]);
+            if (br.error || dist > out.size()) return false;
+            size_t from = out.size() - dist;
+            for (int i = 0; i < len; i++) out.push_back(out[from + i]);
+        }
+    }
+}
+
+bool inflateStored(BitReader& br, std::vector<unsigned char>& out) {
+    // Stored blocks start on a byte boundary
+    br.bitBuf = 0;
+    br.bitCount = 0;
+    if (br.pos + 4 > br.size) return false;
+    unsigned int len = br.data[br.pos] | (br.data[br.pos + 1] << 8);
+    unsigned int nlen = br.data[br.pos + 2] | (br.data[br.pos + 3] << 8);
+    br.pos += 4;
+    if (len != (~nlen & 0xffff) || br.pos + len > br.size) return false;
+    out.insert(out.end(), br.data + br.pos, br.data + br.pos + len);
+    br.pos += len;
+    return true;
+}
+
+struct FixedTables {
+    Huffman lencode, distcode;
+};
+
+FixedTables buildFixedTables() {
+    FixedTables tables;
+    short lengths[288];
+    int s = 0;
+    for (; s < 144; s++) lengths[s] = 8;
+    for (; s < 256; s++) lengths[s] = 9;
+    for (; s < 280; s++) lengths[s] = 7;
+    for (; s < 288; s++) lengths[s] = 8;
+    buildHuffman(tables.lencode, lengths, 288);
+    for (s = 0; s < 30; s++) lengths[s] = 5;
+    buildHuffman(tables.distcode, lengths, 30);
+    return tables;
+}
+
+bool inflateFixed(BitReader& br, std::vector<unsigned char>& out) {
+    // Built once on first use, the prefetch workers and hosted sessions can
+    // all get here at the same time
+    static const FixedTables tables = buildFixedTables();
+    return inflateCodes(br, out, tables.lencode, tables.distcode);
+}
+
+bool inflateDynamic(BitReader& br, std::vector<unsigned char>& out) {
+    static const short order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    short lengths[320];
+
+    int nlen = getBits(br, 5) + 257;
+    int ndist = getBits(br, 5) + 1;
+    int ncode = getBits(br, 4) + 4;
+    if (br.error || nlen > 286 || ndist > 30) return false;
+
+    int index = 0;
+    for (; index < ncode; index++) lengths[order[index]] = (short)getBits(br, 3);
+    for (; index < 19; index++) lengths[order[index]] = 0;
+
+    Huffman lencode, distcode;
+    if (buildHuffman(lencode, lengths, 19) != 0) return false;
+
+    index = 0;
+    while (index < nlen + ndist) {
+        int symbol = decodeSymbol(br, lencode);
+        if (symbol < 0) return false;
+        if (symbol < 16) {
+            lengths[index++] = (short)symbol;
+        } else {
+            short len = 0;
+            int repeat;
+            if (symbol == 16) {
+                if (index == 0) return false;
+                len = lengths[index - 1];
+                repeat = 3 + getBits(br, 2);
+            } else if (symbol == 17) {
+                repeat = 3 + getBits(br, 3);
+            } else {
+                repeat = 11 + getBits(br, 7);
+            }
+            if (br.error || index + repeat > nlen + ndist) return false;
+            while (repeat--) lengths[index++] = len;
+        }
+    }
+    if (lengths[256] == 0) return false;
+
+    int err = buildHuffman(lencode, lengths, nlen);
+    if (err < 0 || (err > 0 && nlen - lencode.count[0] != 1)) return false;
+    err = buildHuffman(distcode, lengths + nlen, ndist);
+    if (err < 0 || (err > 0 && ndist - distcode.count[0] != 1)) return false;
+
+    return inflateCodes(br, out, lencode, distcode);
+}
+
+bool zlibInflate(const unsigned char* data, size_t size, std::vector<unsigned char>& out) {
+    // 2 byte zlib header, we don't bother checking the adler32 at the end
+    if (size < 2 || (data[0] & 0x0f) != 8 || ((data[0] << 8) | data[1]) % 31 != 0) return false;
+
+    BitReader br = {data, size, 2, 0, 0, false};
+    int last;
+    do {
+        last = getBits(br, 1);
+        int type = getBits(br, 2);
+        if (br.error) return false;
+        bool ok;
+        switch (type) {
+            case 0: ok = inflateStored(br, out); break;
+            case 1: ok = inflateFixed(br, out); break;
+            case 2: ok = inflateDynamic(br, out); break;
+            default: ok = false; break;
+        }
+        if (!ok) return false;
+    } while (!last);
+    return true;
+}
+
+// ---- PNG ----
+
+unsigned int readU32(const unsigned char* p) {
+    return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | p[3];
+}
+
+int paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = p > a ? p - a : a - p;
+    int pb = p > b ? p - b : b - p;
+    int pc = p > c ? p - c : c - p;
+    if (pa <= pb && pa <= pc) return a;
+    if (pb <= pc) return b;
+    return c;
+}
+
+bool unfilter(unsigned char* raw, int height, size_t stride, int bpp) {
+    unsigned char* prev = nullptr;
+    for (int y = 0; y < height; y++) {
+        unsigned char filter = raw[0];
+        unsigned char* row = raw + 1;
+        for (size_t i = 0; i < stride; i++) {
+            int a = i >= (size_t)bpp ? row[i - bpp] : 0;
+            int b = prev ? prev[i] : 0;
+            int c = (prev && i >= (size_t)bpp) ? prev[i - bpp] : 0;
+            switch (filter) {
+                case 0: break;
+                case 1: row[i] += a; break;
+                case 2: row[i] += b; break;
+                case 3: row[i] += (a + b) / 2; break;
+                case 4: row[i] += paeth(a, b, c); break;
+                default: return false;
+            }
+        }
+        prev = row;
+        raw += stride + 1;
+    }
+    return true;
+}
+
+} // namespace
+
+bool decodePng(const unsigned char* data, size_t size, PngImage& out) {
+    static const unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    if (size < 8 || memcmp(data, signature, 8) != 0) return false;
+
+    int width = 0, height = 0, bitDepth = 0, colorType = -1, interlace = 0;
+    unsigned int palette[256];
+    int paletteSize = 0;
+    for (int i = 0; i < 256; i++) palette[i] = 0xff000000;
+    std::vector<unsigned char> compressed;
+
+    size_t pos = 8;
+    while (pos + 12 <= size) {
+        unsigned int len = readU32(data + pos);
+        const unsigned char* type = data + pos + 4;
+        const unsigned char* chunk = data + pos + 8;
+        if (len > size - pos - 12) return false;
+
+        if (memcmp(type, "IHDR", 4) == 0 && len >= 13) {
+            width = (int)readU32(chunk);
+            height = (int)readU32(chunk + 4);
+            bitDepth = chunk[8];
+            colorType = chunk[9];
+            interlace = chunk[12];
+        } else if (memcmp(type, "PLTE", 4) == 0) {
+            paletteSize = (int)(len / 3);
+            if (paletteSize > 256) return false;
+            for (int i = 0; i < paletteSize; i++) {
+                palette[i] = 0xff000000 | (chunk[i * 3] << 16) | (chunk[i * 3 + 1] << 8) | chunk[i * 3 + 2];
+            }
+        } else if (memcmp(type, "tRNS", 4) == 0 && colorType == 3) {
+            for (unsigned int i = 0; i < len && i < 256; i++) {
+                palette[i] = (palette[i] & 0x00ffffff) | ((unsigned int)chunk[i] << 24);
+            }
+        } else if (memcmp(type, "IDAT", 4) == 0) {
+            compressed.insert(compressed.end(), chunk, chunk + len);
+        } else if (memcmp(type, "IEND", 4) == 0) {
+            break;
+        }
+        pos += len + 12;
+    }
+
+    if (width <= 0 || height <= 0 || width > 16384 || height > 16384 || interlace != 0) return false;
+
+    int channels;
+    switch (colorType) {
+        case 0: channels = 1; break;
+        case 2: channels = 3; break;
+        case 3: channels = 1; break;
+        case 4: channels = 2; break;
+        case 6: channels = 4; break;
+        default: return false;
+    }
+    if (colorType == 3) {
+        if (bitDepth != 1 && bitDepth != 2 && bitDepth != 4 && bitDepth != 8) return false;
+        if (paletteSize == 0) return false;
+    } else if (bitDepth != 8) {
+        return false;
+    }
+
+    size_t stride = ((size_t)width * channels * bitDepth + 7) / 8;
+    std::vector<unsigned char> raw;
+    raw.reserve((stride + 1) * height);
+    if (!zlibInflate(compressed.data(), compressed.size(), raw)) return false;
+    if (raw.size() < (stride + 1) * height) return false;
+
+    int bpp = (channels * bitDepth + 7) / 8;
+    if (!unfilter(raw.data(), height, stride, bpp)) return false;
+
+    out.width = width;
+    out.height = height;
+    out.pixels.resize((size_t)width * height);
+    for (int y = 0; y < height; y++) {
+        const unsigned char* row = raw.data() + y * (stride + 1) + 1;
+        unsigned int* dst = out.pixels.data() + (size_t)y * width;
+        for (int x = 0; x < width; x++) {
+            switch (colorType) {
+                case 0:
+                    dst[x] = 0xff000000 | (row[x] << 16) | (row[x] << 8) | row[x];
+                    break;
+                case 2:
+                    dst[x] = 0xff000000 | (row[x * 3] << 16) | (row[x * 3 + 1] << 8) | row[x * 3 + 2];
+                    break;
+                case 3: {
+                    int perByte = 8 / bitDepth;
+                    int shift = 8 - bitDepth - (x % perByte) * bitDepth;
+                    int index = (row[x / perByte] >> shift) & ((1 << bitDepth) - 1);
+                    dst[x] = palette[index];
+                    break;
+                }
+                case 4:
+                    dst[x] = ((unsigned int)row[x * 2 + 1] << 24) | (row[x * 2] << 16) | (row[x * 2] << 8) | row[x * 2];
+                    break;
+                case 6:
+                    dst[x] = ((unsigned int)row[x * 4 + 3] << 24) | (row[x * 4] << 16) | (row[x * 4 + 1] << 8) | row[x * 4 + 2];
+                    break;
+            }
+        }
+    }
+    return true;
+}
+
+bool loadPng(const char* filename, PngImage& out) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) return false;
+
+    std::vector<unsigned char> data;
+    unsigned char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.insert(data.end(), buffer, buffer + n);
+    }
+    fclose(file);
+
+    return decodePng(data.data(), data.size(), out);
+}
@@ -0,0 +1,26 @@
+#ifndef PNG_H
+#define PNG_H
+
+#include <vector>
+#include <cstddef>
+
+// Small self-contained PNG decoder so we can hold images in memory
+// ourselves instead of going through FEHImage every time.
+// Handles the formats our assets use: 8-bit gray/RGB/RGBA and
+// palette images (1/2/4/8 bit, with optional tRNS). No interlacing.
+
+struct PngImage {
+    int width = 0;
+    int height = 0;
+    // One 0xAARRGGBB value per pixel, row major
+    std::vector<unsigned int> pixels;
+};
+
+// Decode a PNG from memory. Returns false if the data is bad or
+// uses a format we don't support.
+bool decodePng(const unsigned char* data, size_t size, PngImage& out);
+
+// Read the whole file and decode it
+bool loadPng(const char* filename, PngImage& out);
+
+#endif
@@ -0,0 +1,128 @@
+#include "profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+// Stop recording individual events past this so a long session can't eat
+// all the memory. Totals and frame times keep counting.
+#define MAX_TRACE_EVENTS 1000000
+
+Profiler profiler;
+
+double profilerClock() {
+    using namespace std::chrono;
+    static const steady_clock::time_point start = steady_clock::now();
+    return duration<double, std::micro>(steady_clock::now() - start).count();
+}
+
+static void finishProfiler() {
+    profiler.finish();
+}
+
+void Profiler::startFromEnvironment() {
+    const char* path = getenv("ECOQUEST_PROFILE");
+    if (path && path[0] != '\0') start(path);
+}
+
+void Profiler::start(const char* path) {
+    tracePath = path;
+    events.reserve(65536);
+    profilerClock();
+    enabled.store(true, std::memory_order_relaxed);
+
+    // The game loop never returns, so hook both ways the process can end
+    atexit(finishProfiler);
+    at_quick_exit(finishProfiler);
+}
+
+int Profiler::threadIndex() {
+    static std::map<std::thread::id, int> ids;
+    auto it = ids.find(std::this_thread::get_id());
+    if (it != ids.end()) return it->second;
+    int index = (int)ids.size() + 1;
+    ids[std::this_thread::get_id()] = index;
+    return index;
+}
+
+void Profiler::addEvent(const char* name, double start, double end) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (events.size() < MAX_TRACE_EVENTS) {
+        events.push_back({name, start, end - start, threadIndex()});
+    }
+    ScopeTotals& scope = totals[name];
+    scope.calls++;
+    scope.total += end - start;
+}
+
+void Profiler::beginFrame() {
+    if (!enabled.load(std::memory_order_relaxed)) return;
+    frameStart = profilerClock();
+}
+
+void Profiler::endFrame(const char* state) {
+    if (!enabled.load(std::memory_order_relaxed)) return;
+    double end = profilerClock();
+    std::lock_guard<std::mutex> guard(lock);
+    if (events.size() < MAX_TRACE_EVENTS) {
+        events.push_back({state, frameStart, end - frameStart, threadIndex()});
+    }
+    frameTimes[state].push_back(end - frameStart);
+}
+
+void Profiler::finish() {
+    // Only the first caller writes anything, even if two get here at once
+    if (!enabled.exchange(false)) return;
+    std::lock_guard<std::mutex> guard(lock);
+    writeTrace();
+    printSummary();
+    // quick_exit doesn't flush stdio for us
+    fflush(stdout);
+}
+
+void Profiler::writeTrace() {
+    FILE* file = fopen(tracePath.c_str(), "w");
+    if (!file) {
+        printf("Profiler: can't write %s\n", tracePath.c_str());
+        return;
+    }
+
+    fprintf(file, "{\"traceEvents\":[\n");
+    for (size_t i = 0; i < events.size(); i++) {
+        const ProfileEvent& event = events[i];
+        fprintf(file, "{\"name\":\"%s\",\"cat\":\"game\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}%s\n",
+                event.name, event.start, event.duration, event.thread,
+                i + 1 < events.size() ? "," : "");
+    }
+    fprintf(file, "],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(file);
+    printf("Profiler: wrote %zu events to %s\n", events.size(), tracePath.c_str());
+}
+
+static double percentile(std::vector<double>& values, double p) {
+    if (values.empty()) return 0;
+    size_t index = (size_t)(p * (values.size() - 1) + 0.5);
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+void Profiler::printSummary() {
+    printf("\n%-16s %8s %10s %10s %10s\n", "State", "Frames", "p50 ms", "p99 ms", "max ms");
+    for (auto& entry : frameTimes) {
+        std::vector<double>& times = entry.second;
+        double p50 = percentile(times, 0.50);
+        double p99 = percentile(times, 0.99);
+        double max = *std::max_element(times.begin(), times.end());
+        printf("%-16s %8zu %10.3f %10.3f %10.3f\n",
+               entry.first.c_str(), times.size(), p50 / 1000.0, p99 / 1000.0, max / 1000.0);
+    }
+
+    printf("\n%-24s %10s %12s %10s\n", "Scope", "Calls", "Total ms", "Avg us");
+    for (const auto& entry : totals) {
+        const ScopeTotals& scope = entry.second;
+        printf("%-24s %10lld %12.3f %10.2f\n", entry.first.c_str(), scope.calls,
+               scope.total / 1000.0, scope.total / scope.calls);
+    }
+    printf("\n");
+}
@@ -0,0 +1,91 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+
+// Built-in frame profiler. Off unless ECOQUEST_PROFILE is set, in which case
+// it names the Chrome / Perfetto trace file written at exit
+// (load it in chrome://tracing or ui.perfetto.dev). A summary table of
+// per-state frame times and per-scope totals is printed at exit too.
+//
+// When off, a PROFILE_SCOPE costs one relaxed load and a branch. Build with
+// -DECOQUEST_NO_PROFILE to compile the scopes out entirely.
+
+struct ProfileEvent {
+    const char* name;
+    double start;  // microseconds
+    double duration;
+    int thread;
+};
+
+struct ScopeTotals {
+    long long calls = 0;
+    double total = 0;  // microseconds
+};
+
+class Profiler {
+public:
+    Profiler() : enabled(false), frameStart(0) {}
+
+    // Turns the profiler on if ECOQUEST_PROFILE is set
+    void startFromEnvironment();
+    void start(const char* tracePath);
+
+    void addEvent(const char* name, double start, double end);
+
+    // Bracket one frame of the game loop, frames are grouped by state name
+    void beginFrame();
+    void endFrame(const char* state);
+
+    // Write the trace file and print the summary, safe to call more than once
+    void finish();
+
+    // Read by PROFILE_SCOPE on any thread (the prefetch decoders too), and
+    // finish() can run on whichever thread ends the process
+    std::atomic<bool> enabled;
+
+private:
+    void writeTrace();
+    void printSummary();
+    int threadIndex();
+
+    std::mutex lock;
+    std::string tracePath;
+    std::vector<ProfileEvent> events;
+    std::map<std::string, ScopeTotals> totals;
+    std::map<std::string, std::vector<double>> frameTimes;
+    double frameStart;
+};
+
+// Microseconds since the profiler clock started
+double profilerClock();
+
+extern Profiler profiler;
+
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* name)
+        : name(name), start(profiler.enabled.load(std::memory_order_relaxed) ? profilerClock() : -1) {}
+    ~ProfileScope() {
+        if (start >= 0) profiler.addEvent(name, start, profilerClock());
+    }
+
+private:
+    const char* name;
+    double start;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifdef ECOQUEST_NO_PROFILE
+#define PROFILE_SCOPE(name)
+#else
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#endif
+
+#endif
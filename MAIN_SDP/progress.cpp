@@ -0,0 +1,24 @@
+#include "progress.h"
+
+static int popcount(uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(word);
+#else
+    int count = 0;
+    for (; word; word &= word - 1) count++;
+    return count;
+#endif
+}
+
+int Progress::countVisited(int first, int end) const {
+    if (first >= end) return 0;
+    int firstWord = first >> 6, lastWord = (end - 1) >> 6;
+    uint64_t firstMask = ~(uint64_t)0 << (first & 63);
+    uint64_t lastMask = ~(uint64_t)0 >> (63 - ((end - 1) & 63));
+
+    if (firstWord == lastWord) return popcount(words[firstWord] & firstMask & lastMask);
+
+    int count = popcount(words[firstWord] & firstMask);
+    for (int i = firstWord + 1; i < lastWord; i++) count += popcount(words[i]);
+    return count + popcount(words[lastWord] & lastMask);
+}
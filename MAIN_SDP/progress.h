@@ -0,0 +1,28 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <vector>
+#include <cstdint>
+
+// Which animals have been answered correctly, one bit per animal in content
+// pack order. A biome's animals are a contiguous range, so counting its
+// progress is a popcount over a few words.
+class Progress {
+public:
+    void reset(int animalCount) { words.assign((animalCount + 63) / 64, 0); }
+
+    bool visited(int animal) const {
+        return (words[animal >> 6] >> (animal & 63)) & 1;
+    }
+    void markVisited(int animal) {
+        words[animal >> 6] |= (uint64_t)1 << (animal & 63);
+    }
+
+    // Visited animals in [first, end)
+    int countVisited(int first, int end) const;
+
+private:
+    std::vector<uint64_t> words;
+};
+
+#endif
@@ -0,0 +1,101 @@
+#include "replay.h"
+#include <cstdio>
+#include <cstring>
+
+Benchmark benchmark;
+
+bool loadTouchLog(const char* filename, std::vector<TouchEvent>& events, uint64_t* seed) {
+    FILE* file = fopen(filename, "r");
+    if (!file) {
+        printf("Replay: can't open %s\n", filename);
+        return false;
+    }
+
+    if (seed) *seed = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        unsigned long long recordedSeed;
+        if (sscanf(line, "seed %llu", &recordedSeed) == 1) {
+            if (seed) *seed = recordedSeed;
+            continue;
+        }
+        TouchEvent event = {TOUCH_PRESS, -1, -1, 0};
+        char action[32];
+        if (line[0] == '#' || sscanf(line, "%lf %31s %f %f", &event.time, action, &event.x, &event.y) < 2) {
+            continue;
+        }
+        if (strcmp(action, "press") == 0) {
+            event.type = TOUCH_PRESS;
+        } else if (strcmp(action, "drag") == 0) {
+            event.type = TOUCH_DRAG;
+        } else if (strcmp(action, "release") == 0) {
+            event.type = TOUCH_RELEASE;
+        } else {
+            // Anything else (like the headless "quit") isn't a touch
+            continue;
+        }
+        events.push_back(event);
+    }
+    fclose(file);
+    return true;
+}
+
+void writeTouchEvent(FILE* file, const TouchEvent& event) {
+    static const char* names[] = {"press", "release", "drag"};
+    fprintf(file, "%.4f %s %.0f %.0f\n", event.time, names[event.type], event.x, event.y);
+    fflush(file);
+}
+
+bool waitGameEvent(TouchEvent& event, double timeout) {
+    double untilTimer = scheduler.timeUntilNext();
+    if (!scheduler.virtualClock()) {
+        if (untilTimer >= 0 && untilTimer < timeout) timeout = untilTimer;
+        return input.waitEvent(event, timeout);
+    }
+
+    // A zero timeout only takes what is already due, anything else
+    // skips ahead to the next touch or timer
+    double now = scheduler.now();
+    double due = scheduler.nextDue();
+    double next;
+    bool haveTouch = input.nextReplayTime(next);
+    if (haveTouch && (due < 0 || next <= due) && (timeout > 0 || next <= now)) {
+        scheduler.advanceTo(next);
+        return input.waitEvent(event, 0);
+    }
+    if (due >= 0 && (timeout > 0 || due <= now)) {
+        scheduler.advanceTo(due);
+    }
+    return false;
+}
+
+void Benchmark::start() {
+    enabled = true;
+    startTime = inputClock();
+}
+
+void Benchmark::frame(const char* state, double seconds) {
+    if (!enabled) return;
+    StateTiming& timing = states[state];
+    timing.frames++;
+    timing.total += seconds;
+    if (seconds > timing.max) timing.max = seconds;
+    frameCount++;
+}
+
+void Benchmark::printReport() const {
+    double wall = inputClock() - startTime;
+    printf("\nReplay finished: %d frames in %.3f s wall time (%.1f frames/s)\n",
+           frameCount, wall, wall > 0 ? frameCount / wall : 0.0);
+    if (scheduler.virtualClock()) {
+        printf("Replayed %.1f s of game time\n", scheduler.now());
+    }
+
+    printf("%-16s %8s %10s %10s\n", "State", "Frames", "Avg ms", "Max ms");
+    for (const auto& entry : states) {
+        const StateTiming& timing = entry.second;
+        printf("%-16s %8d %10.3f %10.3f\n", entry.first.c_str(), timing.frames,
+               timing.total / timing.frames * 1000.0, timing.max * 1000.0);
+    }
+    fflush(stdout);
+}
@@ -0,0 +1,60 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "input.h"
+#include "scheduler.h"
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <map>
+
+// Touch recording / replay and the end-to-end benchmark built on it.
+//
+//   ECOQUEST_RECORD=<file>   append every touch event of this session to file
+//   ECOQUEST_REPLAY=<file>   play a recorded session back instead of reading
+//                            the touch screen, then exit with a report
+//   ECOQUEST_BENCH=1         with ECOQUEST_REPLAY, replay as fast as possible
+//                            on a virtual clock that skips all the waiting
+//
+// Log format is one event per line, the same layout as the headless touch scripts:
+//   <seconds> press|drag|release <x> <y>
+// Recordings start with the session's answer order seed:
+//   seed <number>
+// Logs without one were recorded before answers were shuffled and replay with seed 0.
+
+bool loadTouchLog(const char* filename, std::vector<TouchEvent>& events, uint64_t* seed = nullptr);
+void writeTouchEvent(FILE* file, const TouchEvent& event);
+
+// Wait for the next touch event, but never past the next scheduler timer.
+// Fast replays don't wait at all: the scheduler's virtual clock jumps to
+// whichever comes first, the next recorded touch or the next timer, so
+// timers fire at the same point between touches as they did when recording.
+bool waitGameEvent(TouchEvent& event, double timeout);
+
+struct StateTiming {
+    int frames = 0;
+    double total = 0;
+    double max = 0;
+};
+
+// Frame timings for a replayed session
+class Benchmark {
+public:
+    Benchmark() : enabled(false), startTime(0), frameCount(0) {}
+
+    void start();
+    void frame(const char* state, double seconds);
+    void printReport() const;
+
+    bool enabled;
+
+private:
+    double startTime;
+    int frameCount;
+    std::map<std::string, StateTiming> states;
+};
+
+extern Benchmark benchmark;
+
+#endif
@@ -0,0 +1,106 @@
+#include "review.h"
+#include <algorithm>
+
+void ReviewQueue::reset(int itemCount) {
+    items.assign(itemCount, ReviewItem{0, 0, REVIEW_START_EASE, 0, 0, 0, 0});
+    // All due at 0 and tied, so content order is already a valid heap
+    heap.resize(itemCount);
+    position.resize(itemCount);
+    for (int i = 0; i < itemCount; i++) {
+        heap[i] = i;
+        position[i] = i;
+    }
+}
+
+bool ReviewQueue::before(int a, int b) const {
+    if (items[a].due != items[b].due) return items[a].due < items[b].due;
+    return a < b;
+}
+
+void ReviewQueue::place(int slot, int index) {
+    heap[slot] = index;
+    position[index] = slot;
+}
+
+void ReviewQueue::siftUp(int slot) {
+    int index = heap[slot];
+    while (slot > 0) {
+        int parent = (slot - 1) / 2;
+        if (!before(index, heap[parent])) break;
+        place(slot, heap[parent]);
+        slot = parent;
+    }
+    place(slot, index);
+}
+
+void ReviewQueue::siftDown(int slot) {
+    int index = heap[slot];
+    int count = (int)heap.size();
+    for (;;) {
+        int child = slot * 2 + 1;
+        if (child >= count) break;
+        if (child + 1 < count && before(heap[child + 1], heap[child])) child++;
+        if (!before(heap[child], index)) break;
+        place(slot, heap[child]);
+        slot = child;
+    }
+    place(slot, index);
+}
+
+void ReviewQueue::record(int index, bool correct, double responseSeconds, double now) {
+    if (index < 0 || index >= (int)items.size()) return;
+    ReviewItem& item = items[index];
+    item.reviews++;
+
+    if (correct) {
+        // SM-2 quality: 5 for a quick answer, 3 for a slow one, 4 in between
+        int quality = responseSeconds < REVIEW_FAST_SECONDS ? 5 :
+                      responseSeconds > REVIEW_SLOW_SECONDS ? 3 : 4;
+        int miss = 5 - quality;
+        item.ease = std::max(REVIEW_MIN_EASE, item.ease + 0.1f - miss * (0.08f + miss * 0.02f));
+        item.streak++;
+        if (item.streak == 1) item.interval = REVIEW_FIRST_INTERVAL;
+        else if (item.streak == 2) item.interval = REVIEW_SECOND_INTERVAL;
+        else item.interval *= item.ease;
+    } else {
+        item.ease = std::max(REVIEW_MIN_EASE, item.ease - 0.2f);
+        item.streak = 0;
+        item.lapses++;
+        item.interval = REVIEW_RELEARN_INTERVAL;
+    }
+
+    // A relearned item can come due sooner than it was, so sift whichever
+    // way it needs
+    double old = item.due;
+    item.due = now + item.interval;
+    if (item.due < old) siftUp(position[index]);
+    else siftDown(position[index]);
+}
+
+void ReviewQueue::restore(int index, const ReviewItem& item) {
+    if (index < 0 || index >= (int)items.size()) return;
+    items[index] = item;
+    siftUp(position[index]);
+    siftDown(position[index]);
+}
+
+// splitmix64, plenty for picking button orders
+static uint64_t mix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+void ReviewQueue::shuffle(int index, int count, uint8_t* order) const {
+    for (int i = 0; i < count; i++) order[i] = (uint8_t)i;
+    if (answerSeed == 0 || index < 0 || index >= (int)items.size()) return;
+
+    // Fisher-Yates on a stream keyed by the seed, the item and its review count
+    uint64_t state = mix(answerSeed ^ mix((uint64_t)index << 16 | items[index].reviews));
+    for (int i = count - 1; i > 0; i--) {
+        state = mix(state);
+        int j = (int)(state % (uint64_t)(i + 1));
+        std::swap(order[i], order[j]);
+    }
+}
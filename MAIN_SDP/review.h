@@ -0,0 +1,91 @@
+#ifndef REVIEW_H
+#define REVIEW_H
+
+#include <cstdint>
+#include <vector>
+
+// Spaced repetition over the question bank, one item per animal in content
+// pack order. Every item remembers how well the player knows it and when it
+// should come back: a right answer pushes it further out (further still if
+// it was quick), a wrong one brings it back soon. This is SM-2 with the
+// answer time standing in for the player grading themselves.
+//
+// Items are kept in a min-heap on due time that also knows where each item
+// sits in it, so next() is O(1) and recording an answer is O(log n) however
+// big the bank gets. Items never asked yet are due at 0 and come up in
+// content order.
+//
+// The queue also picks the order answer buttons are shown in. It's a hash of
+// the session seed, the item and how often it has been asked, so the same
+// seed always gives the same orders (replays depend on this) and an item
+// asked again gets a fresh order. Seed 0 keeps the order the answers were
+// written in, which is what touch logs recorded before shuffling expect.
+
+// Seconds until a newly learned item comes back, then the one after that.
+// From there on each interval is the last one times the item's ease.
+#define REVIEW_FIRST_INTERVAL 60.0
+#define REVIEW_SECOND_INTERVAL 300.0
+// How soon an item answered wrong comes back
+#define REVIEW_RELEARN_INTERVAL 20.0
+
+// Ease every item starts at, and the least it can drop to
+#define REVIEW_START_EASE 2.5f
+#define REVIEW_MIN_EASE 1.3f
+
+// Right answers quicker than this count as easy, slower than the other as hard
+#define REVIEW_FAST_SECONDS 4.0
+#define REVIEW_SLOW_SECONDS 12.0
+
+// Right answers in a row before an item counts as mastered
+#define REVIEW_MASTERED_STREAK 3
+
+struct ReviewItem {
+    double due;      // scheduler time it should be asked again
+    float interval;  // seconds between the last two reviews
+    float ease;
+    uint16_t reviews;
+    uint16_t lapses;  // times answered wrong
+    uint16_t streak;  // right answers in a row
+    uint16_t pad;
+};
+
+class ReviewQueue {
+public:
+    ReviewQueue() : answerSeed(0) {}
+
+    // Forget everything and start over with itemCount new items
+    void reset(int itemCount);
+    void setSeed(uint64_t seed) { answerSeed = seed; }
+    uint64_t seed() const { return answerSeed; }
+
+    int size() const { return (int)items.size(); }
+    const ReviewItem& item(int index) const { return items[index]; }
+    bool mastered(int index) const { return items[index].streak >= REVIEW_MASTERED_STREAK; }
+
+    // The item most overdue, or due soonest if none are, -1 if the bank is empty
+    int next() const { return heap.empty() ? -1 : heap[0]; }
+    // Whether anything is due at or before now
+    bool anyDue(double now) const { return !heap.empty() && items[heap[0]].due <= now; }
+
+    // Update an item after it was answered and reschedule it
+    void record(int index, bool correct, double responseSeconds, double now);
+    // Put back an item from a saved game, due times and all
+    void restore(int index, const ReviewItem& item);
+
+    // Fill order[0..count) with the answer shown in each slot for the next
+    // time index is asked
+    void shuffle(int index, int count, uint8_t* order) const;
+
+private:
+    bool before(int a, int b) const;
+    void place(int slot, int index);
+    void siftUp(int slot);
+    void siftDown(int slot);
+
+    std::vector<ReviewItem> items;
+    std::vector<int> heap;      // item indices
+    std::vector<int> position;  // where each item is in heap
+    uint64_t answerSeed;
+};
+
+#endif
@@ -0,0 +1,249 @@
+#include "savestore.h"
+#include "content.h"
+#include "input.h"
+#include "session.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+SaveStore saveStore;
+
+static uint32_t checksum(const uint8_t* data, size_t size) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) hash = (hash ^ data[i]) * 16777619u;
+    return hash;
+}
+
+static size_t saveBytes(int animalCount) {
+    return sizeof(SaveHeader) + animalCount * sizeof(SaveAnimal) +
+           (animalCount + 63) / 64 * sizeof(uint64_t);
+}
+
+static void closeSaveStore() {
+    saveStore.close();
+}
+
+SaveStore::SaveStore()
+    : havePending(false), stopping(false), saves(0), superseded(0), failures(0),
+      writeMax(0), restoreTime(0), restoredAnimals(-1) {}
+
+SaveStore::~SaveStore() {
+    close();
+}
+
+bool SaveStore::open(const std::string& savePath, const ContentPack& content) {
+    close();
+    path = savePath;
+    tempPath = savePath + ".tmp";
+    size_t bytes = saveBytes(content.animalCount());
+    building.reserve(bytes);
+    pending.reserve(bytes);
+    writing.reserve(bytes);
+    stopping = false;
+    writer = std::thread(&SaveStore::runWriter, this);
+
+    // The headless game quits with quick_exit, don't lose the last answer
+    static bool hooked = false;
+    if (!hooked) at_quick_exit(closeSaveStore);
+    hooked = true;
+    return true;
+}
+
+void SaveStore::close() {
+    if (!writer.joinable()) return;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_one();
+    writer.join();
+}
+
+void SaveStore::save(const GameSession& session, const ContentPack& content, double now) {
+    if (!writer.joinable()) return;
+    const GameState& state = session.gameState;
+    int animalCount = content.animalCount();
+    building.resize(saveBytes(animalCount));
+
+    SaveHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SAVE_MAGIC;
+    header.version = SAVE_VERSION;
+    header.fileBytes = (uint32_t)building.size();
+    header.seed = session.review.seed();
+    header.savedAt = now;
+    header.animalCount = (uint32_t)animalCount;
+    if (state.totalLives > 0) {
+        header.screen = session.resumeScreen();
+        header.previousScreen = state.previousState;
+        header.coins = state.totalCoins;
+        header.lives = state.totalLives;
+        header.question = header.screen == QUESTION_STATE ? state.currentQuestion : -1;
+    } else {
+        // That was the last life, a restart begins the next game
+        GameState fresh;
+        header.screen = MAIN_MENU;
+        header.previousScreen = fresh.previousState;
+        header.coins = fresh.totalCoins;
+        header.lives = fresh.totalLives;
+        header.question = -1;
+    }
+
+    uint8_t* p = building.data() + sizeof(header);
+    for (int i = 0; i < animalCount; i++) {
+        SaveAnimal animal;
+        animal.id = content.animalId(i);
+        animal.reserved = 0;
+        animal.review = session.review.item(i);
+        memcpy(p, &animal, sizeof(animal));
+        p += sizeof(animal);
+    }
+    for (int word = 0; word < (animalCount + 63) / 64; word++) {
+        uint64_t bits = 0;
+        for (int bit = 0; bit < 64 && word * 64 + bit < animalCount; bit++) {
+            if (session.visited.visited(word * 64 + bit)) bits |= (uint64_t)1 << bit;
+        }
+        memcpy(p, &bits, sizeof(bits));
+        p += sizeof(bits);
+    }
+    header.checksum = checksum(building.data() + sizeof(header), building.size() - sizeof(header));
+    memcpy(building.data(), &header, sizeof(header));
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (havePending) superseded++;
+        pending.swap(building);
+        havePending = true;
+        saves++;
+    }
+    wake.notify_one();
+}
+
+void SaveStore::runWriter() {
+    std::unique_lock<std::mutex> guard(lock);
+    for (;;) {
+        wake.wait(guard, [this] { return havePending || stopping; });
+        if (!havePending) return;
+        writing.swap(pending);
+        havePending = false;
+
+        guard.unlock();
+        double start = inputClock();
+        bool ok = writeFile(writing);
+        double elapsed = inputClock() - start;
+        guard.lock();
+
+        if (!ok) failures++;
+        writeMax = std::max(writeMax, elapsed);
+    }
+}
+
+bool SaveStore::writeFile(const std::vector<uint8_t>& data) {
+    // Written to the side and renamed over, so there's always a whole save
+    FILE* file = fopen(tempPath.c_str(), "wb");
+    if (!file) {
+        printf("SaveStore: can't write %s\n", tempPath.c_str());
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), file) == data.size() && fflush(file) == 0;
+#ifndef _WIN32
+    // Make sure it's on the disk before it replaces the old one, the kiosk
+    // may lose power any moment
+    ok = ok && fsync(fileno(file)) == 0;
+#endif
+    ok = fclose(file) == 0 && ok;
+#ifdef _WIN32
+    // rename won't replace an existing file on Windows
+    if (ok) remove(path.c_str());
+#endif
+    if (!ok || rename(tempPath.c_str(), path.c_str()) != 0) {
+        printf("SaveStore: can't write %s\n", path.c_str());
+        remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool SaveStore::restore(GameSession& session, const ContentPack& content, double now) {
+    double start = inputClock();
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+
+    SaveHeader header;
+    std::vector<uint8_t> data;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+              header.magic == SAVE_MAGIC && header.version == SAVE_VERSION &&
+              header.fileBytes == saveBytes((int)header.animalCount) &&
+              header.animalCount <= 65536;
+    if (ok) {
+        data.resize(header.fileBytes - sizeof(header));
+        ok = fread(data.data(), 1, data.size(), file) == data.size() &&
+             checksum(data.data(), data.size()) == header.checksum;
+    }
+    fclose(file);
+    if (!ok) {
+        printf("SaveStore: ignoring bad save %s\n", path.c_str());
+        return false;
+    }
+
+    // Content IDs to where those animals are now
+    std::vector<std::pair<uint32_t, int>> ids(content.animalCount());
+    for (int i = 0; i < content.animalCount(); i++) ids[i] = {content.animalId(i), i};
+    std::sort(ids.begin(), ids.end());
+
+    const uint8_t* animals = data.data();
+    const uint8_t* visited = animals + header.animalCount * sizeof(SaveAnimal);
+    int question = -1;
+    restoredAnimals = 0;
+    for (uint32_t i = 0; i < header.animalCount; i++) {
+        SaveAnimal animal;
+        memcpy(&animal, animals + i * sizeof(SaveAnimal), sizeof(animal));
+        auto found = std::lower_bound(ids.begin(), ids.end(), std::make_pair(animal.id, 0));
+        if (found == ids.end() || found->first != animal.id) continue;
+        int index = found->second;
+
+        // Due times count from when that game started, this one starts now
+        animal.review.due += now - header.savedAt;
+        session.review.restore(index, animal.review);
+        uint64_t bits;
+        memcpy(&bits, visited + i / 64 * sizeof(bits), sizeof(bits));
+        if ((bits >> (i % 64)) & 1) session.visited.markVisited(index);
+        if ((int)i == header.question) question = index;
+        restoredAnimals++;
+    }
+
+    GameState& state = session.gameState;
+    state = GameState();
+    state.totalCoins = header.coins;
+    state.totalLives = header.lives > 0 && header.lives <= MAX_LIVES ? header.lives : MAX_LIVES;
+    bool screenOk = header.previousScreen >= 0 && header.previousScreen < SCREEN_COUNT &&
+                    header.screen >= 0 && header.screen < SCREEN_COUNT && header.screen != FEEDBACK_STATE;
+    state.previousState = screenOk ? (GameScreen)header.previousScreen : MAIN_MENU;
+    GameScreen screen = screenOk ? (GameScreen)header.screen : MAIN_MENU;
+    if (screen == QUESTION_STATE) {
+        // The animal being asked about may have gone from the content since
+        state.currentQuestion = question;
+        if (question < 0) screen = state.previousState;
+    }
+    session.review.setSeed(header.seed);
+    session.resumeAt(screen);
+
+    restoreTime = inputClock() - start;
+    return true;
+}
+
+void SaveStore::printStats() const {
+    std::lock_guard<std::mutex> guard(lock);
+    if (restoredAnimals >= 0) {
+        printf("SaveStore: restored %d animals in %.3f ms\n", restoredAnimals, restoreTime * 1e3);
+    }
+    if (saves == 0) return;
+    printf("SaveStore: %d saves, %d replaced before writing, %d failed, slowest write %.3f ms\n",
+           saves, superseded, failures, writeMax * 1e3);
+}
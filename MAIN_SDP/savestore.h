@@ -0,0 +1,102 @@
+#ifndef SAVESTORE_H
+#define SAVESTORE_H
+
+#include "review.h"
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class ContentPack;
+class GameSession;
+
+// The game in progress, so a kiosk that gets unplugged picks up where the
+// player left off. After every answer the session is copied into a small
+// binary snapshot and handed to a writer thread, which writes it to the
+// side and renames it over the last one, so the file is always a whole
+// save. At startup the snapshot is read back and applied directly, there
+// is nothing to replay.
+//
+// Animals are saved by content ID (ContentPack::animalId) rather than by
+// index, so a save still lines up after animals are added or moved around
+// in content/animals.txt. Animals that have since been removed are dropped.
+//
+// Layout, in the host's byte order:
+//   SaveHeader
+//   SaveAnimal[animalCount]
+//   uint64_t visited[(animalCount + 63) / 64]   bit i is SaveAnimal i
+
+#define SAVE_MAGIC 0x47535145  // "EQSG"
+#define SAVE_VERSION 1
+
+struct SaveHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t fileBytes;
+    uint32_t checksum;  // FNV-1a of everything after the header
+    uint64_t seed;      // answer order seed
+    double savedAt;     // scheduler time, review due times are relative to it
+    int32_t screen;     // where to pick up
+    int32_t previousScreen;
+    int32_t coins;
+    int32_t lives;
+    int32_t question;  // SaveAnimal being asked, -1 for none
+    uint32_t animalCount;
+};
+
+struct SaveAnimal {
+    uint32_t id;
+    uint32_t reserved;
+    ReviewItem review;
+};
+
+class SaveStore {
+public:
+    SaveStore();
+    ~SaveStore();
+
+    // Save to path from now on. Buffers for a session over content are
+    // allocated here, so saving never touches the heap.
+    bool open(const std::string& path, const ContentPack& content);
+    // Waits for the last save to be written
+    void close();
+
+    // Put the saved game back into session, false if there's none it can use
+    bool restore(GameSession& session, const ContentPack& content, double now);
+
+    // Snapshot session and queue it for writing. If the writer is still busy
+    // with an older one, only the newest waiting snapshot gets written.
+    void save(const GameSession& session, const ContentPack& content, double now);
+
+    void printStats() const;
+
+private:
+    void runWriter();
+    bool writeFile(const std::vector<uint8_t>& data);
+
+    std::string path;
+    std::string tempPath;
+    std::thread writer;
+
+    // Filled on the game thread, swapped through pending to the writer
+    std::vector<uint8_t> building;
+    mutable std::mutex lock;
+    std::condition_variable wake;
+    std::vector<uint8_t> pending;
+    bool havePending;
+    bool stopping;
+    std::vector<uint8_t> writing;
+
+    int saves;
+    int superseded;  // replaced by a newer one before they were written
+    int failures;
+    double writeMax;
+    double restoreTime;
+    int restoredAnimals;
+};
+
+extern SaveStore saveStore;
+
+#endif
@@ -0,0 +1,223 @@
+#include "scene.h"
+#include "imagecache.h"
+#include "profiler.h"
+#include "textlayout.h"
+#include "blit.h"
+#include "world.h"
+#include "ambient.h"
+#include <FEHLCD.h>
+#include <algorithm>
+#include <cstdio>
+
+Scene scene;
+
+// Dirty areas a frame can mark, weather marks a few dozen on its own
+#define SCENE_PENDING_RESERVE 256
+
+Scene::Scene() : hasBackground(false), world(nullptr), ambient(nullptr), frameCount(0), pixelsDrawn(0) {
+    pending.reserve(SCENE_PENDING_RESERVE);
+}
+
+void Scene::clear() {
+    widgets.clear();
+    pending.clear();
+    background = std::string_view();
+    hasBackground = false;
+    world = nullptr;
+    ambient = nullptr;
+    screenArena.reset();
+}
+
+void Scene::setBackground(const char* filename) {
+    background = screenArena.copy(filename ? filename : "");
+    hasBackground = true;
+    markDirty(Rect{0, 0, SCREEN_WIDTH, SCREEN_HEIGHT});
+}
+
+void Scene::setWorld(const WorldView* view) {
+    setBackground(nullptr);
+    world = view;
+}
+
+void Scene::setAmbient(const AmbientLayer* layer) {
+    ambient = layer;
+    markDirty(Rect{0, 0, SCREEN_WIDTH, SCREEN_HEIGHT});
+}
+
+int Scene::addWidget(const Rect& bounds, WidgetDraw draw, WidgetWatch watch, bool canClip) {
+    Widget widget;
+    widget.bounds = bounds;
+    widget.kind = WIDGET_CUSTOM;
+    widget.image = nullptr;
+    widget.color = 0;
+    widget.draw = draw;
+    widget.watch = watch;
+    widget.canClip = canClip;
+    widget.dirty = true;
+    widget.lastValue = watch ? watch() : 0;
+    widgets.push_back(widget);
+    return (int)widgets.size() - 1;
+}
+
+int Scene::addImage(const char* filename, int x, int y, WidgetWatch visible) {
+    const PngImage* image = imageCache.get(filename);
+    Rect bounds = {x, y, image ? image->width : 0, image ? image->height : 0};
+    int id = addWidget(bounds, [image, x, y, visible](DrawList& draw, const Rect& clip) {
+        if (image && (!visible || visible())) {
+            drawImageClipped(draw, *image, x, y, clip.x, clip.y, clip.width, clip.height);
+        }
+    }, visible, true);
+    widgets[id].kind = WIDGET_IMAGE;
+    widgets[id].image = image;
+    return id;
+}
+
+int Scene::addFill(const Rect& bounds, unsigned int color) {
+    int id = addWidget(bounds, [color](DrawList& draw, const Rect& clip) {
+        draw.setFontColor(color);
+        draw.fillRectangle(clip.x, clip.y, clip.width, clip.height);
+    }, nullptr, true);
+    widgets[id].kind = WIDGET_FILL;
+    widgets[id].color = color;
+    return id;
+}
+
+int Scene::addText(std::string_view text, int x, int y, unsigned int color) {
+    Rect bounds = {x, y, measureText((int)text.length()), FONT_HEIGHT};
+    const char* stored = screenArena.copy(text).data();
+    return addWidget(bounds, [stored, x, y, color](DrawList& draw, const Rect&) {
+        draw.setFontColor(color);
+        draw.writeAt(stored, x, y);
+    });
+}
+
+void Scene::markDirty(int widget) {
+    if (widget >= 0 && widget < (int)widgets.size()) {
+        widgets[widget].dirty = true;
+    }
+}
+
+void Scene::markDirty(const Rect& area) {
+    pending.push_back(area);
+}
+
+// regions needs room for every pending area and widget, returns how many it filled
+int Scene::collectDirtyRegions(Rect* regions) {
+    for (auto& widget : widgets) {
+        if (widget.watch) {
+            int value = widget.watch();
+            if (value != widget.lastValue) {
+                widget.lastValue = value;
+                widget.dirty = true;
+            }
+        }
+        if (widget.dirty) {
+            pending.push_back(widget.bounds);
+            widget.dirty = false;
+        }
+    }
+
+    const Rect screen = {0, 0, SCREEN_WIDTH, SCREEN_HEIGHT};
+    int count = 0;
+    for (const auto& area : pending) {
+        Rect clipped = area.intersection(screen);
+        if (!clipped.isEmpty()) regions[count++] = clipped;
+    }
+    pending.clear();
+
+    // Grow regions until they cover every widget that can't draw just part
+    // of itself, and merge any regions that overlap so nothing is drawn twice
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int r = 0; r < count; r++) {
+            Rect& region = regions[r];
+            for (const auto& widget : widgets) {
+                if (!widget.canClip && region.intersects(widget.bounds) &&
+                    !region.contains(widget.bounds)) {
+                    region = region.unite(widget.bounds).intersection(screen);
+                    changed = true;
+                }
+            }
+        }
+        for (int i = 0; i < count; i++) {
+            for (int j = i + 1; j < count; j++) {
+                if (regions[i].intersects(regions[j])) {
+                    regions[i] = regions[i].unite(regions[j]);
+                    std::copy(regions + j + 1, regions + count, regions + j);
+                    count--;
+                    changed = true;
+                    j = i;
+                }
+            }
+        }
+    }
+    return count;
+}
+
+void Scene::drawRegion(const Rect& region) {
+    const PngImage* image = nullptr;
+    if (hasBackground && !background.empty()) {
+        image = imageCache.get(background.data());
+    }
+
+    // Compose the background and every image and fill up to the first
+    // custom widget off screen, then push that as one block. Custom
+    // widgets and whatever is above them draw on top of it as before.
+    // The draw list holds on to the pixels until it sends them
+    Canvas canvas = {drawList.allocatePixels(region.width, region.height),
+                     region.x, region.y, region.width, region.height};
+    if (world) {
+        world->compose(canvas);
+    } else if (image) {
+        canvasCopyImage(canvas, *image, 0, 0);
+    } else {
+        canvasFill(canvas, region.x, region.y, region.width, region.height, BLACK);
+    }
+    if (ambient) ambient->compose(canvas);
+
+    size_t next = 0;
+    for (; next < widgets.size(); next++) {
+        const Widget& widget = widgets[next];
+        if (!widget.bounds.intersects(region)) continue;
+        if (widget.kind == WIDGET_FILL) {
+            canvasFill(canvas, widget.bounds.x, widget.bounds.y, widget.bounds.width,
+                       widget.bounds.height, widget.color);
+        } else if (widget.kind == WIDGET_IMAGE) {
+            if (widget.image && (!widget.watch || widget.watch())) {
+                canvasBlendImage(canvas, *widget.image, widget.bounds.x, widget.bounds.y);
+            }
+        } else {
+            break;
+        }
+    }
+    drawList.pushPixels(canvas.pixels, canvas.width, canvas.x, canvas.y, canvas.width, canvas.height);
+
+    for (; next < widgets.size(); next++) {
+        const Widget& widget = widgets[next];
+        if (widget.bounds.intersects(region)) {
+            widget.draw(drawList, widget.canClip ? widget.bounds.intersection(region) : widget.bounds);
+        }
+    }
+}
+
+void Scene::present() {
+    PROFILE_SCOPE("Scene::present");
+    frameArena.reset();
+    Rect* regions = frameArena.allocate<Rect>(pending.size() + widgets.size());
+    int count = collectDirtyRegions(regions);
+    for (int i = 0; i < count; i++) {
+        drawRegion(regions[i]);
+        pixelsDrawn += (long long)regions[i].width * regions[i].height;
+    }
+    if (count > 0) frameCount++;
+
+    drawList.submit();
+}
+
+void Scene::printStats() const {
+    printf("Scene: %d frames presented, %.1f%% of the screen redrawn per frame on average\n",
+           frameCount,
+           frameCount ? 100.0 * pixelsDrawn / ((double)frameCount * SCREEN_WIDTH * SCREEN_HEIGHT) : 0.0);
+    drawList.printStats();
+}
@@ -0,0 +1,102 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "arena.h"
+#include "drawlist.h"
+#include <string_view>
+#include <vector>
+#include <functional>
+
+// Widgets draw themselves into the scene's draw list given the part of the
+// screen being repainted. Widgets that can't clip (text, buttons) just
+// redraw themselves fully.
+typedef std::function<void(DrawList& draw, const Rect& clip)> WidgetDraw;
+
+// Returns the value a widget is showing, when it changes the widget gets redrawn
+typedef std::function<int()> WidgetWatch;
+
+struct PngImage;
+class WorldView;
+class AmbientLayer;
+
+// Images and fills are composed into an off-screen canvas and sent to the
+// LCD in one go, everything else draws itself straight to the LCD
+#define WIDGET_CUSTOM 0
+#define WIDGET_IMAGE 1
+#define WIDGET_FILL 2
+
+struct Widget {
+    Rect bounds;
+    int kind;
+    const PngImage* image;  // WIDGET_IMAGE
+    unsigned int color;     // WIDGET_FILL
+    WidgetDraw draw;
+    WidgetWatch watch;
+    bool canClip;
+    bool dirty;
+    int lastValue;
+};
+
+// Retained version of the current screen. Handlers build the screen once
+// out of widgets and the scene works out what actually changed, so each
+// frame only the dirty parts get pushed to the LCD.
+class Scene {
+public:
+    Scene();
+
+    // Throw away the current screen, call when switching states
+    void clear();
+    bool isEmpty() const { return widgets.empty() && !hasBackground; }
+
+    // Full screen image drawn under everything, nullptr for plain black
+    void setBackground(const char* filename);
+    // Or the part of a scrolling world the view is on. The view has to
+    // outlive the screen, and whoever scrolls it marks the screen dirty.
+    void setWorld(const WorldView* view);
+    // Weather and idle animations composed over the background and under
+    // every widget, nullptr for none. Same lifetime rule as the world.
+    void setAmbient(const AmbientLayer* layer);
+
+    int addWidget(const Rect& bounds, WidgetDraw draw, WidgetWatch watch = nullptr, bool canClip = false);
+    int addImage(const char* filename, int x, int y, WidgetWatch visible = nullptr);
+    int addFill(const Rect& bounds, unsigned int color);
+    // The scene keeps its own copy of text until the next clear
+    int addText(std::string_view text, int x, int y, unsigned int color);
+
+    void markDirty(int widget);
+    void markDirty(const Rect& area);
+
+    // Redraw everything that changed since the last present, then send it
+    // and anything else drawn into draw() this frame to the LCD
+    void present();
+
+    // Where anything drawn outside of widgets goes, so it's sent with the rest
+    DrawList& draw() { return drawList; }
+
+    void printStats() const;
+
+private:
+    int collectDirtyRegions(Rect* regions);
+    void drawRegion(const Rect& region);
+
+    std::vector<Widget> widgets;
+    std::vector<Rect> pending;
+    std::string_view background;
+    bool hasBackground;
+    const WorldView* world;
+    const AmbientLayer* ambient;
+
+    // Text and the background name live as long as the screen does, the
+    // dirty region list only for one present
+    Arena screenArena;
+    Arena frameArena;
+
+    DrawList drawList;
+
+    int frameCount;
+    long long pixelsDrawn;
+};
+
+extern Scene scene;
+
+#endif
@@ -0,0 +1,69 @@
+#include "scheduler.h"
+#include "input.h"
+#include <algorithm>
+
+Scheduler scheduler;
+
+// Earliest due time on top of the heap, ties in the order they were added
+bool Scheduler::later(const Timer& a, const Timer& b) {
+    return a.due > b.due || (a.due == b.due && a.id > b.id);
+}
+
+Scheduler::Scheduler() : nextId(1), isVirtual(false), virtualNow(0) {
+    // Room for more timers than the game ever has going, so adding one
+    // during a frame doesn't allocate
+    timers.reserve(16);
+}
+
+double Scheduler::now() const {
+    return isVirtual ? virtualNow : inputClock();
+}
+
+void Scheduler::setVirtualClock(bool enabled) {
+    isVirtual = enabled;
+    virtualNow = 0;
+}
+
+void Scheduler::advanceTo(double time) {
+    if (isVirtual && time > virtualNow) virtualNow = time;
+}
+
+int Scheduler::after(double delay, TimerCallback callback) {
+    Timer timer = {now() + delay, nextId++, callback};
+    timers.push_back(timer);
+    std::push_heap(timers.begin(), timers.end(), later);
+    return timer.id;
+}
+
+void Scheduler::cancel(int id) {
+    auto it = std::find_if(timers.begin(), timers.end(), [id](const Timer& timer) {
+        return timer.id == id;
+    });
+    if (it == timers.end()) return;
+    timers.erase(it);
+    std::make_heap(timers.begin(), timers.end(), later);
+}
+
+double Scheduler::nextDue() const {
+    return timers.empty() ? -1 : timers.front().due;
+}
+
+double Scheduler::timeUntilNext() const {
+    if (timers.empty()) return -1;
+    double wait = timers.front().due - now();
+    return wait > 0 ? wait : 0;
+}
+
+int Scheduler::runDue() {
+    int ran = 0;
+    double time = now();
+    while (!timers.empty() && timers.front().due <= time) {
+        std::pop_heap(timers.begin(), timers.end(), later);
+        Timer timer = std::move(timers.back());
+        timers.pop_back();
+        // The callback may add or cancel timers, so it runs after the pop
+        timer.callback();
+        ran++;
+    }
+    return ran;
+}
@@ -0,0 +1,57 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <functional>
+#include <vector>
+
+typedef std::function<void()> TimerCallback;
+
+// Runs callbacks once their time comes, so the game can wait on something
+// (a feedback message, the game over screen) without blocking the loop.
+// The main loop asks how long until the next timer, waits for input at
+// most that long, then calls runDue.
+class Scheduler {
+public:
+    Scheduler();
+
+    // Seconds, on inputClock() unless the clock is virtual
+    double now() const;
+
+    // A virtual clock only moves when advanceTo is called. Fast replays use
+    // it to jump straight over the gaps between touches and timers.
+    void setVirtualClock(bool enabled);
+    bool virtualClock() const { return isVirtual; }
+    void advanceTo(double time);
+
+    // Call callback once, delay seconds from now. Returns an id for cancel.
+    int after(double delay, TimerCallback callback);
+    void cancel(int id);
+
+    bool pending() const { return !timers.empty(); }
+    // When the next timer is due, or -1 if there are none
+    double nextDue() const;
+    // Seconds until the next timer is due (0 if overdue), or -1 if there are none
+    double timeUntilNext() const;
+
+    // Run every timer that is due. Returns how many ran.
+    int runDue();
+
+private:
+    struct Timer {
+        double due;
+        int id;
+        TimerCallback callback;
+    };
+
+    static bool later(const Timer& a, const Timer& b);
+
+    // Min-heap on due time
+    std::vector<Timer> timers;
+    int nextId;
+    bool isVirtual;
+    double virtualNow;
+};
+
+extern Scheduler scheduler;
+
+#endif
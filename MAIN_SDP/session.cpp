@@ -0,0 +1,658 @@
+#include <FEHLCD.h>
+#include "session.h"
+#include "imagecache.h"
+#include "input.h"
+#include "profiler.h"
+#include "textlayout.h"
+#include "savestore.h"
+#include "world.h"
+#include <algorithm>
+#include <cstdio>
+
+// Menu Button Constants
+#define MENU_BUTTON_WIDTH 150
+#define MENU_BUTTON_HEIGHT 30
+#define MENU_BUTTON_SPACING 10
+
+// Prefetch priorities, screens one tap away go first
+#define PREFETCH_NEXT 1
+#define PREFETCH_LATER 0
+
+// How long the timed message screens stay up unless tapped
+#define FEEDBACK_SECONDS 2.0
+#define GAME_OVER_SECONDS 3.0
+
+// Hit map ids. Buttons, tiles, animals and answers on a screen are numbered
+// from HIT_FIRST_ITEM in the order they were added.
+#define HIT_BACK_BUTTON 1
+#define HIT_FIRST_ITEM 2
+
+struct MenuButton {
+    int x;
+    int y;
+    int width;
+    int height;
+    const char* text;
+    GameScreen target;
+};
+
+#define MENU_BUTTON_X ((SCREEN_WIDTH - MENU_BUTTON_WIDTH) / 2)
+#define MENU_BUTTON_Y(row) (80 + (row) * (MENU_BUTTON_HEIGHT + MENU_BUTTON_SPACING))
+
+// Top to bottom, hit map ids follow this order
+static const MenuButton mainMenuButtons[] = {
+    {MENU_BUTTON_X, MENU_BUTTON_Y(0), MENU_BUTTON_WIDTH, MENU_BUTTON_HEIGHT, "Play Game", BIOME_SELECT},
+    {MENU_BUTTON_X, MENU_BUTTON_Y(1), MENU_BUTTON_WIDTH, MENU_BUTTON_HEIGHT, "Stats", STATS},
+    {MENU_BUTTON_X, MENU_BUTTON_Y(2), MENU_BUTTON_WIDTH, MENU_BUTTON_HEIGHT, "Instructions", INSTRUCTIONS},
+    {MENU_BUTTON_X, MENU_BUTTON_Y(3), MENU_BUTTON_WIDTH, MENU_BUTTON_HEIGHT, "Credits", CREDITS},
+};
+#define MAIN_MENU_BUTTONS (int)(sizeof(mainMenuButtons) / sizeof(mainMenuButtons[0]))
+
+static void drawMenuButton(DrawList& draw, const MenuButton& button) {
+    // Draw button background
+    draw.setFontColor(WHITE);
+    draw.drawRectangle(button.x, button.y, button.width, button.height);
+    draw.setFontColor(BLACK);
+    draw.fillRectangle(button.x + 2, button.y + 2, button.width - 4, button.height - 4);
+    
+    // Draw button text
+    draw.setFontColor(WHITE);
+    int textX = button.x + (button.width - measureText(button.text)) / 2;
+    int textY = button.y + (button.height - 12) / 2;
+    draw.writeAt(button.text, textX, textY);
+}
+
+
+static void drawBackButton(DrawList& draw) {
+    // Draw back button
+    draw.setFontColor(WHITE);
+    draw.drawRectangle(10, 10, 60, 30);
+    // Inner border
+    draw.drawRectangle(12, 12, 56, 26);
+    draw.setFontColor(BLACK);
+    draw.fillRectangle(13, 13, 54, 24);
+    draw.setFontColor(WHITE);
+    draw.writeAt("Back", 16, 15);
+}
+
+void GameSession::addBackButton() {
+    scene.addWidget({10, 10, 61, 31}, [](DrawList& draw, const Rect&) { drawBackButton(draw); });
+    addBackButtonHit();
+}
+
+void GameSession::addBackButtonHit() {
+    hitMap.addRect(HIT_BACK_BUTTON, 10, 10, 60, 30);
+}
+
+// Main menu
+
+void GameSession::enterMainMenu() {
+    PROFILE_SCOPE("enterMainMenu");
+    scene.setBackground("home.png");
+    
+    // Decode what the menu leads to while the player is reading it
+    imageCache.prefetch("biomes1.png", PREFETCH_NEXT);
+    imageCache.prefetch("coin.png", PREFETCH_NEXT);
+    imageCache.prefetch("heart.png", PREFETCH_NEXT);
+    imageCache.prefetch("stats.png", PREFETCH_LATER);
+    imageCache.prefetch("instruct.png", PREFETCH_LATER);
+    imageCache.prefetch("credits.png", PREFETCH_LATER);
+    
+    // Display menu title and subtitle
+    scene.addText("EcoQuest", 105, 20, BLACK);
+    scene.addText("Go on an Adventure", 50, 50, BLACK);
+
+    for (int i = 0; i < MAIN_MENU_BUTTONS; i++) {
+        const MenuButton* button = &mainMenuButtons[i];
+        scene.addWidget({button->x, button->y, button->width + 1, button->height + 1},
+                        [button](DrawList& draw, const Rect&) { drawMenuButton(draw, *button); });
+        hitMap.addRect(HIT_FIRST_ITEM + i, button->x, button->y, button->width, button->height);
+    }
+}
+
+void GameSession::updateMainMenu(float touchX, float touchY) {
+    int hit = hitMap.lookup(touchX, touchY);
+    if (hit >= HIT_FIRST_ITEM && hit - HIT_FIRST_ITEM < MAIN_MENU_BUTTONS) {
+        gameState.previousState = current;
+        goTo(mainMenuButtons[hit - HIT_FIRST_ITEM].target);
+    }
+}
+
+// Stats, instructions and credits are all static, only the back button does anything
+
+void GameSession::enterStats() {
+    PROFILE_SCOPE("enterStats");
+    scene.setBackground("stats.png");
+
+    // Everything here is kept up to date by the stats store as games are played
+    const StatsSummary& summary = stats.summary();
+    char line[64];
+    snprintf(line, sizeof(line), "Games: %u", summary.gamesPlayed);
+    scene.addText(line, 50, 65, WHITE);
+    snprintf(line, sizeof(line), "Coins: %llu", (unsigned long long)summary.totalScore);
+    scene.addText(line, 70, 90, WHITE);
+    snprintf(line, sizeof(line), "Best Play: %u", summary.bestScore);
+    scene.addText(line, 70, 120, WHITE);
+    snprintf(line, sizeof(line), "Correct: %d%%", stats.accuracy());
+    scene.addText(line, 70, 145, WHITE);
+    snprintf(line, sizeof(line), "Avg Time: %.1fs", stats.averageResponse());
+    scene.addText(line, 70, 170, WHITE);
+    int hardest = stats.hardestAnimal();
+    if (hardest >= 0 && hardest < content.animalCount()) {
+        snprintf(line, sizeof(line), "Hardest: %s", content.string(content.animal(hardest).name));
+        scene.addText(line, 70, 195, WHITE);
+    }
+
+    addBackButton();
+}
+
+void GameSession::enterInstructions() {
+    PROFILE_SCOPE("enterInstructions");
+    scene.setBackground("instruct.png");
+    
+    scene.addText("How To Play:", 10, 45, BLACK);
+    scene.addText("1. Choose a biome ", 20, 70, BLACK);
+    scene.addText("2. Click on animals", 20, 100, BLACK);
+    scene.addText("3. Answer questions  ", 20, 130, BLACK);
+    scene.addText("4. Watch your lives", 20, 160, BLACK);
+    scene.addText("5. Visit all animals ", 20, 190, BLACK);
+    
+    addBackButton();
+}
+
+void GameSession::enterCredits() {
+    PROFILE_SCOPE("enterCredits");
+    scene.setBackground("credits.png");
+
+    scene.addText("Development Team:", 20, 55, BLACK);
+    scene.addText("Samuel Wales-McGrath ", 20, 80, BLACK);
+    scene.addText("Vamshi Somapalli ", 20, 110, BLACK);
+    scene.addText("Special Thanks To:", 20, 150, BLACK);
+    scene.addText("FEH, Ethan Joll, and TAs", 20, 175, BLACK);
+    scene.addText("As well as ClassMates", 20, 200, BLACK);
+    
+    addBackButton();
+}
+
+void GameSession::updateBackToMenu(float touchX, float touchY) {
+    if (hitMap.lookup(touchX, touchY) == HIT_BACK_BUTTON) {
+        goTo(MAIN_MENU);
+    }
+}
+
+// One quarter of the screen per biome
+static std::vector<ClickableRegion> getBiomeRegions() {
+    return {
+        {0, 0, 160, 120, DESERT_BIOME},
+        {160, 0, 160, 120, TUNDRA_BIOME},
+        {0, 120, 160, 120, SAFARI_BIOME},
+        {160, 120, 160, 120, FOREST_BIOME}
+    };
+}
+
+// Answer buttons go in the hit map as they are drawn
+void GameSession::drawQuestion(const PackAnimal& animal) {
+    PROFILE_SCOPE("drawQuestion");
+    DrawList& draw = scene.draw();
+    
+    // Draw background overlay, covers the whole screen so no need to clear it first
+    draw.setFontColor(BLACK);
+    draw.fillRectangle(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+    
+    // Draw question box
+    draw.setFontColor(WHITE);
+    draw.drawRectangle(QUESTION_BOX_X - 2, QUESTION_BOX_Y - 2, 
+                       QUESTION_BOX_WIDTH + 4, QUESTION_BOX_HEIGHT + 4);
+    draw.setFontColor(BLACK);
+    draw.fillRectangle(QUESTION_BOX_X, QUESTION_BOX_Y, 
+                       QUESTION_BOX_WIDTH, QUESTION_BOX_HEIGHT);
+    
+    draw.setFontColor(WHITE);
+
+    // Wrapped once per question, every redraw after that reuses the lines
+    const TextLayout& question = textCache.layout(content.string(animal.question),
+                                                  QUESTION_TEXT_WIDTH, QUESTION_LINE_HEIGHT);
+    drawTextLayout(draw, question, QUESTION_BOX_X + 10, QUESTION_BOX_Y + 15);
+    
+    // Answer buttons start below the question and grow to fit wrapped answers
+    int buttonY = std::max(QUESTION_BOX_Y + 50, QUESTION_BOX_Y + 15 + question.height);
+    for(int i = 0; i < gameState.answersShown; i++) {
+        const TextLayout& answer = textCache.layout(content.answer(animal, gameState.answerOrder[i]),
+                                                    ANSWER_TEXT_WIDTH, QUESTION_LINE_HEIGHT);
+        int buttonHeight = std::max(ANSWER_BUTTON_HEIGHT, answer.height + 8);
+        
+        draw.setFontColor(WHITE);
+        draw.drawRectangle(QUESTION_BOX_X + 10, buttonY, 
+                           QUESTION_BOX_WIDTH - 20, buttonHeight);
+        
+        draw.setFontColor(BLACK);
+        draw.fillRectangle(QUESTION_BOX_X + 11, buttonY + 1, 
+                           QUESTION_BOX_WIDTH - 22, buttonHeight - 2);
+        
+        draw.setFontColor(WHITE);
+        drawTextLayout(draw, answer, QUESTION_BOX_X + 15, buttonY + 3);
+
+        hitMap.addRect(HIT_FIRST_ITEM + i, QUESTION_BOX_X + 10, buttonY,
+                       QUESTION_BOX_WIDTH - 30, buttonHeight);
+        buttonY += buttonHeight;
+    }
+}
+
+void GameSession::addStatusBar() {
+    PROFILE_SCOPE("addStatusBar");
+    // Create status bar background
+    scene.addFill({0, SCREEN_HEIGHT - 30, SCREEN_WIDTH, 30}, BLACK);
+    
+    // Coin icon and count, the count only gets redrawn when it changes
+    scene.addImage("coin.png", 14, SCREEN_HEIGHT - 30);
+    scene.addWidget({45, SCREEN_HEIGHT - 22, 60, 17}, [this](DrawList& draw, const Rect&) {
+        draw.setFontColor(WHITE);
+        draw.writeAt(gameState.totalCoins, 45, SCREEN_HEIGHT - 22);
+    }, [this]() { return gameState.totalCoins; });
+    
+    // One heart per life, each one disappears on its own
+    for(int i = 0; i < MAX_LIVES; i++) {
+        scene.addImage("heart.png", 185 + (i * 35), SCREEN_HEIGHT - 30,
+                       [this, i]() { return gameState.totalLives > i; });
+    }
+}
+
+// Biome select
+
+void GameSession::enterBiomeSelect() {
+    PROFILE_SCOPE("enterBiomeSelect");
+    scene.setBackground("biomes1.png");
+    
+    // Every biome is one tap away, get them decoded before the tap.
+    // Worlds only ever decode the tiles on screen, there's nothing to get ready.
+    for (int i = 0; i < content.biomeCount(); i++) {
+        const char* image = content.string(content.biome(i).image);
+        if (!isWorldFile(image)) imageCache.prefetch(image, PREFETCH_NEXT);
+    }
+    
+    // Display the title and status bar
+    const char* title = "Pick Your Biome";
+    scene.addText(title, (SCREEN_WIDTH - measureText(title)) / 2, 111, WHITE); // Title
+    addStatusBar(); // Coins and lives
+    addBackButton(); // Draw back button in a consistent location, on top of the tiles
+
+    for (size_t i = 0; i < biomeRegions.size(); i++) {
+        const auto& region = biomeRegions[i];
+        hitMap.addRect(HIT_FIRST_ITEM + i, region.x, region.y, region.width, region.height);
+    }
+}
+
+void GameSession::updateBiomeSelect(float touchX, float touchY) {
+    int hit = hitMap.lookup(touchX, touchY);
+    if (hit == HIT_BACK_BUTTON) {
+        goTo(MAIN_MENU);
+    } else if (hit >= HIT_FIRST_ITEM) {
+        gameState.previousState = current;
+        goTo(biomeRegions[hit - HIT_FIRST_ITEM].state);
+    }
+}
+
+// Biomes, one table entry per biome screen but they all share these
+
+void GameSession::enterBiome() {
+    PROFILE_SCOPE("enterBiome");
+    const PackBiome* biome = content.findBiome(current);
+    if (!biome) {
+        // Nothing in the content pack for this biome
+        goTo(BIOME_SELECT);
+        return;
+    }
+
+    const char* image = content.string(biome->image);
+    int first = content.firstAnimal(*biome);
+    int end = content.endAnimal(*biome);
+    if (isWorldFile(image) && world.open(image)) {
+        scene.setWorld(&world);
+        world.clearObjects();
+        for (int i = first; i < end; i++) {
+            const PackRect& rect = content.animalRect(i);
+            world.addObject(HIT_FIRST_ITEM + (i - first), {rect.x, rect.y, rect.width, rect.height});
+        }
+    } else {
+        world.close();
+        scene.setBackground(image);
+    }
+    addBackButton();
+    addStatusBar();
+    addAnimalHits();
+    startAmbient(*biome, image);
+}
+
+void GameSession::exitBiome() {
+    if (ambientTimer) {
+        scheduler.cancel(ambientTimer);
+        ambientTimer = 0;
+    }
+    ambient.clear();
+}
+
+static Weather biomeWeather(GameScreen screen) {
+    switch (screen) {
+        case DESERT_BIOME: return WEATHER_SAND;
+        case TUNDRA_BIOME: return WEATHER_SNOW;
+        case FOREST_BIOME: return WEATHER_LEAVES;
+        default: return WEATHER_NONE;
+    }
+}
+
+void GameSession::startAmbient(const PackBiome& biome, const char* image) {
+    ambient.clear();
+    if (!AmbientLayer::enabled(scheduler.virtualClock())) return;
+    ambient.start(biomeWeather(current), (uint32_t)current);
+
+    // Idle loops are cut out of the background, a world has no one image to cut from
+    const PngImage* background = world.isOpen() ? nullptr : imageCache.get(image);
+    if (background) {
+        for (int i = content.firstAnimal(biome); i < content.endAnimal(biome); i++) {
+            const PackRect& rect = content.animalRect(i);
+            const char* name = content.string(content.animal(i).name);
+            int first = spriteAtlas.find(name);
+            if (first < 0) {
+                first = addIdleFrames(spriteAtlas, *background, {rect.x, rect.y, rect.width, rect.height});
+                if (first < 0) continue;
+                spriteAtlas.name(name, first);
+            }
+            ambient.addSprite(first, IDLE_FRAMES, 4, rect.x, rect.y);
+        }
+    }
+    if (!ambient.isActive()) return;
+    scene.setAmbient(&ambient);
+    ambientLast = scheduler.now();
+    ambientTimer = scheduler.after(1.0 / AMBIENT_FPS, [this]() { tickAmbient(); });
+}
+
+void GameSession::tickAmbient() {
+    ambientTimer = 0;
+    // A replay that's run out shouldn't be kept going by the weather
+    if (input.replayFinished()) return;
+    double now = scheduler.now();
+    // Don't jump ahead after a stall, just carry on
+    ambient.update(std::min(now - ambientLast, 0.1), scene);
+    ambientLast = now;
+    ambientTimer = scheduler.after(1.0 / AMBIENT_FPS, [this]() { tickAmbient(); });
+}
+
+void GameSession::addAnimalHits() {
+    // Animals are painted into the background, so their boxes are all there is
+    if (world.isOpen()) {
+        // Only the ones on screen, however many the world has
+        world.forEachVisible([this](uint16_t id, const Rect& bounds) {
+            hitMap.addRect(id, bounds.x, bounds.y, bounds.width, bounds.height);
+        });
+        return;
+    }
+    const PackBiome* biome = content.findBiome(current);
+    int first = content.firstAnimal(*biome);
+    int end = content.endAnimal(*biome);
+    for (int i = first; i < end; i++) {
+        const PackRect& rect = content.animalRect(i);
+        hitMap.addRect(HIT_FIRST_ITEM + (i - first), rect.x, rect.y, rect.width, rect.height);
+    }
+}
+
+void GameSession::dragBiome(float dx, float dy) {
+    // The world moves with the finger
+    if (!world.scrollBy((int)-dx, (int)-dy)) return;
+    scene.markDirty(Rect{0, 0, SCREEN_WIDTH, SCREEN_HEIGHT});
+    hitMap.clear();
+    addBackButtonHit();
+    addAnimalHits();
+}
+
+void GameSession::updateBiome(float touchX, float touchY) {
+    int hit = hitMap.lookup(touchX, touchY);
+    if (hit == HIT_BACK_BUTTON) {
+        goTo(BIOME_SELECT);
+    } else if (hit >= HIT_FIRST_ITEM) {
+        gameState.currentQuestion = content.firstAnimal(*content.findBiome(current)) + (hit - HIT_FIRST_ITEM);
+        gameState.previousState = current;
+        goTo(QUESTION_STATE);
+    }
+}
+
+// Question
+
+void GameSession::enterQuestion() {
+    if (gameState.currentQuestion < 0) {
+        // Safely handle invalid question state
+        scene.draw().clear(BLACK);
+        goTo(gameState.previousState);
+        return;
+    }
+    const PackAnimal& animal = content.animal(gameState.currentQuestion);
+    gameState.answersShown = std::min<int>(animal.answerCount, CONTENT_MAX_ANSWERS);
+    review.shuffle(gameState.currentQuestion, gameState.answersShown, gameState.answerOrder);
+    drawQuestion(animal);
+    gameState.questionShownAt = scheduler.now();
+}
+
+void GameSession::updateQuestion(float touchX, float touchY) {
+    PROFILE_SCOPE("updateQuestion");
+    const PackAnimal& animal = content.animal(gameState.currentQuestion);
+    
+    int hit = hitMap.lookup(touchX, touchY);
+    int button = hit - HIT_FIRST_ITEM;
+    if (hit < HIT_FIRST_ITEM || button >= gameState.answersShown) return;
+
+    bool correct = gameState.answerOrder[button] == animal.correctAnswer;
+    double responseTime = scheduler.now() - gameState.questionShownAt;
+    stats.recordAnswer(gameState.currentQuestion, correct, responseTime);
+    review.record(gameState.currentQuestion, correct, responseTime, scheduler.now());
+    saveDue = true;
+    if (correct) {
+        if (!visited.visited(gameState.currentQuestion)) {
+            gameState.totalCoins += 10;
+            visited.markVisited(gameState.currentQuestion);
+        }
+        showFeedback({{"Correct!", SCREEN_HEIGHT/2 - 10, GREEN}},
+                     FEEDBACK_SECONDS, gameState.previousState);
+    } else {
+        gameState.totalLives--;
+        stats.recordLifeLost(gameState.currentQuestion);
+        showFeedback({{"Wrong!", SCREEN_HEIGHT/2 - 10, RED}},
+                     FEEDBACK_SECONDS, gameState.previousState);
+    }
+    
+    // The feedback screen returns to the biome page
+    gameState.currentQuestion = -1;
+}
+
+// Feedback and game over
+
+// Put a message screen up for a while, then go to nextScreen. The loop keeps
+// running while it's up, and a tap moves on straight away.
+void GameSession::showFeedback(std::initializer_list<FeedbackLine> lines,
+                               double seconds, GameScreen nextScreen) {
+    gameState.feedbackLines = 0;
+    for (const FeedbackLine& line : lines) {
+        if (gameState.feedbackLines < MAX_FEEDBACK_LINES) gameState.feedback[gameState.feedbackLines++] = line;
+    }
+    gameState.feedbackNext = nextScreen;
+    gameState.feedbackEndsGame = false;
+    goTo(FEEDBACK_STATE);
+    gameState.feedbackTimer = scheduler.after(seconds, [this]() {
+        gameState.feedbackTimer = 0;
+        finishFeedback();
+    });
+}
+
+void GameSession::finishFeedback() {
+    goTo(gameState.feedbackNext);
+}
+
+void GameSession::showGameOver() {
+    snprintf(gameState.finalScore, sizeof(gameState.finalScore), "%d", gameState.totalCoins);
+    showFeedback({
+        {"Game Over!", 100, RED},
+        {"Final Score:", 120, WHITE},
+        {gameState.finalScore, 140, WHITE},
+    }, GAME_OVER_SECONDS, MAIN_MENU);
+    gameState.feedbackEndsGame = true;
+    stats.recordGameEnd(gameState.totalCoins);
+
+    if (printReports) {
+        imageCache.printStats();
+        tileCache.printStats();
+        ambient.printStats();
+        textCache.printStats();
+        input.printStats();
+        scene.printStats();
+        stats.printStats();
+        if (saves) saves->printStats();
+    }
+}
+
+void GameSession::enterFeedback() {
+    scene.setBackground(nullptr);
+    for (int i = 0; i < gameState.feedbackLines; i++) {
+        const FeedbackLine& line = gameState.feedback[i];
+        int x = (SCREEN_WIDTH - measureText(line.text)) / 2;
+        scene.addText(line.text, x, line.y, line.color);
+    }
+}
+
+void GameSession::updateFeedback(float touchX, float touchY) {
+    if (touchX >= 0 && touchY >= 0) {
+        finishFeedback();
+    }
+}
+
+void GameSession::exitFeedback() {
+    // Left early by a tap, the timer has nothing left to do
+    if (gameState.feedbackTimer) {
+        scheduler.cancel(gameState.feedbackTimer);
+        gameState.feedbackTimer = 0;
+    }
+    if (gameState.feedbackEndsGame) {
+        // Back to the main menu with a fresh game
+        gameState = GameState();
+    }
+}
+
+// Screen table
+
+constexpr GameSession::ScreenHandlers GameSession::screens[SCREEN_COUNT] = {
+    {MAIN_MENU, "MAIN_MENU", &GameSession::enterMainMenu, &GameSession::updateMainMenu, nullptr, nullptr},
+    {INSTRUCTIONS, "INSTRUCTIONS", &GameSession::enterInstructions, &GameSession::updateBackToMenu, nullptr, nullptr},
+    {STATS, "STATS", &GameSession::enterStats, &GameSession::updateBackToMenu, nullptr, nullptr},
+    {CREDITS, "CREDITS", &GameSession::enterCredits, &GameSession::updateBackToMenu, nullptr, nullptr},
+    {BIOME_SELECT, "BIOME_SELECT", &GameSession::enterBiomeSelect, &GameSession::updateBiomeSelect, nullptr, nullptr},
+    {DESERT_BIOME, "DESERT_BIOME", &GameSession::enterBiome, &GameSession::updateBiome, &GameSession::exitBiome, &GameSession::dragBiome},
+    {TUNDRA_BIOME, "TUNDRA_BIOME", &GameSession::enterBiome, &GameSession::updateBiome, &GameSession::exitBiome, &GameSession::dragBiome},
+    {FOREST_BIOME, "FOREST_BIOME", &GameSession::enterBiome, &GameSession::updateBiome, &GameSession::exitBiome, &GameSession::dragBiome},
+    {SAFARI_BIOME, "SAFARI_BIOME", &GameSession::enterBiome, &GameSession::updateBiome, &GameSession::exitBiome, &GameSession::dragBiome},
+    {QUESTION_STATE, "QUESTION_STATE", &GameSession::enterQuestion, &GameSession::updateQuestion, nullptr, nullptr},
+    {FEEDBACK_STATE, "FEEDBACK", &GameSession::enterFeedback, &GameSession::updateFeedback,
+     &GameSession::exitFeedback, nullptr},
+};
+
+constexpr bool GameSession::screensInOrder() {
+    for (int i = 0; i < SCREEN_COUNT; i++) {
+        if (screens[i].screen != i) return false;
+    }
+    return true;
+}
+
+const char* stateName(int state) {
+    if (state < 0 || state >= SCREEN_COUNT) return "INVALID";
+    return GameSession::screens[state].name;
+}
+
+GameSession::GameSession(const ContentPack& content, Scene& scene, HitMap& hitMap,
+                         Scheduler& scheduler, StatsStore& stats)
+    : printReports(false), saves(nullptr), content(content), scene(scene), hitMap(hitMap),
+      scheduler(scheduler), stats(stats), biomeRegions(getBiomeRegions()),
+      ambientTimer(0), ambientLast(0), current(MAIN_MENU), pending(SCREEN_COUNT), entered(false), frameEntered(false),
+      saveDue(false), dragX(0), dragY(0) {
+    visited.reset(content.animalCount());
+    review.reset(content.animalCount());
+    // Looking screens up by index only works if nobody shuffled the table
+    static_assert(screensInOrder(), "GameSession::screens has to be in GameScreen order");
+}
+
+void GameSession::goTo(GameScreen screen) {
+    pending = screen;
+}
+
+GameScreen GameSession::resumeScreen() const {
+    GameScreen screen = pending != SCREEN_COUNT ? pending : current;
+    if (screen == FEEDBACK_STATE) {
+        screen = gameState.feedbackEndsGame ? MAIN_MENU : gameState.feedbackNext;
+    }
+    return screen;
+}
+
+void GameSession::resumeAt(GameScreen screen) {
+    current = screen;
+    pending = SCREEN_COUNT;
+    entered = false;
+}
+
+void GameSession::applyTransition() {
+    if (pending == SCREEN_COUNT) return;
+    // A screen that never got drawn has nothing to tidy up
+    if (entered && screens[current].onExit) (this->*screens[current].onExit)();
+    current = pending;
+    pending = SCREEN_COUNT;
+    entered = false;
+}
+
+void GameSession::drag(float dx, float dy) {
+    dragX += dx;
+    dragY += dy;
+}
+
+int GameSession::frame(float touchX, float touchY) {
+    double frameStart = inputClock();
+    // Switches queued since the last frame, by the last frame or by a timer
+    applyTransition();
+    
+    if (gameState.totalLives <= 0 && current != FEEDBACK_STATE) {
+        showGameOver();
+        applyTransition();
+        // Whatever was tapped belonged to the screen being left
+        touchX = -1;
+        touchY = -1;
+    }
+    int frameScreen = current;
+    
+    // Static content goes into a fresh scene once, when the screen comes up
+    const ScreenHandlers& handlers = screens[current];
+    frameEntered = !entered;
+    if (!entered) {
+        scene.clear();
+        hitMap.clear();
+        entered = true;
+        (this->*handlers.onEnter)();
+    }
+    // Skipped if entering already bounced somewhere else
+    if (pending == SCREEN_COUNT && touchX >= 0 && touchY >= 0) {
+        (this->*handlers.onUpdate)(touchX, touchY);
+    }
+    if (pending == SCREEN_COUNT && handlers.onDrag && (dragX != 0 || dragY != 0)) {
+        (this->*handlers.onDrag)(dragX, dragY);
+    }
+    // Drags on screens that don't scroll just go away
+    dragX = 0;
+    dragY = 0;
+
+    // An answer changes everything a save holds
+    if (saveDue) {
+        saveDue = false;
+        if (saves) saves->save(*this, content, scheduler.now());
+    }
+
+    // Push whatever changed on screen this frame
+    scene.present();
+    
+    // Update  display
+    LCD.Update();
+    // Weather gets whatever's left of the frame budget
+    if (ambient.isActive()) ambient.frameTook(inputClock() - frameStart);
+    return frameScreen;
+}
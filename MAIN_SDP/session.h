@@ -0,0 +1,226 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "content.h"
+#include "progress.h"
+#include "review.h"
+#include "scene.h"
+#include "hitmap.h"
+#include "scheduler.h"
+#include "statsstore.h"
+#include "world.h"
+#include "ambient.h"
+#include <initializer_list>
+#include <vector>
+
+class SaveStore;
+
+// Every screen in the game, each one has an entry in GameSession's screen
+// table. content/animals.txt names the screen a biome is shown on by
+// number, so the biome values must not change.
+enum GameScreen {
+    MAIN_MENU = 0,
+    INSTRUCTIONS = 1,
+    STATS = 2,
+    CREDITS = 3,
+    BIOME_SELECT = 4,
+    DESERT_BIOME = 5,
+    TUNDRA_BIOME = 6,
+    FOREST_BIOME = 7,
+    SAFARI_BIOME = 8,
+    QUESTION_STATE = 9,
+    FEEDBACK_STATE = 10,
+    SCREEN_COUNT
+};
+
+// Names for the screens above, used by the profiler
+const char* stateName(int state);
+
+#define MAX_LIVES 3
+
+// Question UI constants, tools/microbench.cpp wraps text into the same boxes
+#define QUESTION_BOX_X 0
+#define QUESTION_BOX_Y 20
+#define QUESTION_BOX_WIDTH 320
+#define QUESTION_BOX_HEIGHT 200
+#define ANSWER_BUTTON_HEIGHT 30
+#define ANSWER_SPACING 35
+#define QUESTION_LINE_HEIGHT 15
+#define QUESTION_TEXT_WIDTH (QUESTION_BOX_WIDTH - 20)
+#define ANSWER_TEXT_WIDTH (QUESTION_BOX_WIDTH - 30)
+
+struct ClickableRegion {
+    int x, y, width, height;
+    GameScreen state;  // where clicking it takes you
+};
+
+// Most lines a feedback screen can show
+#define MAX_FEEDBACK_LINES 4
+
+// One line of centered text on a feedback screen. text has to outlive the
+// screen, so it's a literal or lives in GameState.
+struct FeedbackLine {
+    const char* text;
+    int y;
+    unsigned int color;
+};
+
+class GameState {
+public:
+    GameScreen previousState;
+    int totalCoins;
+    int totalLives;
+    int currentQuestion;  // animal index in the content pack, -1 for none
+    double questionShownAt;  // scheduler time, for how long answering took
+    // Which answer is on each button of the question being shown
+    uint8_t answerOrder[CONTENT_MAX_ANSWERS];
+    int answersShown;
+
+    // What FEEDBACK_STATE shows and where it goes after, see showFeedback
+    FeedbackLine feedback[MAX_FEEDBACK_LINES];
+    int feedbackLines;
+    GameScreen feedbackNext;
+    int feedbackTimer;
+    bool feedbackEndsGame;
+    char finalScore[16];  // shown on the game over screen
+
+    GameState() {
+        previousState = MAIN_MENU;
+        totalCoins = 0;
+        totalLives = MAX_LIVES;
+        currentQuestion = -1;
+        questionShownAt = 0;
+        answersShown = 0;
+        for (auto& answer : answerOrder) answer = 0;
+        feedbackLines = 0;
+        feedbackNext = MAIN_MENU;
+        feedbackTimer = 0;
+        feedbackEndsGame = false;
+        finalScore[0] = '\0';
+    }
+};
+
+// One player's game. Everything that changes while playing (state, progress,
+// the screen being shown, its hit map and timers, stats) belongs to the
+// session, the content pack is shared read-only. The game itself runs one
+// session on the global scene, hit map, scheduler and stats; the session
+// host (tools/gamehost.cpp) runs many, each with its own.
+//
+// Screens are looked up in a table of enter / update / exit hooks. onEnter
+// builds the screen's static content into the scene once, onUpdate runs
+// every frame the screen is up, and onExit tidies up after it. Handlers
+// never switch screens themselves, they queue the switch with goTo and it
+// happens at the start of the next frame.
+//
+// Drawing goes to LCD, so a session has to run on one thread at a time.
+// Scene widgets point back at the session, so it must not move.
+class GameSession {
+public:
+    GameSession(const ContentPack& content, Scene& scene, HitMap& hitMap,
+                Scheduler& scheduler, StatsStore& stats);
+    GameSession(const GameSession&) = delete;
+    GameSession& operator=(const GameSession&) = delete;
+
+    GameScreen screen() const { return current; }
+
+    // A screen switch or a drag is queued or the current screen hasn't been drawn yet
+    bool needsFrame() const { return pending != SCREEN_COUNT || !entered || dragX != 0 || dragY != 0; }
+    // The last frame built a screen rather than just updating the one that was up
+    bool builtScreen() const { return frameEntered; }
+
+    // Draw one frame, touchX/touchY are -1 if nothing was touched.
+    // Returns the screen the frame was drawn for.
+    int frame(float touchX, float touchY);
+
+    // The finger moved by dx, dy while down. Adds up until the next frame,
+    // which hands it to the screen (scrolling a biome's world).
+    void drag(float dx, float dy);
+
+    // Where a saved copy of this session should start up: the screen it's
+    // on or about to switch to, or past the feedback screen if it's on that
+    GameScreen resumeScreen() const;
+    // Start on screen next frame without leaving the current one, for
+    // restoring a save before the first frame
+    void resumeAt(GameScreen screen);
+
+    GameState gameState;
+    // Which animals have been answered correctly, kept across games
+    Progress visited;
+    // How well the player knows each animal's question and when to ask it
+    // again. Its seed picks the answer orders, so set it before playing.
+    ReviewQueue review;
+    // Print cache and scene stats at game over
+    bool printReports;
+    // Saved to after every answer when set
+    SaveStore* saves;
+
+private:
+    struct ScreenHandlers {
+        GameScreen screen;  // the table is checked to be in enum order
+        const char* name;
+        void (GameSession::*onEnter)();
+        void (GameSession::*onUpdate)(float touchX, float touchY);
+        void (GameSession::*onExit)();  // may be nullptr
+        void (GameSession::*onDrag)(float dx, float dy);  // may be nullptr
+    };
+    // Indexed by GameScreen, checked at compile time to be in that order
+    static const ScreenHandlers screens[SCREEN_COUNT];
+    static constexpr bool screensInOrder();
+    friend const char* stateName(int state);
+
+    // Switch screens at the start of the next frame
+    void goTo(GameScreen screen);
+    void applyTransition();
+
+    void addBackButton();
+    void addBackButtonHit();
+    void addStatusBar();
+    void drawQuestion(const PackAnimal& animal);
+
+    void enterMainMenu();
+    void updateMainMenu(float touchX, float touchY);
+    void enterStats();
+    void enterInstructions();
+    void enterCredits();
+    void updateBackToMenu(float touchX, float touchY);
+    void enterBiomeSelect();
+    void updateBiomeSelect(float touchX, float touchY);
+    void enterBiome();
+    void updateBiome(float touchX, float touchY);
+    void dragBiome(float dx, float dy);
+    void addAnimalHits();
+    void exitBiome();
+    void startAmbient(const PackBiome& biome, const char* image);
+    void tickAmbient();
+    void enterQuestion();
+    void updateQuestion(float touchX, float touchY);
+    void enterFeedback();
+    void updateFeedback(float touchX, float touchY);
+    void exitFeedback();
+
+    void finishFeedback();
+    void showFeedback(std::initializer_list<FeedbackLine> lines, double seconds, GameScreen nextScreen);
+    void showGameOver();
+
+    const ContentPack& content;
+    Scene& scene;
+    HitMap& hitMap;
+    Scheduler& scheduler;
+    StatsStore& stats;
+
+    std::vector<ClickableRegion> biomeRegions;
+    // The biome's world, if it's a scrolling one
+    WorldView world;
+    // Weather and idle animals on the biome being shown, see ambient.h
+    AmbientLayer ambient;
+    int ambientTimer;
+    double ambientLast;  // scheduler time of the last ambient step
+    GameScreen current;
+    GameScreen pending;  // SCREEN_COUNT when no switch is queued
+    bool entered;        // current's onEnter has run
+    bool frameEntered;   // and it ran during the last frame
+    bool saveDue;        // answered this frame
+    float dragX, dragY;  // drag queued for the next frame
+};
+
+#endif
@@ -0,0 +1,409 @@
+#include "spectator.h"
+#include "input.h"
+#include "profiler.h"
+#include "tilecodec.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// Viewers hanging up mid-send shouldn't kill the game with SIGPIPE
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+Spectator spectator;
+
+size_t spectatorMaxMessage(int width, int height) {
+    size_t tiles = (size_t)((width + SPECTATOR_TILE_SIZE - 1) / SPECTATOR_TILE_SIZE) *
+                   ((height + SPECTATOR_TILE_SIZE - 1) / SPECTATOR_TILE_SIZE);
+    return sizeof(SpectatorHeader) + tiles * (2 + tileCodecMaxBytes(SPECTATOR_TILE_SIZE, SPECTATOR_TILE_SIZE));
+}
+
+size_t encodeSpectatorFrame(const unsigned int* pixels, const unsigned int* previous,
+                            int width, int height, uint32_t frame, uint8_t* out) {
+    int tilesX = (width + SPECTATOR_TILE_SIZE - 1) / SPECTATOR_TILE_SIZE;
+    int tilesY = (height + SPECTATOR_TILE_SIZE - 1) / SPECTATOR_TILE_SIZE;
+    uint8_t* p = out + sizeof(SpectatorHeader);
+    int tileCount = 0;
+
+    for (int tileY = 0; tileY < tilesY; tileY++) {
+        int y = tileY * SPECTATOR_TILE_SIZE;
+        int tileHeight = std::min(SPECTATOR_TILE_SIZE, height - y);
+        for (int tileX = 0; tileX < tilesX; tileX++) {
+            int x = tileX * SPECTATOR_TILE_SIZE;
+            int tileWidth = std::min(SPECTATOR_TILE_SIZE, width - x);
+            size_t origin = (size_t)y * width + x;
+
+            if (previous) {
+                bool changed = false;
+                for (int row = 0; row < tileHeight && !changed; row++) {
+                    changed = memcmp(pixels + origin + (size_t)row * width,
+                                     previous + origin + (size_t)row * width,
+                                     tileWidth * sizeof(unsigned int)) != 0;
+                }
+                if (!changed) continue;
+            }
+
+            uint16_t index = (uint16_t)(tileY * tilesX + tileX);
+            memcpy(p, &index, sizeof(index));
+            p += sizeof(index);
+            p += encodeTile(pixels + origin, width, tileWidth, tileHeight, p);
+            tileCount++;
+        }
+    }
+    if (tileCount == 0) return 0;
+
+    SpectatorHeader header;
+    header.magic = SPECTATOR_MAGIC;
+    header.frame = frame;
+    header.width = (uint16_t)width;
+    header.height = (uint16_t)height;
+    header.tileCount = (uint16_t)tileCount;
+    header.tileSize = SPECTATOR_TILE_SIZE;
+    header.flags = previous ? 0 : SPECTATOR_KEYFRAME;
+    header.payloadBytes = (uint32_t)(p - out - sizeof(header));
+    memcpy(out, &header, sizeof(header));
+    return p - out;
+}
+
+Spectator::Spectator()
+    : width(0), height(0), listenFd(-1), wakeFds{-1, -1}, unixPath{}, running(false),
+      stopping(false), finished(false), keyframeInterval(SPECTATOR_KEYFRAME_INTERVAL),
+      frameNumber(0), head(0), previousFrame(0), havePrevious(false), framesSeen(0),
+      messagesSent(0), keyframesSent(0), bytesSent(0), largestMessage(0), encodeTotal(0),
+      encodeMax(0), viewersSeen(0), resyncs(0) {}
+
+Spectator::~Spectator() {
+    stop();
+}
+
+static void finishSpectator() {
+    spectator.finish();
+}
+
+void Spectator::startFromEnvironment(int width, int height) {
+    const char* address = getenv("ECOQUEST_SPECTATE");
+    if (!address || address[0] == '\0') return;
+    const char* interval = getenv("ECOQUEST_SPECTATE_KEYFRAME");
+    if (interval && atoi(interval) > 0) keyframeInterval = atoi(interval);
+    start(address, width, height);
+}
+
+#ifdef _WIN32
+
+bool Spectator::start(const char*, int, int) {
+    printf("Spectator: not supported on Windows\n");
+    return false;
+}
+
+void Spectator::stop() {}
+void Spectator::frame(const unsigned int*) {}
+
+#else
+
+static void setNonBlocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+bool Spectator::start(const char* address, int frameWidth, int frameHeight) {
+    if (running) return true;
+    if (!listenOn(address)) return false;
+    if (pipe(wakeFds) != 0) {
+        printf("Spectator: can't make a wake pipe\n");
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+    setNonBlocking(wakeFds[0]);
+    setNonBlocking(wakeFds[1]);
+
+    // Everything frame() needs is allocated up front
+    width = frameWidth;
+    height = frameHeight;
+    message.resize(spectatorMaxMessage(width, height));
+    ring.resize(SPECTATOR_BUFFER_BYTES);
+    previous.assign((size_t)width * height, 0);
+
+    stopping = false;
+    running = true;
+    network = std::thread(&Spectator::runNetwork, this);
+
+    // The headless game quits from its touch script with quick_exit
+    at_quick_exit(finishSpectator);
+    printf("Spectator: streaming on %s\n", address);
+    return true;
+}
+
+bool Spectator::listenOn(const char* address) {
+    int fd = -1;
+    if (strncmp(address, "unix:", 5) == 0) {
+        const char* path = address + 5;
+        sockaddr_un local = {};
+        if (strlen(path) >= sizeof(local.sun_path) || strlen(path) >= sizeof(unixPath)) {
+            printf("Spectator: socket path too long: %s\n", path);
+            return false;
+        }
+        local.sun_family = AF_UNIX;
+        strcpy(local.sun_path, path);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        // A game that didn't get to clean up leaves its socket behind
+        unlink(path);
+        if (fd < 0 || bind(fd, (sockaddr*)&local, sizeof(local)) != 0) {
+            printf("Spectator: can't bind %s\n", path);
+            if (fd >= 0) close(fd);
+            return false;
+        }
+        strcpy(unixPath, path);
+    } else if (strncmp(address, "tcp:", 4) == 0) {
+        int port = atoi(address + 4);
+        if (port <= 0 || port > 65535) {
+            printf("Spectator: bad port in %s\n", address);
+            return false;
+        }
+        // Loopback only, whoever wants it further afield can tunnel it
+        sockaddr_in local = {};
+        local.sin_family = AF_INET;
+        local.sin_port = htons((uint16_t)port);
+        local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        int reuse = 1;
+        if (fd >= 0) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (fd < 0 || bind(fd, (sockaddr*)&local, sizeof(local)) != 0) {
+            printf("Spectator: can't bind 127.0.0.1:%d\n", port);
+            if (fd >= 0) close(fd);
+            return false;
+        }
+    } else {
+        printf("Spectator: don't know how to listen on %s, use unix:<path> or tcp:<port>\n", address);
+        return false;
+    }
+
+    if (listen(fd, 8) != 0) {
+        printf("Spectator: can't listen on %s\n", address);
+        close(fd);
+        return false;
+    }
+    setNonBlocking(fd);
+    listenFd = fd;
+    return true;
+}
+
+void Spectator::stop() {
+    if (!running) return;
+    running = false;
+    stopping = true;
+    char wake = 1;
+    if (write(wakeFds[1], &wake, 1) < 0) {}
+    if (network.joinable()) network.join();
+
+    for (Viewer& viewer : viewers) close(viewer.fd);
+    viewers.clear();
+    close(listenFd);
+    close(wakeFds[0]);
+    close(wakeFds[1]);
+    listenFd = wakeFds[0] = wakeFds[1] = -1;
+    if (unixPath[0]) unlink(unixPath);
+}
+
+void Spectator::frame(const unsigned int* pixels) {
+    if (!running) return;
+    PROFILE_SCOPE("Spectator::frame");
+    double start = inputClock();
+
+    bool keyframe = !havePrevious || frameNumber % keyframeInterval == 0;
+    size_t size = encodeSpectatorFrame(pixels, keyframe ? nullptr : previous.data(),
+                                       width, height, frameNumber, message.data());
+    if (size > 0) {
+        std::lock_guard<std::mutex> guard(lock);
+        append(message.data(), size);
+        memcpy(previous.data(), pixels, previous.size() * sizeof(unsigned int));
+        previousFrame = frameNumber;
+        havePrevious = true;
+    }
+    frameNumber++;
+
+    double elapsed = inputClock() - start;
+    framesSeen++;
+    encodeTotal += elapsed;
+    encodeMax = std::max(encodeMax, elapsed);
+    if (size == 0) return;
+    messagesSent++;
+    if (keyframe) keyframesSent++;
+    bytesSent += size;
+    largestMessage = std::max(largestMessage, size);
+
+    // Nudge the network thread, if the pipe is full it's already awake
+    char wake = 1;
+    if (write(wakeFds[1], &wake, 1) < 0) {}
+}
+
+void Spectator::append(const uint8_t* data, size_t size) {
+    size_t offset = head % ring.size();
+    size_t first = std::min(size, ring.size() - offset);
+    memcpy(ring.data() + offset, data, first);
+    memcpy(ring.data(), data + first, size - first);
+    head += size;
+}
+
+void Spectator::readRing(uint64_t position, uint8_t* data, size_t size) const {
+    size_t offset = position % ring.size();
+    size_t first = std::min(size, ring.size() - offset);
+    memcpy(data, ring.data() + offset, first);
+    memcpy(data + first, ring.data(), size - first);
+}
+
+void Spectator::runNetwork() {
+    std::vector<pollfd> fds;
+    double deadline = 0;
+
+    for (;;) {
+        if (stopping) {
+            // Quitting, but let everyone see how it ended if they can keep up
+            if (deadline == 0) deadline = inputClock() + SPECTATOR_DRAIN_SECONDS;
+            bool caughtUp = true;
+            for (const Viewer& viewer : viewers) caughtUp = caughtUp && !hasData(viewer);
+            if (caughtUp || inputClock() > deadline) break;
+        }
+
+        fds.clear();
+        fds.push_back({listenFd, POLLIN, 0});
+        fds.push_back({wakeFds[0], POLLIN, 0});
+        for (const Viewer& viewer : viewers) {
+            // Viewers never send anything, POLLIN is only there to notice them leave
+            short events = POLLIN | (hasData(viewer) ? POLLOUT : 0);
+            fds.push_back({viewer.fd, events, 0});
+        }
+        if (poll(fds.data(), fds.size(), stopping ? 50 : -1) < 0 && errno != EINTR) break;
+
+        if (fds[1].revents & POLLIN) {
+            char drain[64];
+            while (read(wakeFds[0], drain, sizeof(drain)) > 0) {}
+        }
+
+        for (size_t i = 0; i < viewers.size(); i++) {
+            Viewer& viewer = viewers[i];
+            short events = fds[i + 2].revents;
+            bool open = !(events & (POLLERR | POLLHUP | POLLNVAL));
+            if (open && (events & POLLIN)) {
+                char junk[256];
+                ssize_t got = recv(viewer.fd, junk, sizeof(junk), 0);
+                open = got > 0 || (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+            }
+            if (open && (events & POLLOUT)) open = flush(viewer);
+            if (!open) {
+                close(viewer.fd);
+                viewer.fd = -1;
+            }
+        }
+        viewers.erase(std::remove_if(viewers.begin(), viewers.end(),
+                                     [](const Viewer& viewer) { return viewer.fd < 0; }),
+                      viewers.end());
+
+        if (fds[0].revents & POLLIN) acceptViewers();
+    }
+}
+
+void Spectator::acceptViewers() {
+    for (;;) {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0) return;
+        setNonBlocking(fd);
+#ifdef SO_NOSIGPIPE
+        int noSignal = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &noSignal, sizeof(noSignal));
+#endif
+        Viewer viewer;
+        viewer.fd = fd;
+        viewer.position = 0;
+        viewer.synced = false;
+        viewer.out.resize(spectatorMaxMessage(width, height));
+        viewer.outSize = viewer.outSent = 0;
+        viewers.push_back(std::move(viewer));
+        viewersSeen++;
+    }
+}
+
+bool Spectator::hasData(const Viewer& viewer) const {
+    if (viewer.outSent < viewer.outSize) return true;
+    std::lock_guard<std::mutex> guard(lock);
+    return havePrevious && (!viewer.synced || viewer.position != head);
+}
+
+// Queue the viewer's next message, the viewer's own copy so the ring can
+// move on while it goes out
+void Spectator::fill(Viewer& viewer) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!havePrevious) return;
+
+    if (!viewer.synced || head - viewer.position > ring.size()) {
+        // New, or lapped by the ring: start over from what's on screen now
+        if (viewer.synced) resyncs++;
+        viewer.outSize = encodeSpectatorFrame(previous.data(), nullptr, width, height,
+                                              previousFrame, viewer.out.data());
+        viewer.outSent = 0;
+        viewer.position = head;
+        viewer.synced = true;
+        return;
+    }
+    if (viewer.position == head) return;
+
+    SpectatorHeader header;
+    readRing(viewer.position, (uint8_t*)&header, sizeof(header));
+    size_t size = sizeof(header) + header.payloadBytes;
+    readRing(viewer.position, viewer.out.data(), size);
+    viewer.position += size;
+    viewer.outSize = size;
+    viewer.outSent = 0;
+}
+
+// Send until the socket is full or there's nothing left, false if the viewer is gone
+bool Spectator::flush(Viewer& viewer) {
+    for (;;) {
+        if (viewer.outSent == viewer.outSize) {
+            fill(viewer);
+            if (viewer.outSent == viewer.outSize) return true;
+        }
+        ssize_t sent = send(viewer.fd, viewer.out.data() + viewer.outSent,
+                            viewer.outSize - viewer.outSent, SEND_FLAGS);
+        if (sent < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        viewer.outSent += sent;
+    }
+}
+
+#endif
+
+void Spectator::finish() {
+    if (finished || !running) return;
+    finished = true;
+    stop();
+    printStats();
+    // quick_exit doesn't flush stdio for us
+    fflush(stdout);
+}
+
+void Spectator::printStats() const {
+    if (framesSeen == 0) return;
+    size_t raw = (size_t)width * height * 3;
+    printf("Spectator: %d frames, %d sent (%d keyframes), %.0f bytes per frame on average, "
+           "%zu at most (%zu raw)\n",
+           framesSeen, messagesSent, keyframesSent, (double)bytesSent / framesSeen,
+           largestMessage, raw);
+    printf("Spectator: encode %.3f ms per frame on average, %.3f ms at most\n",
+           encodeTotal * 1e3 / framesSeen, encodeMax * 1e3);
+    printf("Spectator: %d viewers connected, %d skipped ahead after falling behind\n",
+           viewersSeen, resyncs);
+}
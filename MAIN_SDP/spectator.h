@@ -0,0 +1,141 @@
+#ifndef SPECTATOR_H
+#define SPECTATOR_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Spectator stream, so a teacher can watch the kiosks from one console.
+// Every frame the game pushes with LCD.Update() is cut into 16x16 tiles and
+// compared against the last one, and only the tiles that changed are sent.
+// A screen that sits still costs nothing, a button press costs the button.
+//
+//   ECOQUEST_SPECTATE=unix:<path>          listen on a Unix-domain socket
+//   ECOQUEST_SPECTATE=tcp:<port>           or on 127.0.0.1:port
+//   ECOQUEST_SPECTATE_KEYFRAME=<frames>    full frame every this many frames
+//                                          (default SPECTATOR_KEYFRAME_INTERVAL)
+//
+// Any number of viewers can connect (tools/spectate.cpp is one). Each gets
+// a keyframe of the current screen first, then the deltas. The game never
+// waits on a viewer: frames go into one shared ring buffer and a network
+// thread sends each viewer what it hasn't had yet. A viewer so slow the
+// ring laps it skips ahead to a fresh keyframe instead.
+//
+// Stream format, one message per frame that changed. Fields are in the
+// host's byte order, viewers are always on the same machine.
+//   SpectatorHeader
+//   tileCount tiles of:
+//     uint16 tile index, row by row over the tile grid
+//     the tile, encoded as in tilecodec.h
+
+#define SPECTATOR_MAGIC 0x56535145  // "EQSV"
+#define SPECTATOR_TILE_SIZE 16
+#define SPECTATOR_KEYFRAME_INTERVAL 120
+
+// Shared by all viewers, a few keyframes' worth
+#define SPECTATOR_BUFFER_BYTES (1 << 20)
+
+// Longest a quitting game waits for viewers to get the last frames
+#define SPECTATOR_DRAIN_SECONDS 1.0
+
+#define SPECTATOR_KEYFRAME 1
+
+struct SpectatorHeader {
+    uint32_t magic;
+    uint32_t frame;
+    uint16_t width;
+    uint16_t height;
+    uint16_t tileCount;
+    uint8_t tileSize;
+    uint8_t flags;         // SPECTATOR_KEYFRAME
+    uint32_t payloadBytes;  // tile data following the header
+};
+
+// Biggest message a width x height frame can encode to, every tile raw
+size_t spectatorMaxMessage(int width, int height);
+
+// Encode pixels (0xRRGGBB) into out, which needs spectatorMaxMessage bytes.
+// Only tiles that differ from previous go in, or all of them when previous
+// is null. Returns the message size, 0 if nothing changed.
+size_t encodeSpectatorFrame(const unsigned int* pixels, const unsigned int* previous,
+                            int width, int height, uint32_t frame, uint8_t* out);
+
+class Spectator {
+public:
+    Spectator();
+    ~Spectator();
+
+    // Starts listening if ECOQUEST_SPECTATE is set, for frames of width x height
+    void startFromEnvironment(int width, int height);
+    bool start(const char* address, int width, int height);
+
+    // Send whatever changed since the last frame
+    void frame(const unsigned int* pixels);
+
+    // Give viewers a moment to catch up, then hang up on them
+    void stop();
+    // stop() and print the stream stats, once
+    void finish();
+    void printStats() const;
+
+    bool enabled() const { return running; }
+
+private:
+    struct Viewer {
+        int fd;
+        uint64_t position;  // next ring byte to send, always a message start
+        bool synced;        // had its keyframe
+        std::vector<uint8_t> out;
+        size_t outSize;
+        size_t outSent;
+    };
+
+    bool listenOn(const char* address);
+    void runNetwork();
+    void acceptViewers();
+    bool hasData(const Viewer& viewer) const;
+    void fill(Viewer& viewer);
+    bool flush(Viewer& viewer);
+    void append(const uint8_t* data, size_t size);
+    void readRing(uint64_t position, uint8_t* data, size_t size) const;
+
+    int width, height;
+    int listenFd;
+    int wakeFds[2];
+    char unixPath[108];
+    std::thread network;
+    std::atomic<bool> running;
+    std::atomic<bool> stopping;
+    bool finished;
+
+    // Game thread only
+    int keyframeInterval;
+    uint32_t frameNumber;
+    std::vector<uint8_t> message;
+
+    // Under lock: the ring and the last frame sent, which viewers joining
+    // late get their keyframe from. Only the game thread writes these.
+    mutable std::mutex lock;
+    std::vector<uint8_t> ring;
+    uint64_t head;  // bytes ever written to the ring
+    std::vector<unsigned int> previous;
+    uint32_t previousFrame;
+    bool havePrevious;
+
+    // Network thread only
+    std::vector<Viewer> viewers;
+
+    // Stats
+    int framesSeen, messagesSent, keyframesSent;
+    uint64_t bytesSent;
+    size_t largestMessage;
+    double encodeTotal, encodeMax;
+    int viewersSeen, resyncs;
+};
+
+extern Spectator spectator;
+
+#endif
@@ -0,0 +1,287 @@
+#include "statsstore.h"
+#include "content.h"
+#include <algorithm>
+#include <cstring>
+
+StatsStore stats;
+
+// What a record looked like in version 1, animal was a content index
+struct StatsRecordV1 {
+    uint8_t type;
+    uint8_t correct;
+    uint16_t animal;
+    uint32_t value;
+};
+
+StatsStore::StatsStore() : log(nullptr), logBytes(0), sinceSnapshot(0), replayed(0) {
+    memset(&totals, 0, sizeof(totals));
+}
+
+StatsStore::~StatsStore() {
+    close();
+}
+
+bool StatsStore::open(const std::string& path, const ContentPack& content) {
+    close();
+    snapPath = path + ".snap";
+    memset(&totals, 0, sizeof(totals));
+    int animalCount = content.animalCount();
+    animals.assign(animalCount, StatsAnimal{0, 0});
+    ids.resize(animalCount);
+    byId.resize(animalCount);
+    for (int i = 0; i < animalCount; i++) {
+        ids[i] = content.animalId(i);
+        byId[i] = {ids[i], i};
+    }
+    std::sort(byId.begin(), byId.end());
+    logBytes = 0;
+    replayed = 0;
+
+    std::string logPath = path + ".log";
+    if (!upgradeLog(logPath)) {
+        printf("StatsStore: can't upgrade %s, stats won't be saved\n", logPath.c_str());
+        return false;
+    }
+
+    // A missing or unreadable snapshot just means replaying the whole log
+    if (!loadSnapshot()) {
+        memset(&totals, 0, sizeof(totals));
+        animals.assign(animalCount, StatsAnimal{0, 0});
+        logBytes = 0;
+    }
+
+    log = fopen(logPath.c_str(), "r+b");
+    if (!log) log = fopen(logPath.c_str(), "w+b");
+    if (!log) {
+        printf("StatsStore: can't open %s, stats won't be saved\n", logPath.c_str());
+        return false;
+    }
+
+    replayed = replayLog();
+    sinceSnapshot = replayed;
+    if (logBytes == 0) {
+        // A new log, say what's in it
+        StatsRecord start = {STATS_LOG_START, 0, 0, 0, STATS_VERSION};
+        if (fwrite(&start, sizeof(start), 1, log) == 1) logBytes += sizeof(start);
+        fflush(log);
+    }
+    return true;
+}
+
+int StatsStore::animalIndex(uint32_t id) const {
+    auto found = std::lower_bound(byId.begin(), byId.end(), std::make_pair(id, 0));
+    return found != byId.end() && found->first == id ? found->second : -1;
+}
+
+uint32_t StatsStore::animalId(int index) const {
+    return index >= 0 && index < (int)ids.size() ? ids[index] : 0;
+}
+
+bool StatsStore::upgradeLog(const std::string& logPath) {
+    FILE* file = fopen(logPath.c_str(), "rb");
+    if (!file) return true;
+    uint8_t type = 0;
+    bool current = fread(&type, 1, 1, file) != 1 || type == STATS_LOG_START;
+    if (current) {
+        fclose(file);
+        return true;
+    }
+
+    // Version 1: indexes into whatever the content was then. The content
+    // now is the best guess there is for which animals they meant.
+    std::vector<StatsRecord> records;
+    records.push_back(StatsRecord{STATS_LOG_START, 0, 0, 0, STATS_VERSION});
+    fseek(file, 0, SEEK_SET);
+    StatsRecordV1 old;
+    while (fread(&old, sizeof(old), 1, file) == 1) {
+        records.push_back(StatsRecord{old.type, old.correct, 0, animalId(old.animal), old.value});
+    }
+    fclose(file);
+
+    // Written to the side and renamed over, like the snapshot
+    std::string tempPath = logPath + ".tmp";
+    file = fopen(tempPath.c_str(), "wb");
+    if (!file) return false;
+    bool ok = fwrite(records.data(), sizeof(StatsRecord), records.size(), file) == records.size();
+    ok = fclose(file) == 0 && ok;
+#ifdef _WIN32
+    if (ok) remove(logPath.c_str());
+#endif
+    if (!ok || rename(tempPath.c_str(), logPath.c_str()) != 0) {
+        remove(tempPath.c_str());
+        return false;
+    }
+    // The old snapshot counts the old log's bytes, the new log has it all anyway
+    remove(snapPath.c_str());
+    printf("StatsStore: upgraded %s, %d records\n", logPath.c_str(), (int)records.size() - 1);
+    return true;
+}
+
+void StatsStore::close() {
+    if (!log) return;
+    if (sinceSnapshot > 0) snapshot();
+    fclose(log);
+    log = nullptr;
+}
+
+bool StatsStore::loadSnapshot() {
+    FILE* file = fopen(snapPath.c_str(), "rb");
+    if (!file) return false;
+
+    StatsSnapshotHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+              header.magic == STATS_MAGIC && header.version == STATS_VERSION;
+    if (ok) {
+        totals = header.summary;
+        logBytes = header.logBytes;
+        // The content pack may have gained, lost or moved animals since
+        std::vector<StatsSavedAnimal> saved(header.animalCount);
+        ok = header.animalCount == 0 ||
+             fread(saved.data(), sizeof(StatsSavedAnimal), saved.size(), file) == saved.size();
+        for (size_t i = 0; ok && i < saved.size(); i++) {
+            int index = animalIndex(saved[i].id);
+            if (index >= 0) animals[index] = saved[i].stats;
+        }
+    }
+    fclose(file);
+    if (!ok) printf("StatsStore: ignoring bad snapshot %s\n", snapPath.c_str());
+    return ok;
+}
+
+int StatsStore::replayLog() {
+    fseek(log, 0, SEEK_END);
+    long size = ftell(log);
+    // A record cut off by a crash or power loss gets written over
+    uint64_t whole = size > 0 ? (uint64_t)size - (uint64_t)size % sizeof(StatsRecord) : 0;
+    if (logBytes > whole) {
+        // Log is shorter than the snapshot remembers, the snapshot has it all
+        logBytes = whole;
+    }
+
+    int count = 0;
+    fseek(log, (long)logBytes, SEEK_SET);
+    StatsRecord record;
+    while (logBytes < whole && fread(&record, sizeof(record), 1, log) == 1) {
+        apply(record);
+        logBytes += sizeof(record);
+        count++;
+    }
+    // Switching from reading to writing needs a seek in between anyway
+    fseek(log, (long)logBytes, SEEK_SET);
+    return count;
+}
+
+void StatsStore::apply(const StatsRecord& record) {
+    switch (record.type) {
+        case STATS_ANSWER:
+            totals.answers++;
+            totals.correctAnswers += record.correct;
+            totals.responseMs += record.value;
+            if (int index = animalIndex(record.animal); index >= 0) {
+                animals[index].attempts++;
+                animals[index].correct += record.correct;
+            }
+            break;
+        case STATS_LIFE_LOST:
+            totals.livesLost++;
+            break;
+        case STATS_GAME_END:
+            totals.gamesPlayed++;
+            totals.totalScore += record.value;
+            if (record.value > totals.bestScore) totals.bestScore = record.value;
+            break;
+    }
+}
+
+void StatsStore::append(const StatsRecord& record) {
+    apply(record);
+    if (!log) return;
+    if (fwrite(&record, sizeof(record), 1, log) == 1) {
+        logBytes += sizeof(record);
+    }
+    fflush(log);
+    if (++sinceSnapshot >= STATS_SNAPSHOT_INTERVAL) snapshot();
+}
+
+void StatsStore::recordAnswer(int animal, bool correct, double responseSeconds) {
+    double ms = responseSeconds * 1000.0;
+    StatsRecord record;
+    record.type = STATS_ANSWER;
+    record.correct = correct ? 1 : 0;
+    record.reserved = 0;
+    record.animal = animalId(animal);
+    record.value = ms <= 0 ? 0 : ms >= 4e9 ? 4000000000u : (uint32_t)(ms + 0.5);
+    append(record);
+}
+
+void StatsStore::recordLifeLost(int animal) {
+    append(StatsRecord{STATS_LIFE_LOST, 0, 0, animalId(animal), 0});
+}
+
+void StatsStore::recordGameEnd(int score) {
+    append(StatsRecord{STATS_GAME_END, 0, 0, 0, (uint32_t)(score > 0 ? score : 0)});
+    snapshot();
+}
+
+void StatsStore::snapshot() {
+    if (!log) return;
+    StatsSnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = STATS_MAGIC;
+    header.version = STATS_VERSION;
+    header.logBytes = logBytes;
+    header.animalCount = (uint32_t)animals.size();
+    header.summary = totals;
+
+    // Written to the side and renamed over, so there's always a whole snapshot
+    std::string tempPath = snapPath + ".tmp";
+    FILE* file = fopen(tempPath.c_str(), "wb");
+    if (!file) {
+        printf("StatsStore: can't write %s\n", tempPath.c_str());
+        return;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (size_t i = 0; ok && i < animals.size(); i++) {
+        StatsSavedAnimal saved = {ids[i], animals[i]};
+        ok = fwrite(&saved, sizeof(saved), 1, file) == 1;
+    }
+    ok = fclose(file) == 0 && ok;
+#ifdef _WIN32
+    // rename won't replace an existing file on Windows
+    if (ok) remove(snapPath.c_str());
+#endif
+    if (!ok || rename(tempPath.c_str(), snapPath.c_str()) != 0) {
+        printf("StatsStore: can't write %s\n", snapPath.c_str());
+        remove(tempPath.c_str());
+        return;
+    }
+    sinceSnapshot = 0;
+}
+
+int StatsStore::accuracy() const {
+    if (totals.answers == 0) return 0;
+    return (int)((totals.correctAnswers * 100ull + totals.answers / 2) / totals.answers);
+}
+
+double StatsStore::averageResponse() const {
+    return totals.answers ? totals.responseMs / 1000.0 / totals.answers : 0.0;
+}
+
+int StatsStore::hardestAnimal() const {
+    int hardest = -1;
+    for (int i = 0; i < (int)animals.size(); i++) {
+        const StatsAnimal& a = animals[i];
+        if (a.attempts == 0 || a.correct == a.attempts) continue;
+        // Lower correct / attempts, compared without dividing
+        if (hardest < 0 || (uint64_t)a.correct * animals[hardest].attempts <
+                           (uint64_t)animals[hardest].correct * a.attempts) {
+            hardest = i;
+        }
+    }
+    return hardest;
+}
+
+void StatsStore::printStats() const {
+    printf("StatsStore: %d records replayed at startup, %u games, best score %u, %u answers (%d%% right)\n",
+           replayed, totals.gamesPlayed, totals.bestScore, totals.answers, accuracy());
+}
@@ -0,0 +1,138 @@
+#ifndef STATSSTORE_H
+#define STATSSTORE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+class ContentPack;
+
+// Player stats that survive restarts and game overs.
+//
+// Every answer, lost life and finished game is appended to <path>.log as one
+// fixed size StatsRecord, and the totals below are updated as it goes. Every
+// STATS_SNAPSHOT_INTERVAL records, and at the end of each game, the totals are
+// written to <path>.snap along with how much of the log they cover. Opening
+// reads the snapshot and only replays the records after it, so startup costs
+// the same however long the log has grown. The Stats screen just reads
+// summary(), nothing is recomputed from history.
+//
+// Animals are stored by content ID (ContentPack::animalId), like SaveStore
+// does, so stats still line up after animals are added or moved around in
+// content/animals.txt. Stats for animals that have since been removed are
+// dropped at the next snapshot.
+//
+// A log starts with a STATS_LOG_START record. Logs from version 1, which
+// stored content indexes and had no start record, are rewritten with IDs
+// the first time they're opened.
+
+#define STATS_MAGIC 0x53535145  // "EQSS"
+#define STATS_VERSION 2
+
+// Records between snapshots, and so the most a startup ever replays
+#define STATS_SNAPSHOT_INTERVAL 64
+
+#define STATS_ANSWER 1     // animal, value = response time in ms, correct
+#define STATS_LIFE_LOST 2  // animal it was lost on
+#define STATS_GAME_END 3   // value = final score
+#define STATS_LOG_START 4  // value = STATS_VERSION
+
+struct StatsRecord {
+    uint8_t type;
+    uint8_t correct;
+    uint16_t reserved;
+    uint32_t animal;  // content ID
+    uint32_t value;
+};
+
+struct StatsSummary {
+    uint32_t gamesPlayed;
+    uint32_t bestScore;
+    uint64_t totalScore;
+    uint32_t answers;
+    uint32_t correctAnswers;
+    uint64_t responseMs;  // summed over every answer
+    uint32_t livesLost;
+    uint32_t reserved;
+};
+
+struct StatsSnapshotHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t logBytes;  // length of the log the snapshot includes
+    uint32_t animalCount;
+    uint32_t reserved;
+    StatsSummary summary;
+    // followed by StatsSavedAnimal[animalCount]
+};
+
+struct StatsAnimal {
+    uint32_t attempts;
+    uint32_t correct;
+};
+
+struct StatsSavedAnimal {
+    uint32_t id;  // content ID
+    StatsAnimal stats;
+};
+
+class StatsStore {
+public:
+    StatsStore();
+    ~StatsStore();
+
+    // Load <path>.snap, replay the log after it and keep <path>.log open
+    // for appending. Without a successful open the store still counts, it
+    // just doesn't save anything (replays use it that way).
+    bool open(const std::string& path, const ContentPack& content);
+    void close();
+
+    // animal is a content index, it's stored by ID
+    void recordAnswer(int animal, bool correct, double responseSeconds);
+    void recordLifeLost(int animal);
+    void recordGameEnd(int score);
+
+    // Write the snapshot now rather than waiting for the interval
+    void snapshot();
+
+    const StatsSummary& summary() const { return totals; }
+    const StatsAnimal& animal(int index) const { return animals[index]; }
+    int animalCount() const { return (int)animals.size(); }
+
+    // Percent of answers that were right, and average seconds to answer
+    int accuracy() const;
+    double averageResponse() const;
+    // Animal with the worst accuracy that's been tried, -1 if none has
+    int hardestAnimal() const;
+
+    void printStats() const;
+
+private:
+    void apply(const StatsRecord& record);
+    void append(const StatsRecord& record);
+    bool upgradeLog(const std::string& logPath);
+    bool loadSnapshot();
+    int replayLog();
+    // Content index of an animal ID, -1 if the content doesn't have it
+    int animalIndex(uint32_t id) const;
+    uint32_t animalId(int index) const;
+
+    std::string snapPath;
+    FILE* log;
+    uint64_t logBytes;
+    int sinceSnapshot;
+    int replayed;  // records replayed by the last open, for printStats
+
+    StatsSummary totals;
+    // By content index, the same order as ids
+    std::vector<StatsAnimal> animals;
+    std::vector<uint32_t> ids;
+    // (ID, index) sorted by ID, to find animals from the log and snapshot
+    std::vector<std::pair<uint32_t, int>> byId;
+};
+
+extern StatsStore stats;
+
+#endif
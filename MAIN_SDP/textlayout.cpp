@@ -0,0 +1,101 @@
+#include "textlayout.h"
+#include "profiler.h"
+#include "drawlist.h"
+#include <cstdio>
+
+TextLayoutCache textCache;
+
+int measureText(std::string_view text, int fontSize) {
+    return measureText((int)text.length(), fontSize);
+}
+
+static uint64_t hashLayout(std::string_view text, int boxWidth, int lineHeight, int fontSize, int align) {
+    // FNV-1a over the text, then the box
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : text) {
+        hash = (hash ^ (unsigned char)c) * 1099511628211ull;
+    }
+    int params[] = {boxWidth, lineHeight, fontSize, align};
+    for (int param : params) {
+        hash = (hash ^ (uint32_t)param) * 1099511628211ull;
+    }
+    return hash;
+}
+
+void wrapText(std::string_view text, int boxWidth, int lineHeight, int fontSize, int align,
+              TextLayout& layout) {
+    int maxChars = boxWidth / measureText(1, fontSize);
+    if (maxChars < 1) maxChars = 1;
+
+    layout.width = 0;
+    int length = (int)text.length();
+    int start = 0;
+    while (start < length) {
+        // Take as much as fits, up to the next newline
+        int end = start;
+        while (end < length && end - start < maxChars && text[end] != '\n') end++;
+        int next = end;
+
+        if (end < length && text[end] == '\n') {
+            next = end + 1;
+        } else if (end < length && text[end] != ' ') {
+            // Ended mid word, go back to the last space if there is one
+            int space = end;
+            while (space > start && text[space] != ' ') space--;
+            if (space > start) {
+                end = space;
+                next = space + 1;
+            }
+        } else if (end < length) {
+            next = end + 1;
+        }
+
+        TextLine line;
+        line.text.assign(text.data() + start, end - start);
+        line.width = measureText(end - start, fontSize);
+        line.x = align == TEXT_ALIGN_CENTER ? (boxWidth - line.width) / 2 : 0;
+        line.y = (int)layout.lines.size() * lineHeight;
+        if (line.width > layout.width) layout.width = line.width;
+        layout.lines.push_back(line);
+        start = next;
+    }
+    layout.height = (int)layout.lines.size() * lineHeight;
+}
+
+const TextLayout& TextLayoutCache::layout(std::string_view text, int boxWidth, int lineHeight,
+                                          int fontSize, int align) {
+    uint64_t hash = hashLayout(text, boxWidth, lineHeight, fontSize, align);
+    std::lock_guard<std::mutex> guard(lock);
+    auto range = entries.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        const Entry& entry = it->second;
+        if (entry.boxWidth == boxWidth && entry.lineHeight == lineHeight &&
+            entry.fontSize == fontSize && entry.align == align && entry.text == text) {
+            hitCount++;
+            return entry.layout;
+        }
+    }
+
+    missCount++;
+    PROFILE_SCOPE("TextLayoutCache::layout");
+    Entry entry;
+    entry.text = text;
+    entry.boxWidth = boxWidth;
+    entry.lineHeight = lineHeight;
+    entry.fontSize = fontSize;
+    entry.align = align;
+    wrapText(text, boxWidth, lineHeight, fontSize, align, entry.layout);
+    return entries.emplace(hash, std::move(entry))->second.layout;
+}
+
+void TextLayoutCache::printStats() const {
+    std::lock_guard<std::mutex> guard(lock);
+    printf("TextLayoutCache: %d hits, %d misses, %zu layouts\n",
+           hitCount, missCount, entries.size());
+}
+
+void drawTextLayout(DrawList& draw, const TextLayout& layout, int x, int y) {
+    for (const TextLine& line : layout.lines) {
+        draw.writeAt(line.text, x + line.x, y + line.y);
+    }
+}
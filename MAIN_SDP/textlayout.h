@@ -0,0 +1,79 @@
+#ifndef TEXTLAYOUT_H
+#define TEXTLAYOUT_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+
+// Size of one character of the LCD font
+#define FONT_WIDTH 12
+#define FONT_HEIGHT 17
+
+#define TEXT_ALIGN_LEFT 0
+#define TEXT_ALIGN_CENTER 1
+
+// One line of wrapped text, positioned relative to the top left of its box
+struct TextLine {
+    std::string text;
+    int x, y;
+    int width;
+};
+
+struct TextLayout {
+    std::vector<TextLine> lines;
+    int width;   // widest line
+    int height;  // all the lines, lineHeight apart
+};
+
+// Width in pixels of a run of characters. The LCD font is fixed width,
+// fontSize scales it.
+inline int measureText(int length, int fontSize = 1) {
+    return length * FONT_WIDTH * fontSize;
+}
+int measureText(std::string_view text, int fontSize = 1);
+
+// The wrapping itself, uncached. layout should start out with no lines.
+void wrapText(std::string_view text, int boxWidth, int lineHeight, int fontSize, int align,
+              TextLayout& layout);
+
+// Word wraps text to a box width once and keeps the result, so drawing the
+// same string again doesn't measure, split or allocate anything. Lines break
+// at spaces and newlines; words too long for a line are split.
+class TextLayoutCache {
+public:
+    TextLayoutCache() : hitCount(0), missCount(0) {}
+
+    // The returned layout stays valid for the life of the cache
+    const TextLayout& layout(std::string_view text, int boxWidth, int lineHeight = FONT_HEIGHT,
+                             int fontSize = 1, int align = TEXT_ALIGN_LEFT);
+
+    int hits() const { return hitCount; }
+    int misses() const { return missCount; }
+    void printStats() const;
+
+private:
+    struct Entry {
+        std::string text;
+        int boxWidth, lineHeight, fontSize, align;
+        TextLayout layout;
+    };
+
+    // Keyed by a hash of the text and the box, entries never move once added.
+    // Hosted sessions share the cache, so lookups take the lock.
+    std::unordered_multimap<uint64_t, Entry> entries;
+    mutable std::mutex lock;
+    int hitCount;
+    int missCount;
+};
+
+class DrawList;
+
+// Write every line of a layout with its box at (x, y), in the current font color
+void drawTextLayout(DrawList& draw, const TextLayout& layout, int x, int y);
+
+extern TextLayoutCache textCache;
+
+#endif
@@ -0,0 +1,130 @@
+#include "tilecodec.h"
+
+static uint8_t* putColor(uint8_t* out, unsigned int color) {
+    out[0] = (uint8_t)(color >> 16);
+    out[1] = (uint8_t)(color >> 8);
+    out[2] = (uint8_t)color;
+    return out + 3;
+}
+
+static unsigned int getColor(const uint8_t* rgb) {
+    return 0xFF000000u | (unsigned)rgb[0] << 16 | rgb[1] << 8 | rgb[2];
+}
+
+// Twice the most colors a palette tile can have, so probes stay short
+#define PALETTE_SLOTS 512
+#define PALETTE_SLOT_SHIFT 23
+
+size_t encodeTile(const unsigned int* pixels, int stride, int width, int height, uint8_t* out) {
+    unsigned int palette[256];
+    uint8_t indices[TILE_CODEC_MAX_SIZE * TILE_CODEC_MAX_SIZE];
+    // Open addressed, palette index + 1 or 0 for empty
+    uint16_t slots[PALETTE_SLOTS] = {};
+    int colors = 0;
+    int count = 0;
+    int last = -1;
+    bool paletted = true;
+
+    // Screens are mostly flat fills and text, so a color is nearly always
+    // the one before it. Photos are the other way, and give up at 256.
+    for (int y = 0; y < height && paletted; y++) {
+        const unsigned int* row = pixels + (size_t)y * stride;
+        for (int x = 0; x < width; x++) {
+            unsigned int color = row[x] & 0xFFFFFF;
+            if (last < 0 || palette[last] != color) {
+                unsigned int slot = (color * 2654435761u) >> PALETTE_SLOT_SHIFT;
+                while (slots[slot] && palette[slots[slot] - 1] != color) {
+                    slot = (slot + 1) & (PALETTE_SLOTS - 1);
+                }
+                if (!slots[slot]) {
+                    if (colors == 256) {
+                        paletted = false;
+                        break;
+                    }
+                    palette[colors++] = color;
+                    slots[slot] = (uint16_t)colors;
+                }
+                last = slots[slot] - 1;
+            }
+            indices[count++] = (uint8_t)last;
+        }
+    }
+
+    int pixelCount = width * height;
+    if (paletted) {
+        int runs = 0;
+        for (int i = 0; i < pixelCount; runs++) {
+            int start = i;
+            while (i < pixelCount && indices[i] == indices[start] && i - start < 256) i++;
+        }
+        paletted = 2 + 3 * colors + 2 * runs <= 1 + 3 * pixelCount;
+        if (paletted) {
+            uint8_t* p = out;
+            *p++ = TILE_PALETTE;
+            *p++ = (uint8_t)(colors - 1);
+            for (int i = 0; i < colors; i++) p = putColor(p, palette[i]);
+            for (int i = 0; i < pixelCount;) {
+                int start = i;
+                while (i < pixelCount && indices[i] == indices[start] && i - start < 256) i++;
+                *p++ = (uint8_t)(i - start - 1);
+                *p++ = indices[start];
+            }
+            return p - out;
+        }
+    }
+
+    uint8_t* p = out;
+    *p++ = TILE_RAW;
+    for (int y = 0; y < height; y++) {
+        const unsigned int* row = pixels + (size_t)y * stride;
+        for (int x = 0; x < width; x++) p = putColor(p, row[x]);
+    }
+    return p - out;
+}
+
+size_t decodeTile(const uint8_t* data, size_t size, int width, int height,
+                  unsigned int* out, int stride) {
+    const uint8_t* p = data;
+    const uint8_t* end = data + size;
+    int pixelCount = width * height;
+    if (p >= end) return 0;
+    uint8_t encoding = *p++;
+
+    if (encoding == TILE_RAW) {
+        if (end - p < 3 * (ptrdiff_t)pixelCount) return 0;
+        for (int y = 0; y < height; y++) {
+            unsigned int* row = out + (size_t)y * stride;
+            for (int x = 0; x < width; x++, p += 3) row[x] = getColor(p);
+        }
+        return p - data;
+    }
+    if (encoding != TILE_PALETTE || p >= end) return 0;
+
+    int colors = *p++ + 1;
+    if (end - p < 3 * colors) return 0;
+    unsigned int palette[256];
+    for (int i = 0; i < colors; i++, p += 3) palette[i] = getColor(p);
+
+    // Runs carry on across rows
+    int x = 0;
+    unsigned int* row = out;
+    for (int i = 0; i < pixelCount;) {
+        if (end - p < 2 || p[1] >= colors) return 0;
+        int length = p[0] + 1;
+        unsigned int color = palette[p[1]];
+        p += 2;
+        if (i + length > pixelCount) return 0;
+        i += length;
+        while (length > 0) {
+            int span = width - x < length ? width - x : length;
+            for (int j = 0; j < span; j++) row[x + j] = color;
+            x += span;
+            length -= span;
+            if (x == width) {
+                x = 0;
+                row += stride;
+            }
+        }
+    }
+    return p - data;
+}
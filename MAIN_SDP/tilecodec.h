@@ -0,0 +1,34 @@
+#ifndef TILECODEC_H
+#define TILECODEC_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Compression for one small block of 0xAARRGGBB pixels, shared by the
+// spectator stream and world files. Alpha is dropped, decoded pixels are
+// opaque.
+//
+//   uint8  TILE_PALETTE: uint8 colors - 1, colors x RGB, then runs of
+//            uint8 length - 1, uint8 color covering the tile row by row
+//          TILE_RAW: RGB for every pixel, row by row
+// Tiles are palette coded unless that comes out bigger than raw.
+
+// Largest tile either side, worlds use the biggest
+#define TILE_CODEC_MAX_SIZE 64
+
+enum { TILE_PALETTE, TILE_RAW };
+
+// Most bytes encodeTile can write for width x height pixels
+inline size_t tileCodecMaxBytes(int width, int height) {
+    return 1 + 3 * (size_t)width * height;
+}
+
+// One width x height tile starting at pixels, returns the bytes written
+size_t encodeTile(const unsigned int* pixels, int stride, int width, int height, uint8_t* out);
+
+// The other way, into out with rows stride pixels apart. Returns the bytes
+// of data the tile took up, 0 if it doesn't decode to exactly width x height.
+size_t decodeTile(const uint8_t* data, size_t size, int width, int height,
+                  unsigned int* out, int stride);
+
+#endif
@@ -0,0 +1,218 @@
+// Weather and idle animation costs (see ambient.h): a check that every
+// particle kernel set matches the plain C++ one exactly, nanoseconds per
+// particle for each set, then whole biome frames with the layer up.
+//
+//   ambientbench [frames]     (default 600, 20 seconds at AMBIENT_FPS)
+//
+// The frame runs are repeated pretending the kiosk is 4, 8, 16 and 64 times
+// slower than this machine, to show where the frame budget settles the
+// particle count and how often the weather moves. Frame times are this
+// machine's own, so they drop as the budget sheds weather. Frames draw into a headless FEHLCD of their own and must
+// not touch the heap once the screen is up. Run from MAIN_SDP, it needs
+// content.pack and the biome images.
+
+#include "../ambient.h"
+#include "../alloccount.h"
+#include "../content.h"
+#include "../scene.h"
+#include "../session.h"
+#include "../imagecache.h"
+#include "../input.h"
+#include <FEHLCD.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#define DEFAULT_FRAMES 600
+// Odd on purpose, so the kernels' leftover loops get checked too
+#define CHECK_PARTICLES 4099
+#define CHECK_STEPS 200
+
+static volatile int sink;
+
+// Runs a pass enough times to take a measurable amount of time and
+// returns the average seconds per pass
+template <typename Pass>
+static double timePass(Pass pass) {
+    int runs = 1;
+    for (;;) {
+        double start = inputClock();
+        for (int i = 0; i < runs; i++) pass();
+        double elapsed = inputClock() - start;
+        if (elapsed > 0.1 || runs >= (1 << 20)) return elapsed / runs;
+        runs *= 2;
+    }
+}
+
+struct Particles {
+    std::vector<float> x, y, vx, vy, phase;
+    std::vector<int> offsets;
+
+    explicit Particles(int count) : x(count), y(count), vx(count), vy(count), phase(count), offsets(count) {
+        unsigned int seed = 1;
+        auto next = [&seed]() {
+            seed = seed * 1103515245u + 12345u;
+            return (seed >> 8) * (1.0f / 16777216.0f);
+        };
+        for (int i = 0; i < count; i++) {
+            x[i] = next() * 320;
+            y[i] = next() * 240;
+            vx[i] = next() * 300 - 100;
+            vy[i] = next() * 80 - 20;
+            phase[i] = next();
+        }
+    }
+};
+
+static ParticleStep screenStep(float dt) {
+    return ParticleStep{dt, 25, 0.6f, 320, 240, 1.0f / 320, 1.0f / 240};
+}
+
+// Every set run side by side with the scalar one, bit for bit
+static bool checkKernels() {
+    bool ok = true;
+    const ParticleKernels& scalar = particleKernelSet(0);
+    ParticleClip clip = {40, 30, 277, 197, 240};
+    for (int set = 1; set < particleKernelSetCount(); set++) {
+        const ParticleKernels& kernels = particleKernelSet(set);
+        Particles expected(CHECK_PARTICLES), got(CHECK_PARTICLES);
+        int mismatches = 0;
+        for (int step = 0; step < CHECK_STEPS; step++) {
+            // Uneven steps, like a real frame clock
+            ParticleStep move = screenStep(0.01f + 0.0007f * (step % 37));
+            scalar.advance(expected.x.data(), expected.y.data(), expected.phase.data(), expected.vx.data(),
+                           expected.vy.data(), CHECK_PARTICLES, move);
+            kernels.advance(got.x.data(), got.y.data(), got.phase.data(), got.vx.data(), got.vy.data(),
+                            CHECK_PARTICLES, move);
+            scalar.locate(expected.x.data(), expected.y.data(), expected.offsets.data(), CHECK_PARTICLES, clip);
+            kernels.locate(got.x.data(), got.y.data(), got.offsets.data(), CHECK_PARTICLES, clip);
+            if (memcmp(expected.x.data(), got.x.data(), CHECK_PARTICLES * sizeof(float)) ||
+                memcmp(expected.y.data(), got.y.data(), CHECK_PARTICLES * sizeof(float)) ||
+                memcmp(expected.phase.data(), got.phase.data(), CHECK_PARTICLES * sizeof(float)) ||
+                expected.offsets != got.offsets) {
+                mismatches++;
+            }
+        }
+        printf("%-8s %s\n", kernels.name, mismatches ? "DIFFERS from scalar" : "matches scalar");
+        if (mismatches) ok = false;
+    }
+    return ok;
+}
+
+static void timeKernels() {
+    printf("\n%-8s %9s %14s %14s\n", "set", "particles", "advance ns/p", "locate ns/p");
+    ParticleClip clip = {0, 0, 318, 238, 320};
+    for (int set = 0; set < particleKernelSetCount(); set++) {
+        const ParticleKernels& kernels = particleKernelSet(set);
+        for (int count : {1000, 2000, 4000}) {
+            Particles particles(count);
+            ParticleStep move = screenStep(1.0f / AMBIENT_FPS);
+            double advance = timePass([&] {
+                kernels.advance(particles.x.data(), particles.y.data(), particles.phase.data(),
+                                particles.vx.data(), particles.vy.data(), count, move);
+            });
+            double locate = timePass([&] {
+                kernels.locate(particles.x.data(), particles.y.data(), particles.offsets.data(), count, clip);
+                sink += particles.offsets[count / 2];
+            });
+            printf("%-8s %9d %14.2f %14.2f\n", kernels.name, count, advance * 1e9 / count, locate * 1e9 / count);
+        }
+    }
+
+    // Drawing them, with the set the game would pick
+    std::vector<unsigned int> pixels(320 * 240);
+    Canvas canvas = {pixels.data(), 0, 0, 320, 240};
+    printf("\ncompose (%s), one screen:\n", particleKernels().name);
+    for (Weather weather : {WEATHER_SAND, WEATHER_SNOW, WEATHER_LEAVES}) {
+        ParticleField field;
+        field.reset(weather, AMBIENT_MAX_PARTICLES, 1, 320, 240);
+        double compose = timePass([&] { field.compose(canvas); });
+        printf("  weather %d, %d particles: %.3f ms, %.2f ns per particle\n", weather, field.active(),
+               compose * 1e3, compose * 1e9 / field.active());
+    }
+}
+
+struct FrameRun {
+    double average;
+    int particles;
+    int weatherEvery;
+    int steadyAllocations;
+};
+
+// One biome screen with its weather and animals up for frames frames. The
+// frame time the budget sees is multiplied by slowdown.
+static FrameRun runFrames(const ContentPack& content, GameScreen screen, int frames, double slowdown) {
+    Scene scene;
+    const PackBiome* biome = content.findBiome(screen);
+    const char* image = content.string(biome->image);
+    scene.setBackground(image);
+
+    Weather weathers[] = {WEATHER_SAND, WEATHER_SNOW, WEATHER_LEAVES, WEATHER_NONE};
+    AmbientLayer layer;
+    layer.start(weathers[screen - DESERT_BIOME], screen);
+    if (const PngImage* background = imageCache.get(image)) {
+        for (int i = content.firstAnimal(*biome); i < content.endAnimal(*biome); i++) {
+            const char* name = content.string(content.animal(i).name);
+            const PackRect& rect = content.animalRect(i);
+            int first = spriteAtlas.find(name);
+            if (first < 0) {
+                first = addIdleFrames(spriteAtlas, *background, {rect.x, rect.y, rect.width, rect.height});
+                if (first < 0) continue;
+                spriteAtlas.name(name, first);
+            }
+            layer.addSprite(first, IDLE_FRAMES, 4, rect.x, rect.y);
+        }
+    }
+    scene.setAmbient(&layer);
+    scene.present();
+    LCD.Update();
+
+    double total = 0;
+    int steadyAllocations = 0;
+    for (int frame = 0; frame < frames; frame++) {
+        AllocationCounts before = threadAllocations();
+        double start = inputClock();
+        layer.update(1.0 / AMBIENT_FPS, scene);
+        scene.present();
+        LCD.Update();
+        double took = inputClock() - start;
+        layer.frameTook(took * slowdown);
+        // The first few frames size the scene's dirty lists
+        if (frame >= 4 && threadAllocations().allocations != before.allocations) steadyAllocations++;
+        total += took;
+    }
+    return FrameRun{total / frames, layer.particleCount(), layer.weatherEvery(), steadyAllocations};
+}
+
+int main(int argc, char** argv) {
+    int frames = argc > 1 ? atoi(argv[1]) : DEFAULT_FRAMES;
+    if (frames < 10) frames = 10;
+
+    bool ok = checkKernels();
+    timeKernels();
+
+    ContentPack content;
+    if (!content.open("content.pack")) return 1;
+    FEHLCD lcd(false);
+    activeLCD = &lcd;
+
+    printf("\nbiome frames, %d each, budget %.1f ms:\n", frames, AMBIENT_FRAME_BUDGET * 1e3);
+    printf("%-14s %9s %10s %10s %12s %12s\n", "screen", "slowdown", "frame ms", "particles", "moves every",
+           "allocating");
+    int allocating = 0;
+    for (GameScreen screen : {DESERT_BIOME, TUNDRA_BIOME, FOREST_BIOME, SAFARI_BIOME}) {
+        for (double slowdown : {1.0, 4.0, 8.0, 16.0, 64.0}) {
+            FrameRun run = runFrames(content, screen, frames, slowdown);
+            printf("%-14s %8.0fx %10.3f %10d %12d %12d\n", stateName(screen), slowdown, run.average * 1e3,
+                   run.particles, run.weatherEvery, run.steadyAllocations);
+            allocating += run.steadyAllocations;
+        }
+    }
+    printf("atlas: %d frames\n", spriteAtlas.frameCount());
+    if (allocating) {
+        printf("%d steady frames allocated\n", allocating);
+        ok = false;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,197 @@
+// Turns PNG assets into headers of constexpr palette + index arrays so the
+// game can be built without any image files (see embedded.h).
+//
+//   assetcompiler [--rle] <output dir> <image.png>...
+//
+// Writes one <output dir>/asset_<name>.h per image plus <output dir>/assets.h,
+// which includes them all and lists them in embeddedImages[]. With --rle
+// each image is run-length encoded when that comes out smaller.
+
+#include "../png.h"
+#include "../embedded.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <sys/stat.h>
+
+struct CompiledImage {
+    std::string file;
+    std::string ident;
+    int width, height;
+    int format;
+    std::vector<unsigned int> palette;
+    std::vector<unsigned int> data;  // indices or (count, index) pairs
+    size_t fileBytes;
+};
+
+static const char* formatNames[] = {"index8", "index16", "rle8", "rle16"};
+
+static size_t fileSize(const char* filename) {
+    struct stat info;
+    return stat(filename, &info) == 0 ? (size_t)info.st_size : 0;
+}
+
+static std::string identifierFor(const std::string& file) {
+    // Just the file name, without any directories
+    size_t slash = file.find_last_of("/\\");
+    std::string name = slash == std::string::npos ? file : file.substr(slash + 1);
+    std::string ident = "asset_";
+    for (char c : name) {
+        bool alnum = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+        ident += alnum ? c : '_';
+    }
+    return ident;
+}
+
+static size_t dataBytes(const CompiledImage& image) {
+    size_t entry = image.format == EMBED_INDEX8 || image.format == EMBED_RLE8 ? 1 : 2;
+    return image.data.size() * entry + image.palette.size() * sizeof(unsigned int);
+}
+
+static bool compileImage(const char* file, bool allowRle, CompiledImage& out) {
+    PngImage png;
+    if (!loadPng(file, png)) {
+        fprintf(stderr, "assetcompiler: can't decode %s\n", file);
+        return false;
+    }
+
+    out.file = file;
+    out.ident = identifierFor(file);
+    out.width = png.width;
+    out.height = png.height;
+    out.fileBytes = fileSize(file);
+
+    // Colors are numbered in the order they first show up
+    std::unordered_map<unsigned int, unsigned int> indexOf;
+    std::vector<unsigned int> indices(png.pixels.size());
+    for (size_t i = 0; i < png.pixels.size(); i++) {
+        auto it = indexOf.find(png.pixels[i]);
+        if (it == indexOf.end()) {
+            it = indexOf.emplace(png.pixels[i], (unsigned int)out.palette.size()).first;
+            out.palette.push_back(png.pixels[i]);
+        }
+        indices[i] = it->second;
+    }
+    if (out.palette.size() > 65536) {
+        fprintf(stderr, "assetcompiler: %s has %zu colors, at most 65536 fit\n", file, out.palette.size());
+        return false;
+    }
+
+    bool wide = out.palette.size() > 256;
+    unsigned int maxRun = wide ? 65535 : 255;
+    out.format = wide ? EMBED_INDEX16 : EMBED_INDEX8;
+    out.data = indices;
+
+    if (allowRle) {
+        std::vector<unsigned int> runs;
+        for (size_t i = 0; i < indices.size();) {
+            unsigned int count = 1;
+            while (i + count < indices.size() && indices[i + count] == indices[i] && count < maxRun) count++;
+            runs.push_back(count);
+            runs.push_back(indices[i]);
+            i += count;
+        }
+        if (runs.size() < indices.size()) {
+            out.format = wide ? EMBED_RLE16 : EMBED_RLE8;
+            out.data = runs;
+        }
+    }
+    return true;
+}
+
+static void writeArray(FILE* file, const char* type, const std::string& name,
+                       const std::vector<unsigned int>& values, bool hex) {
+    fprintf(file, "constexpr %s %s[%zu] = {", type, name.c_str(), values.size());
+    int perLine = hex ? 8 : 24;
+    for (size_t i = 0; i < values.size(); i++) {
+        if (i % perLine == 0) fprintf(file, "\n    ");
+        fprintf(file, hex ? "0x%08x," : "%u,", values[i]);
+    }
+    fprintf(file, "\n};\n\n");
+}
+
+static bool writeImageHeader(const std::string& dir, const CompiledImage& image) {
+    std::string path = dir + "/" + image.ident + ".h";
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        fprintf(stderr, "assetcompiler: can't write %s\n", path.c_str());
+        return false;
+    }
+
+    fprintf(file, "// Generated by tools/assetcompiler.cpp from %s, do not edit\n", image.file.c_str());
+    fprintf(file, "#pragma once\n#include \"embedded.h\"\n\n");
+    writeArray(file, "unsigned int", image.ident + "_palette", image.palette, true);
+    bool narrow = image.format == EMBED_INDEX8 || image.format == EMBED_RLE8;
+    writeArray(file, narrow ? "unsigned char" : "unsigned short", image.ident + "_data", image.data, false);
+
+    // The name the game asks for is the file name without directories
+    size_t slash = image.file.find_last_of("/\\");
+    std::string name = slash == std::string::npos ? image.file : image.file.substr(slash + 1);
+    fprintf(file, "constexpr EmbeddedImage %s = {\n", image.ident.c_str());
+    fprintf(file, "    \"%s\", %d, %d, %d,\n", name.c_str(), image.width, image.height, image.format);
+    fprintf(file, "    %s_palette, %zu,\n", image.ident.c_str(), image.palette.size());
+    fprintf(file, "    %s_data, %zu\n};\n", image.ident.c_str(), image.data.size());
+    fclose(file);
+    return true;
+}
+
+static bool writeIndexHeader(const std::string& dir, const std::vector<CompiledImage>& images) {
+    std::string path = dir + "/assets.h";
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        fprintf(stderr, "assetcompiler: can't write %s\n", path.c_str());
+        return false;
+    }
+    fprintf(file, "// Generated by tools/assetcompiler.cpp, do not edit\n#pragma once\n\n");
+    for (const auto& image : images) {
+        fprintf(file, "#include \"%s.h\"\n", image.ident.c_str());
+    }
+    fprintf(file, "\nconstexpr EmbeddedImage embeddedImages[] = {\n");
+    for (const auto& image : images) {
+        fprintf(file, "    %s,\n", image.ident.c_str());
+    }
+    fprintf(file, "};\n");
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    bool allowRle = false;
+    int arg = 1;
+    if (arg < argc && strcmp(argv[arg], "--rle") == 0) {
+        allowRle = true;
+        arg++;
+    }
+    if (argc - arg < 2) {
+        fprintf(stderr, "usage: assetcompiler [--rle] <output dir> <image.png>...\n");
+        return 1;
+    }
+    std::string dir = argv[arg++];
+    mkdir(dir.c_str(), 0755);
+
+    std::vector<CompiledImage> images;
+    for (; arg < argc; arg++) {
+        CompiledImage image;
+        if (!compileImage(argv[arg], allowRle, image) || !writeImageHeader(dir, image)) return 1;
+        images.push_back(std::move(image));
+    }
+    if (!writeIndexHeader(dir, images)) return 1;
+
+    size_t totalFile = 0, totalDecoded = 0, totalEmbedded = 0;
+    printf("%-16s %9s %7s %8s %10s %10s %10s\n",
+           "Asset", "Size", "Colors", "Format", "PNG bytes", "Decoded", "Embedded");
+    for (const auto& image : images) {
+        size_t decoded = (size_t)image.width * image.height * sizeof(unsigned int);
+        char size[32];
+        snprintf(size, sizeof(size), "%dx%d", image.width, image.height);
+        printf("%-16s %9s %7zu %8s %10zu %10zu %10zu\n", image.ident.c_str() + 6, size,
+               image.palette.size(), formatNames[image.format], image.fileBytes, decoded, dataBytes(image));
+        totalFile += image.fileBytes;
+        totalDecoded += decoded;
+        totalEmbedded += dataBytes(image);
+    }
+    printf("%-16s %9s %7s %8s %10zu %10zu %10zu\n", "total", "", "", "", totalFile, totalDecoded, totalEmbedded);
+    return 0;
+}
@@ -0,0 +1,109 @@
+// Throughput of each blit kernel set this CPU can run, in megapixels per
+// second, plus a check that every set matches the plain C++ one exactly.
+//
+//   blitbench [width height]     (default 320 240, one screen)
+
+#include "../blit.h"
+#include "benchclock.h"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static volatile unsigned int sink;
+
+// Runs a pass enough times to take a measurable amount of time and
+// returns the average seconds per pass
+template <typename Pass>
+static double timePass(Pass pass) {
+    int runs = 1;
+    for (;;) {
+        double start = benchClock();
+        for (int i = 0; i < runs; i++) pass();
+        double elapsed = benchClock() - start;
+        if (elapsed > 0.1 || runs >= (1 << 20)) return elapsed / runs;
+        runs *= 2;
+    }
+}
+
+int main(int argc, char** argv) {
+    int width = argc > 2 ? atoi(argv[1]) : 320;
+    int height = argc > 2 ? atoi(argv[2]) : 240;
+    if (width <= 0 || height <= 0) {
+        fprintf(stderr, "usage: blitbench [width height]\n");
+        return 1;
+    }
+    int count = width * height;
+
+    // A 256 color palette, 8 and 16 bit index images, an opaque background
+    // and a sprite with a mix of transparent, opaque and in between pixels
+    srand(1);
+    std::vector<unsigned int> palette(65536);
+    for (auto& color : palette) color = 0xff000000 | ((unsigned int)rand() & 0xffffff);
+    std::vector<unsigned char> indices8(count);
+    std::vector<unsigned short> indices16(count);
+    std::vector<unsigned int> background(count), sprite(count);
+    for (int i = 0; i < count; i++) {
+        indices8[i] = (unsigned char)rand();
+        indices16[i] = (unsigned short)rand();
+        background[i] = 0xff000000 | ((unsigned int)rand() & 0xffffff);
+        unsigned int alphas[] = {0, 255, (unsigned int)rand() & 0xff};
+        sprite[i] = alphas[rand() % 3] << 24 | ((unsigned int)rand() & 0xffffff);
+    }
+
+    std::vector<unsigned int> out(count), expected(count);
+    const BlitKernels& reference = blitKernelSet(0);
+
+    printf("%dx%d pixels, kernels in use: %s\n\n", width, height, blitKernels().name);
+    printf("%-8s %10s %10s %10s %10s %10s   %s\n", "MP/s", "expand8", "expand16", "copy", "fill", "blend", "matches");
+
+    for (int s = 0; s < blitKernelSetCount(); s++) {
+        const BlitKernels& kernels = blitKernelSet(s);
+
+        // Same output as the scalar set for every kernel
+        bool same = true;
+        auto check = [&]() {
+            for (int i = 0; i < count; i++) same = same && out[i] == expected[i];
+        };
+        reference.expand8(indices8.data(), palette.data(), expected.data(), count);
+        kernels.expand8(indices8.data(), palette.data(), out.data(), count);
+        check();
+        reference.expand16(indices16.data(), palette.data(), expected.data(), count);
+        kernels.expand16(indices16.data(), palette.data(), out.data(), count);
+        check();
+        expected = background;
+        out = background;
+        reference.blend(sprite.data(), expected.data(), count);
+        kernels.blend(sprite.data(), out.data(), count);
+        check();
+
+        double expand8 = timePass([&]() {
+            kernels.expand8(indices8.data(), palette.data(), out.data(), count);
+            sink += out[0];
+        });
+        double expand16 = timePass([&]() {
+            kernels.expand16(indices16.data(), palette.data(), out.data(), count);
+            sink += out[0];
+        });
+        double copy = timePass([&]() {
+            kernels.copy(background.data(), out.data(), count);
+            sink += out[0];
+        });
+        double fill = timePass([&]() {
+            kernels.fill(0xff336699, out.data(), count);
+            sink += out[0];
+        });
+        // Blending into the same buffer over and over changes nothing about
+        // the work done per pixel, so there's no need to reset it
+        double blend = timePass([&]() {
+            kernels.blend(sprite.data(), out.data(), count);
+            sink += out[0];
+        });
+
+        double megapixels = count / 1e6;
+        printf("%-8s %10.0f %10.0f %10.0f %10.0f %10.0f   %s\n", kernels.name,
+               megapixels / expand8, megapixels / expand16, megapixels / copy,
+               megapixels / fill, megapixels / blend, same ? "yes" : "NO");
+        if (!same) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,209 @@
+// Measures what it costs to scan a biome's animals with the old layout,
+// where every ClickableRegion carried its geometry, visited flag and all of
+// its text, against the content pack layout, where geometry and visited
+// bits are packed on their own and the text lives in a separate table.
+//
+//   entitybench [animals]     (default 10000)
+
+#include "../content.h"
+#include "../hitmap.h"
+#include "../progress.h"
+#include "benchclock.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// How animals were stored before the content pack
+struct LegacyRegion {
+    int x, y, width, height;
+    std::string name;
+    std::string question;
+    std::string correct_answer;
+    std::vector<std::string> answers;
+    bool visited;
+};
+
+// Hit map id of the first animal
+#define FIRST_ID 1
+
+// Touches per hit test pass
+#define TOUCHES 1000
+
+static volatile long long sink;
+
+// Runs a pass enough times to take a measurable amount of time and
+// returns the average seconds per pass
+template <typename Pass>
+static double timePass(Pass pass) {
+    int runs = 1;
+    for (;;) {
+        double start = benchClock();
+        for (int i = 0; i < runs; i++) sink += pass();
+        double elapsed = benchClock() - start;
+        if (elapsed > 0.05 || runs >= (1 << 20)) return elapsed / runs;
+        runs *= 2;
+    }
+}
+
+// Same, but with the caches flushed before every pass, which is closer to
+// a single scan when the player touches the screen
+static std::vector<char> evictBuffer(64 << 20);
+
+template <typename Pass>
+static double timeColdPass(Pass pass) {
+    const int runs = 20;
+    double total = 0;
+    for (int i = 0; i < runs; i++) {
+        for (size_t b = 0; b < evictBuffer.size(); b += 64) evictBuffer[b]++;
+        double start = benchClock();
+        sink += pass();
+        total += benchClock() - start;
+    }
+    return total / runs;
+}
+
+static void report(const char* name, double legacy, double packed, int items) {
+    printf("%-24s %12.1f %12.1f %9.1fx\n", name,
+           legacy * 1e9 / items, packed * 1e9 / items, legacy / packed);
+}
+
+int main(int argc, char** argv) {
+    int count = argc > 1 ? atoi(argv[1]) : 10000;
+    if (count <= 0 || count >= 65535 - FIRST_ID) {
+        fprintf(stderr, "usage: entitybench [animals]  (1-65000)\n");
+        return 1;
+    }
+
+    // Same animals in both layouts: small boxes scattered over the screen,
+    // every third one visited, four answers each
+    srand(1);
+    std::vector<LegacyRegion> legacy(count);
+    std::vector<PackRect> rects(count);
+    std::vector<PackAnimal> animals(count);
+    Progress progress;
+    progress.reset(count);
+    for (int i = 0; i < count; i++) {
+        PackRect rect = {(int32_t)(rand() % 300), (int32_t)(rand() % 200), 16, 16};
+        rects[i] = rect;
+        animals[i] = PackAnimal{};
+        animals[i].answerCount = 4;
+        animals[i].correctAnswer = (uint16_t)(i % 4);
+
+        LegacyRegion& region = legacy[i];
+        region.x = rect.x;
+        region.y = rect.y;
+        region.width = rect.width;
+        region.height = rect.height;
+        region.name = "Animal number " + std::to_string(i);
+        region.question = "Which of these is true about animal number " + std::to_string(i) + "?";
+        for (int a = 0; a < 4; a++) {
+            region.answers.push_back("Answer " + std::to_string(a) + " for animal " + std::to_string(i));
+        }
+        region.correct_answer = region.answers[i % 4];
+        region.visited = i % 3 == 0;
+        if (region.visited) progress.markVisited(i);
+    }
+
+    std::vector<float> touchX(TOUCHES), touchY(TOUCHES);
+    std::vector<int> picked(TOUCHES);
+    for (int t = 0; t < TOUCHES; t++) {
+        touchX[t] = (float)(rand() % 320);
+        touchY[t] = (float)(rand() % 240);
+        picked[t] = rand() % 4;
+    }
+
+    printf("%d animals, %zu bytes per legacy region, %zu bytes of geometry per packed animal\n\n",
+           count, sizeof(LegacyRegion), sizeof(PackRect));
+    printf("%-24s %12s %12s %10s\n", "ns per item", "legacy", "packed", "speedup");
+
+    // Topmost animal under each touch, which means looking at all of them.
+    // Written without branches so it measures memory traffic rather than
+    // branch misses.
+    auto legacyScanPass = [&](int touches) {
+        long long found = 0;
+        for (int t = 0; t < touches; t++) {
+            int hit = -1, x = (int)touchX[t], y = (int)touchY[t];
+            for (int i = 0; i < count; i++) {
+                const LegacyRegion& r = legacy[i];
+                bool inside = (x >= r.x) & (x <= r.x + r.width) & (y >= r.y) & (y <= r.y + r.height);
+                hit = inside ? i : hit;
+            }
+            found += hit;
+        }
+        return found;
+    };
+    auto packedScanPass = [&](int touches) {
+        long long found = 0;
+        for (int t = 0; t < touches; t++) {
+            int hit = -1, x = (int)touchX[t], y = (int)touchY[t];
+            for (int i = 0; i < count; i++) {
+                const PackRect& r = rects[i];
+                bool inside = (x >= r.x) & (x <= r.x + r.width) & (y >= r.y) & (y <= r.y + r.height);
+                hit = inside ? i : hit;
+            }
+            found += hit;
+        }
+        return found;
+    };
+    double legacyScan = timePass([&]() { return legacyScanPass(TOUCHES); });
+    double packedScan = timePass([&]() { return packedScanPass(TOUCHES); });
+    report("hit test scan", legacyScan, packedScan, count * TOUCHES);
+    report("hit test scan (cold)", timeColdPass([&]() { return legacyScanPass(1); }),
+           timeColdPass([&]() { return packedScanPass(1); }), count);
+
+    // Progress through the biome
+    double legacyProgress = timePass([&]() {
+        long long visited = 0;
+        for (const auto& region : legacy) visited += region.visited;
+        return visited;
+    });
+    double packedProgress = timePass([&]() {
+        return (long long)progress.countVisited(0, count);
+    });
+    report("progress scan", legacyProgress, packedProgress, count);
+    report("progress scan (cold)", timeColdPass([&]() {
+        long long visited = 0;
+        for (const auto& region : legacy) visited += region.visited;
+        return visited;
+    }), timeColdPass([&]() {
+        return (long long)progress.countVisited(0, count);
+    }), count);
+
+    // Checking one picked answer per animal
+    double legacyCheck = timePass([&]() {
+        long long correct = 0;
+        for (int i = 0; i < count; i++) {
+            const LegacyRegion& region = legacy[i];
+            correct += region.answers[picked[i % TOUCHES]] == region.correct_answer;
+        }
+        return correct;
+    });
+    double packedCheck = timePass([&]() {
+        long long correct = 0;
+        for (int i = 0; i < count; i++) {
+            correct += picked[i % TOUCHES] == animals[i].correctAnswer;
+        }
+        return correct;
+    });
+    report("answer check", legacyCheck, packedCheck, count);
+
+    // What the game actually does now: build the hit map once per screen,
+    // then one lookup per touch
+    HitMap map;
+    double build = timePass([&]() {
+        map.clear();
+        for (int i = count - 1; i >= 0; i--) {
+            map.addRect(FIRST_ID + i, rects[i].x, rects[i].y, rects[i].width, rects[i].height);
+        }
+        return 0LL;
+    });
+    double lookup = timePass([&]() {
+        long long found = 0;
+        for (int t = 0; t < TOUCHES; t++) found += map.lookup(touchX[t], touchY[t]);
+        return found;
+    });
+    printf("\nhit map: %.3f ms to build, %.1f ns per touch (vs %.3f ms per touch scanning)\n",
+           build * 1e3, lookup * 1e9 / TOUCHES, packedScan * 1e3 / TOUCHES);
+    return 0;
+}
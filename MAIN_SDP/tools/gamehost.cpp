@@ -0,0 +1,242 @@
+// Runs many independent game sessions in one process, the way one box would
+// serve a classroom of thin clients. Every session has its own game state,
+// progress, stats, scene, hit map, timers and framebuffer. The content pack,
+// decoded images and text layouts are shared.
+//
+//   gamehost [sessions] [threads] [touch log]
+//       (default 32 sessions, one thread per core, replays/desert_round.txt)
+//
+// Each session plays the touch log back on its own virtual clock as fast as
+// it can. Sessions are spread over a work-stealing pool: every worker keeps
+// its own deque of sessions, runs one frame of the session at the bottom and
+// puts it back there, and a worker that runs dry steals from the top of
+// somebody else's. Headless build only, since sessions draw into their own
+// FEHLCD through activeLCD.
+
+#include "../session.h"
+#include "../replay.h"
+#include "../imagecache.h"
+#include "../textlayout.h"
+#include "../input.h"
+#include <FEHLCD.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#define CONTENT_PACK_FILE "content.pack"
+#define DEFAULT_SESSIONS 32
+#define DEFAULT_TOUCH_LOG "replays/desert_round.txt"
+
+// One player. Members are built in order, the game last since it hangs on to the rest.
+class HostedSession {
+public:
+    HostedSession(const ContentPack& content, const std::vector<TouchEvent>& events, uint64_t seed)
+        : lcd(false), game(content, scene, hitMap, scheduler, stats),
+          events(events), next(0), frames(0), lastX(0), lastY(0) {
+        scheduler.setVirtualClock(true);
+        game.review.setSeed(seed);
+    }
+
+    // Run up to and including the next frame. False once the touch log has
+    // run out and nothing is left to draw or wait for.
+    bool step();
+
+    uint64_t framebufferHash() const;
+
+    FEHLCD lcd;
+    Scene scene;
+    HitMap hitMap;
+    Scheduler scheduler;
+    StatsStore stats;
+    GameSession game;
+
+    const std::vector<TouchEvent>& events;
+    size_t next;
+    int frames;
+    float lastX, lastY;  // where the finger was last seen, for drags
+};
+
+bool HostedSession::step() {
+    activeLCD = &lcd;
+    for (;;) {
+        bool stateChanged = game.needsFrame();
+        if (!stateChanged && !scheduler.pending() && next >= events.size()) return false;
+
+        // Same as waitGameEvent on a virtual clock: jump to the next touch or
+        // timer, or only take what's already due if a frame is waiting
+        bool pressed = false;
+        TouchEvent event = {TOUCH_PRESS, -1, -1, 0};
+        double current = scheduler.now();
+        double due = scheduler.nextDue();
+        if (next < events.size() && (due < 0 || events[next].time <= due) &&
+            (!stateChanged || events[next].time <= current)) {
+            event = events[next++];
+            scheduler.advanceTo(event.time);
+            pressed = event.type == TOUCH_PRESS;
+            if (event.type == TOUCH_DRAG) game.drag(event.x - lastX, event.y - lastY);
+            if (event.type != TOUCH_RELEASE) {
+                lastX = event.x;
+                lastY = event.y;
+            }
+        } else if (due >= 0 && (!stateChanged || due <= current)) {
+            scheduler.advanceTo(due);
+        }
+
+        bool timersRan = scheduler.runDue() > 0;
+        if (!pressed && !timersRan && !game.needsFrame()) continue;
+
+        game.frame(pressed ? event.x : -1, pressed ? event.y : -1);
+        frames++;
+        return true;
+    }
+}
+
+uint64_t HostedSession::framebufferHash() const {
+    uint64_t hash = 1469598103934665603ull;
+    const unsigned int* pixels = lcd.Framebuffer();
+    for (int i = 0; i < FEHLCD::LCD_WIDTH * FEHLCD::LCD_HEIGHT; i++) {
+        hash = (hash ^ pixels[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+struct Worker {
+    std::mutex lock;
+    std::deque<HostedSession*> sessions;
+    long long frames = 0;
+    long long steals = 0;
+};
+
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(int threads) : workers(threads), remaining(0) {
+        for (auto& worker : workers) worker.reset(new Worker());
+    }
+
+    // Deal sessions out round robin, then run until every one has finished
+    void run(std::vector<std::unique_ptr<HostedSession>>& sessions);
+
+    int threadCount() const { return (int)workers.size(); }
+    const Worker& worker(int index) const { return *workers[index]; }
+
+private:
+    void runWorker(int index);
+    HostedSession* take(int index);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<int> remaining;
+};
+
+void WorkStealingPool::run(std::vector<std::unique_ptr<HostedSession>>& sessions) {
+    for (size_t i = 0; i < sessions.size(); i++) {
+        workers[i % workers.size()]->sessions.push_back(sessions[i].get());
+    }
+    remaining = (int)sessions.size();
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < threadCount(); i++) threads.emplace_back(&WorkStealingPool::runWorker, this, i);
+    runWorker(0);
+    for (auto& thread : threads) thread.join();
+}
+
+HostedSession* WorkStealingPool::take(int index) {
+    Worker& own = *workers[index];
+    {
+        // Own work comes off the bottom, where the last session run went back
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.sessions.empty()) {
+            HostedSession* session = own.sessions.back();
+            own.sessions.pop_back();
+            return session;
+        }
+    }
+
+    // Steal from the top of the others, starting after ourselves so thieves spread out
+    for (int i = 1; i < threadCount(); i++) {
+        Worker& victim = *workers[(index + i) % threadCount()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.sessions.empty()) {
+            HostedSession* session = victim.sessions.front();
+            victim.sessions.pop_front();
+            own.steals++;
+            return session;
+        }
+    }
+    return nullptr;
+}
+
+void WorkStealingPool::runWorker(int index) {
+    Worker& own = *workers[index];
+    while (remaining.load(std::memory_order_acquire) > 0) {
+        HostedSession* session = take(index);
+        if (!session) {
+            // Everything left is being run by someone else right now
+            std::this_thread::yield();
+            continue;
+        }
+        if (session->step()) {
+            own.frames++;
+            std::lock_guard<std::mutex> guard(own.lock);
+            own.sessions.push_back(session);
+        } else {
+            remaining.fetch_sub(1, std::memory_order_release);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    int sessionCount = argc > 1 ? atoi(argv[1]) : DEFAULT_SESSIONS;
+    int threads = argc > 2 ? atoi(argv[2]) : (int)std::thread::hardware_concurrency();
+    const char* logFile = argc > 3 ? argv[3] : DEFAULT_TOUCH_LOG;
+    if (threads <= 0) threads = 1;
+    if (sessionCount <= 0) {
+        fprintf(stderr, "usage: gamehost [sessions] [threads] [touch log]\n");
+        return 1;
+    }
+
+    ContentPack content;
+    if (!content.open(CONTENT_PACK_FILE)) return 1;
+    std::vector<TouchEvent> events;
+    uint64_t seed;
+    if (!loadTouchLog(logFile, events, &seed)) return 1;
+
+    std::vector<std::unique_ptr<HostedSession>> sessions;
+    for (int i = 0; i < sessionCount; i++) {
+        sessions.emplace_back(new HostedSession(content, events, seed));
+    }
+
+    WorkStealingPool pool(threads);
+    double start = inputClock();
+    pool.run(sessions);
+    double wall = inputClock() - start;
+
+    long long frames = 0;
+    std::set<uint64_t> endings;
+    for (const auto& session : sessions) {
+        frames += session->frames;
+        endings.insert(session->framebufferHash());
+    }
+
+    printf("%d sessions of %s on %d threads: %lld frames in %.3f s (%.1f frames/s)\n",
+           sessionCount, logFile, threads, frames, wall, wall > 0 ? frames / wall : 0.0);
+    printf("%-8s %10s %10s\n", "Thread", "Frames", "Steals");
+    for (int i = 0; i < pool.threadCount(); i++) {
+        printf("%-8d %10lld %10lld\n", i, pool.worker(i).frames, pool.worker(i).steals);
+    }
+    imageCache.printStats();
+    textCache.printStats();
+
+    // Same touches in every session, so they all have to end on the same screen
+    if (endings.size() != 1) {
+        printf("Sessions ended on %zu different screens, they are not isolated\n", endings.size());
+        return 1;
+    }
+    printf("Every session ended on the same screen (%016llx)\n", (unsigned long long)*endings.begin());
+    return 0;
+}
@@ -0,0 +1,270 @@
+// Times the game's hot functions one at a time, so a slowdown shows up
+// against the function that caused it rather than somewhere in a replay.
+// Everything draws into a headless FEHLCD of its own, nothing is shown.
+//
+// Each benchmark is warmed up first (image and text caches filled, prefetch
+// threads started), then timed over a number of repetitions of a batch big
+// enough to measure. The median is what gets compared.
+//
+//   microbench [--json results.json] [--baseline old.json] [--threshold percent]
+//              [--reps n] [name filter]
+//
+// With --baseline, every benchmark is compared against the same one in an
+// earlier --json file and the run fails if any median got slower by more
+// than the threshold (default 10%). Run from MAIN_SDP, it loads
+// content.pack and the images from there.
+
+#include "../session.h"
+#include "../png.h"
+#include "../imagecache.h"
+#include "../drawlist.h"
+#include "../textlayout.h"
+#include "../input.h"
+#include <FEHLCD.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+// Warm up this long before timing anything
+#define WARMUP_SECONDS 0.05
+// Aim for each repetition to take about this long
+#define REPETITION_SECONDS 0.02
+#define DEFAULT_REPETITIONS 15
+#define DEFAULT_THRESHOLD 10.0
+
+// Touches per hit map pass
+#define TOUCHES 1000
+
+// Full screen background for the image benchmarks
+#define BENCH_IMAGE "desert.png"
+
+static volatile long long sink;
+
+struct BenchResult {
+    std::string name;
+    double median, min, mean, stddev;  // ns per call
+    int repetitions;
+    long iterations;  // calls per repetition
+};
+
+static BenchResult measure(const std::string& name, int repetitions, const std::function<void()>& pass) {
+    // Warm up, and find a batch size that takes long enough to time
+    long iterations = 1;
+    double warmupEnd = inputClock() + WARMUP_SECONDS;
+    for (;;) {
+        double start = inputClock();
+        for (long i = 0; i < iterations; i++) pass();
+        double elapsed = inputClock() - start;
+        if (inputClock() >= warmupEnd && elapsed >= REPETITION_SECONDS) break;
+        if (elapsed < REPETITION_SECONDS) iterations *= 2;
+    }
+
+    std::vector<double> times;
+    for (int rep = 0; rep < repetitions; rep++) {
+        double start = inputClock();
+        for (long i = 0; i < iterations; i++) pass();
+        times.push_back((inputClock() - start) * 1e9 / iterations);
+    }
+    std::sort(times.begin(), times.end());
+
+    BenchResult result;
+    result.name = name;
+    result.repetitions = repetitions;
+    result.iterations = iterations;
+    result.min = times.front();
+    result.median = times.size() % 2 ? times[times.size() / 2]
+                                     : (times[times.size() / 2 - 1] + times[times.size() / 2]) / 2;
+    double sum = 0, squares = 0;
+    for (double t : times) sum += t;
+    result.mean = sum / times.size();
+    for (double t : times) squares += (t - result.mean) * (t - result.mean);
+    result.stddev = std::sqrt(squares / times.size());
+    return result;
+}
+
+static bool writeJson(const char* path, const std::vector<BenchResult>& results) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "microbench: can't write %s\n", path);
+        return false;
+    }
+    // One benchmark per line, which is all readBaseline expects
+    fprintf(file, "{\"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        fprintf(file, "  {\"name\": \"%s\", \"median_ns\": %.1f, \"min_ns\": %.1f, \"mean_ns\": %.1f, "
+                      "\"stddev_ns\": %.1f, \"repetitions\": %d, \"iterations\": %ld}%s\n",
+                r.name.c_str(), r.median, r.min, r.mean, r.stddev, r.repetitions, r.iterations,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "]}\n");
+    fclose(file);
+    return true;
+}
+
+// Medians by name from a file writeJson wrote
+static bool readBaseline(const char* path, std::map<std::string, double>& medians) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "microbench: can't read %s\n", path);
+        return false;
+    }
+    char line[512];
+    while (fgets(line, sizeof(line), file)) {
+        char name[128];
+        double median;
+        if (sscanf(line, " {\"name\": \"%127[^\"]\", \"median_ns\": %lf", name, &median) == 2) {
+            medians[name] = median;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const char* jsonPath = nullptr;
+    const char* baselinePath = nullptr;
+    const char* filter = nullptr;
+    double threshold = DEFAULT_THRESHOLD;
+    int repetitions = DEFAULT_REPETITIONS;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--json") && hasValue) jsonPath = argv[++i];
+        else if (!strcmp(argv[i], "--baseline") && hasValue) baselinePath = argv[++i];
+        else if (!strcmp(argv[i], "--threshold") && hasValue) threshold = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--reps") && hasValue) repetitions = atoi(argv[++i]);
+        else if (argv[i][0] != '-') filter = argv[i];
+        else {
+            fprintf(stderr, "usage: microbench [--json results.json] [--baseline old.json] "
+                            "[--threshold percent] [--reps n] [name filter]\n");
+            return 1;
+        }
+    }
+    if (repetitions < 1) repetitions = 1;
+
+    ContentPack content;
+    if (!content.open("content.pack")) return 1;
+    int animals = content.animalCount();
+
+    // A session of its own on a stub LCD, like the session host's
+    FEHLCD lcd(false);
+    activeLCD = &lcd;
+    Scene scene;
+    HitMap hits;
+    Scheduler timers;
+    timers.setVirtualClock(true);
+    // Never opened, so nothing here writes stats to disk
+    StatsStore playerStats;
+    GameSession game(content, scene, hits, timers, playerStats);
+
+    std::vector<unsigned char> imageFile;
+    if (FILE* file = fopen(BENCH_IMAGE, "rb")) {
+        unsigned char buffer[65536];
+        size_t got;
+        while ((got = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            imageFile.insert(imageFile.end(), buffer, buffer + got);
+        }
+        fclose(file);
+    }
+    PngImage image;
+    if (!decodePng(imageFile.data(), imageFile.size(), image)) {
+        fprintf(stderr, "microbench: can't decode %s\n", BENCH_IMAGE);
+        return 1;
+    }
+    DrawList imageDraw;
+
+    int question = 0;
+    unsigned int touch = 1;
+    std::vector<std::pair<const char*, std::function<void()>>> benchmarks = {
+        // drawQuestion's word wrap, uncached and through the layout cache
+        {"wrap.question", [&] {
+            TextLayout layout;
+            wrapText(content.string(content.animal(question).question), QUESTION_TEXT_WIDTH,
+                     QUESTION_LINE_HEIGHT, 1, TEXT_ALIGN_LEFT, layout);
+            sink += layout.lines.size();
+            question = (question + 1) % animals;
+        }},
+        {"wrap.cached", [&] {
+            sink += textCache.layout(content.string(content.animal(question).question),
+                                     QUESTION_TEXT_WIDTH, QUESTION_LINE_HEIGHT).height;
+            question = (question + 1) % animals;
+        }},
+        // Building a whole screen and pushing it to the LCD
+        {"screen.mainMenu", [&] {
+            game.resumeAt(MAIN_MENU);
+            sink += game.frame(-1, -1);
+        }},
+        {"screen.biome", [&] {
+            game.resumeAt(DESERT_BIOME);
+            sink += game.frame(-1, -1);
+        }},
+        {"screen.question", [&] {
+            game.gameState.currentQuestion = question;
+            game.resumeAt(QUESTION_STATE);
+            sink += game.frame(-1, -1);
+            question = (question + 1) % animals;
+        }},
+        // Which animal a touch landed on, over the desert's hit map
+        {"hitmap.lookup", [&] {
+            if (game.screen() != DESERT_BIOME) {
+                game.resumeAt(DESERT_BIOME);
+                game.frame(-1, -1);
+            }
+            long found = 0;
+            for (int i = 0; i < TOUCHES; i++) {
+                touch = touch * 1103515245u + 12345u;
+                found += hits.lookup((float)(touch >> 8 & 511) * 320 / 512,
+                                     (float)(touch >> 20 & 255) * 240 / 256);
+            }
+            sink += found;
+        }},
+        // The image loading that used to happen on every draw
+        {"png.decode", [&] {
+            PngImage decoded;
+            sink += decodePng(imageFile.data(), imageFile.size(), decoded);
+        }},
+        {"image.draw", [&] {
+            drawImage(imageDraw, image, 0, 0);
+            imageDraw.submit();
+            sink += lcd.FrameCount();
+        }},
+    };
+
+    std::vector<BenchResult> results;
+    for (const auto& benchmark : benchmarks) {
+        if (filter && !strstr(benchmark.first, filter)) continue;
+        results.push_back(measure(benchmark.first, repetitions, benchmark.second));
+        const BenchResult& r = results.back();
+        printf("%-16s %12.1f ns median  %12.1f min  +-%5.1f%%  (%d x %ld)\n", r.name.c_str(), r.median,
+               r.min, r.mean > 0 ? r.stddev * 100 / r.mean : 0.0, r.repetitions, r.iterations);
+    }
+    imageCache.stopPrefetch();
+
+    if (jsonPath && !writeJson(jsonPath, results)) return 1;
+
+    int regressions = 0;
+    if (baselinePath) {
+        std::map<std::string, double> baseline;
+        if (!readBaseline(baselinePath, baseline)) return 1;
+        printf("\nAgainst %s (fails above +%.0f%%):\n", baselinePath, threshold);
+        for (const BenchResult& r : results) {
+            auto old = baseline.find(r.name);
+            if (old == baseline.end() || old->second <= 0) {
+                printf("%-16s %12s\n", r.name.c_str(), "new");
+                continue;
+            }
+            double change = (r.median - old->second) * 100 / old->second;
+            bool regressed = change > threshold;
+            if (regressed) regressions++;
+            printf("%-16s %12.1f -> %12.1f ns  %+6.1f%%%s\n", r.name.c_str(), old->second, r.median,
+                   change, regressed ? "  SLOWER" : "");
+        }
+    }
+    return regressions > 0 ? 1 : 0;
+}
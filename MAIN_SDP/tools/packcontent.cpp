@@ -0,0 +1,251 @@
+// Compiles the human-editable content source (content/animals.txt) into the
+// binary content pack the game maps at startup. See content.h for the layout.
+//
+//   packcontent <source.txt> <output.pack>
+
+#include "../content.h"
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <map>
+
+struct SourceAnimal {
+    PackRect rect;
+    PackAnimal pack;
+    std::vector<uint32_t> answers;
+    int correct;
+    int line;
+};
+
+struct SourceBiome {
+    PackBiome pack;
+    std::vector<SourceAnimal> animals;
+};
+
+class StringPool {
+public:
+    StringPool() { add(""); }
+
+    // Returns the offset of the string, storing it the first time it is seen
+    uint32_t add(const std::string& text) {
+        auto it = offsets.find(text);
+        if (it != offsets.end()) return it->second;
+
+        uint32_t offset = (uint32_t)bytes.size();
+        uint16_t length = (uint16_t)text.size();
+        bytes.push_back((char)(length & 0xff));
+        bytes.push_back((char)(length >> 8));
+        bytes.insert(bytes.end(), text.begin(), text.end());
+        bytes.push_back('\0');
+        offsets[text] = offset;
+        return offset;
+    }
+
+    const char* get(uint32_t offset) const { return bytes.data() + offset + 2; }
+
+    std::vector<char> bytes;
+
+private:
+    std::map<std::string, uint32_t> offsets;
+};
+
+static std::string trim(const std::string& text) {
+    size_t start = text.find_first_not_of(" \t\r\n");
+    if (start == std::string::npos) return "";
+    size_t end = text.find_last_not_of(" \t\r\n");
+    return text.substr(start, end - start + 1);
+}
+
+static bool fail(const char* source, int line, const char* message) {
+    fprintf(stderr, "%s:%d: %s\n", source, line, message);
+    return false;
+}
+
+static bool parseSource(const char* source, std::vector<SourceBiome>& biomes, StringPool& strings) {
+    FILE* file = fopen(source, "r");
+    if (!file) {
+        fprintf(stderr, "packcontent: can't open %s\n", source);
+        return false;
+    }
+
+    char buffer[1024];
+    int lineNumber = 0;
+    bool ok = true;
+    while (ok && fgets(buffer, sizeof(buffer), file)) {
+        lineNumber++;
+        std::string line = trim(buffer);
+        if (line.empty() || line[0] == '#') continue;
+
+        size_t space = line.find(' ');
+        std::string keyword = line.substr(0, space);
+        std::string rest = space == std::string::npos ? "" : trim(line.substr(space + 1));
+
+        if (keyword == "biome") {
+            unsigned int state;
+            char name[256], image[256];
+            if (sscanf(rest.c_str(), "%u %255s %255s", &state, name, image) != 3) {
+                ok = fail(source, lineNumber, "expected: biome <state> <name> <image>");
+                break;
+            }
+            SourceBiome biome = {};
+            biome.pack.state = state;
+            biome.pack.name = strings.add(name);
+            biome.pack.image = strings.add(image);
+            biomes.push_back(biome);
+        } else if (keyword == "animal") {
+            int x, y, width, height, consumed = 0;
+            if (biomes.empty()) {
+                ok = fail(source, lineNumber, "animal before any biome");
+            } else if (sscanf(rest.c_str(), "%d %d %d %d %n", &x, &y, &width, &height, &consumed) != 4 ||
+                       trim(rest.substr(consumed)).empty()) {
+                ok = fail(source, lineNumber, "expected: animal <x> <y> <width> <height> <name>");
+            } else {
+                SourceAnimal animal = {};
+                animal.rect.x = (int32_t)x;
+                animal.rect.y = (int32_t)y;
+                animal.rect.width = (int32_t)width;
+                animal.rect.height = (int32_t)height;
+                animal.pack.name = strings.add(trim(rest.substr(consumed)));
+                animal.correct = -1;
+                animal.line = lineNumber;
+                biomes.back().animals.push_back(animal);
+            }
+        } else if (keyword == "question" || keyword == "answer" || keyword == "correct") {
+            if (biomes.empty() || biomes.back().animals.empty()) {
+                ok = fail(source, lineNumber, "question/answer before any animal");
+                break;
+            }
+            SourceAnimal& animal = biomes.back().animals.back();
+            if (keyword == "question") {
+                animal.pack.question = strings.add(rest);
+            } else {
+                if (keyword == "correct") {
+                    if (animal.correct >= 0) {
+                        ok = fail(source, lineNumber, "animal already has a correct answer");
+                        break;
+                    }
+                    animal.correct = (int)animal.answers.size();
+                }
+                if (animal.answers.size() >= CONTENT_MAX_ANSWERS) {
+                    ok = fail(source, lineNumber, "too many answers");
+                    break;
+                }
+                animal.answers.push_back(strings.add(rest));
+            }
+        } else {
+            ok = fail(source, lineNumber, "unknown keyword");
+        }
+    }
+    fclose(file);
+
+    // Saved games and stats find animals again by a hash of the name (see
+    // ContentPack::animalId), so no two names may hash the same. Names are
+    // interned, so the same name is the same offset.
+    std::map<uint32_t, int> names;
+    std::map<uint32_t, const SourceAnimal*> ids;
+    for (const auto& biome : biomes) {
+        for (const auto& animal : biome.animals) {
+            if (ok && animal.correct < 0) ok = fail(source, animal.line, "animal has no correct answer");
+            if (ok && !names.emplace(animal.pack.name, animal.line).second) {
+                ok = fail(source, animal.line, "two animals with the same name");
+            }
+            if (!ok) continue;
+            auto added = ids.emplace(animalNameId(strings.get(animal.pack.name)), &animal);
+            if (!added.second) {
+                fprintf(stderr, "%s:%d: %s has the same ID as %s on line %d, rename one of them\n", source,
+                        animal.line, strings.get(animal.pack.name), strings.get(added.first->second->pack.name),
+                        added.first->second->line);
+                ok = false;
+            }
+        }
+    }
+    return ok;
+}
+
+static void align(std::vector<char>& out) {
+    while (out.size() % 4 != 0) out.push_back('\0');
+}
+
+template <typename T>
+static void append(std::vector<char>& out, const T& value) {
+    const char* bytes = (const char*)&value;
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: packcontent <source.txt> <output.pack>\n");
+        return 1;
+    }
+
+    std::vector<SourceBiome> biomes;
+    StringPool strings;
+    if (!parseSource(argv[1], biomes, strings)) return 1;
+
+    // Flatten the biomes into the pack tables
+    std::vector<PackBiome> packBiomes;
+    std::vector<PackRect> packRects;
+    std::vector<PackAnimal> packAnimals;
+    std::vector<uint32_t> packAnswers;
+    for (auto& biome : biomes) {
+        biome.pack.firstAnimal = (uint32_t)packAnimals.size();
+        biome.pack.animalCount = (uint32_t)biome.animals.size();
+        packBiomes.push_back(biome.pack);
+        for (auto& animal : biome.animals) {
+            animal.pack.firstAnswer = (uint32_t)packAnswers.size();
+            animal.pack.answerCount = (uint16_t)animal.answers.size();
+            animal.pack.correctAnswer = (uint16_t)animal.correct;
+            packRects.push_back(animal.rect);
+            packAnimals.push_back(animal.pack);
+            packAnswers.insert(packAnswers.end(), animal.answers.begin(), animal.answers.end());
+        }
+    }
+
+    std::vector<char> out;
+    PackHeader header = {};
+    append(out, header);
+
+    align(out);
+    header.biomeCount = (uint32_t)packBiomes.size();
+    header.biomeOffset = (uint32_t)out.size();
+    for (const auto& biome : packBiomes) append(out, biome);
+
+    align(out);
+    header.animalCount = (uint32_t)packAnimals.size();
+    header.rectOffset = (uint32_t)out.size();
+    for (const auto& rect : packRects) append(out, rect);
+
+    align(out);
+    header.animalOffset = (uint32_t)out.size();
+    for (const auto& animal : packAnimals) append(out, animal);
+
+    align(out);
+    header.answerCount = (uint32_t)packAnswers.size();
+    header.answerOffset = (uint32_t)out.size();
+    for (uint32_t answer : packAnswers) append(out, answer);
+
+    align(out);
+    header.stringBytes = (uint32_t)strings.bytes.size();
+    header.stringOffset = (uint32_t)out.size();
+    out.insert(out.end(), strings.bytes.begin(), strings.bytes.end());
+    align(out);
+
+    header.magic = CONTENT_MAGIC;
+    header.version = CONTENT_VERSION;
+    header.fileSize = (uint32_t)out.size();
+    memcpy(out.data(), &header, sizeof(header));
+
+    FILE* file = fopen(argv[2], "wb");
+    if (!file || fwrite(out.data(), 1, out.size(), file) != out.size()) {
+        fprintf(stderr, "packcontent: can't write %s\n", argv[2]);
+        if (file) fclose(file);
+        return 1;
+    }
+    fclose(file);
+
+    printf("packcontent: %zu biomes, %zu animals, %zu answers, %u bytes of strings -> %s (%zu bytes)\n",
+           packBiomes.size(), packAnimals.size(), packAnswers.size(), header.stringBytes, argv[2], out.size());
+    return 0;
+}
@@ -0,0 +1,78 @@
+// Cost of picking and rescheduling questions as the question bank grows.
+// A simulated player answers whatever the review queue says is due next,
+// right about 80% of the time, and every answer is rescheduled. The same
+// bank is also run with a linear scan for the next due item, which is what
+// picking without the heap would cost.
+//
+//   reviewbench [questions] [answers]     (default 100000 and 200000)
+
+#include "../review.h"
+#include "../content.h"
+#include "benchclock.h"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// Seconds of game time between answers
+#define ANSWER_GAP 5.0
+
+static volatile long long sink;
+
+// Next due item the slow way, same tie break as the heap
+static int scanNext(const ReviewQueue& queue) {
+    int best = -1;
+    for (int i = 0; i < queue.size(); i++) {
+        if (best < 0 || queue.item(i).due < queue.item(best).due) best = i;
+    }
+    return best;
+}
+
+// Answer count questions, returns seconds per answer
+template <typename PickNext>
+static double play(ReviewQueue& queue, int count, PickNext pickNext) {
+    srand(1);
+    double clock = 0;
+    uint8_t order[CONTENT_MAX_ANSWERS];
+    double start = benchClock();
+    for (int i = 0; i < count; i++) {
+        int item = pickNext(queue);
+        // What happens between the tap and drawing the question
+        queue.shuffle(item, 4, order);
+        sink += order[0];
+        clock += ANSWER_GAP;
+        queue.record(item, rand() % 5 != 0, (rand() % 200) / 10.0, clock);
+    }
+    return (benchClock() - start) / count;
+}
+
+int main(int argc, char** argv) {
+    int questions = argc > 1 ? atoi(argv[1]) : 100000;
+    int answers = argc > 2 ? atoi(argv[2]) : 200000;
+    if (questions <= 0 || answers <= 0) {
+        fprintf(stderr, "usage: reviewbench [questions] [answers]\n");
+        return 1;
+    }
+
+    ReviewQueue queue;
+    queue.setSeed(1);
+    double start = benchClock();
+    queue.reset(questions);
+    double resetTime = benchClock() - start;
+
+    double heapTime = play(queue, answers, [](const ReviewQueue& q) { return q.next(); });
+
+    // Same again picking by scan, on fewer answers since each one walks the bank
+    int scanAnswers = answers / 100 > 0 ? answers / 100 : 1;
+    ReviewQueue scanned;
+    scanned.setSeed(1);
+    scanned.reset(questions);
+    double scanTime = play(scanned, scanAnswers, scanNext);
+
+    printf("%d questions, %zu bytes of review state each, reset in %.3f ms\n",
+           questions, sizeof(ReviewItem) + 2 * sizeof(int), resetTime * 1e3);
+    printf("%d answers with the heap:  %10.1f ns per answer (pick, shuffle, reschedule)\n",
+           answers, heapTime * 1e9);
+    printf("%d answers with a scan:    %10.1f ns per answer (%.0fx slower)\n",
+           scanAnswers, scanTime * 1e9, scanTime / heapTime);
+    return 0;
+}
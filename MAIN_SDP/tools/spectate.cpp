@@ -0,0 +1,142 @@
+// Watches a game started with ECOQUEST_SPECTATE (see spectator.h). Prints a
+// line per frame received and keeps the decoded screen, which is written
+// out as a .ppm when the game goes away or enough frames have come in.
+//
+//   spectate unix:<path>|tcp:<port> [screen.ppm] [frames]
+
+#include "../spectator.h"
+#include "../tilecodec.h"
+#include <arpa/inet.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+static int connectTo(const char* address) {
+    int fd = -1;
+    if (strncmp(address, "unix:", 5) == 0) {
+        sockaddr_un remote = {};
+        remote.sun_family = AF_UNIX;
+        strncpy(remote.sun_path, address + 5, sizeof(remote.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (sockaddr*)&remote, sizeof(remote)) == 0) return fd;
+    } else if (strncmp(address, "tcp:", 4) == 0) {
+        sockaddr_in remote = {};
+        remote.sin_family = AF_INET;
+        remote.sin_port = htons((uint16_t)atoi(address + 4));
+        remote.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (sockaddr*)&remote, sizeof(remote)) == 0) return fd;
+    }
+    if (fd >= 0) close(fd);
+    return -1;
+}
+
+static bool readFully(int fd, void* data, size_t size) {
+    uint8_t* p = (uint8_t*)data;
+    while (size > 0) {
+        ssize_t got = recv(fd, p, size, 0);
+        if (got <= 0) return false;
+        p += got;
+        size -= got;
+    }
+    return true;
+}
+
+// Apply one message's tiles to screen, false if the data doesn't add up
+static bool decodeTiles(const SpectatorHeader& header, const uint8_t* data, const uint8_t* end,
+                        std::vector<unsigned int>& screen) {
+    int size = header.tileSize;
+    int tilesX = (header.width + size - 1) / size;
+    int tilesY = (header.height + size - 1) / size;
+    for (int tile = 0; tile < header.tileCount; tile++) {
+        if (end - data < 2) return false;
+        uint16_t index;
+        memcpy(&index, data, sizeof(index));
+        data += 2;
+        if (index >= tilesX * tilesY) return false;
+
+        int x = index % tilesX * size, y = index / tilesX * size;
+        int width = header.width - x < size ? header.width - x : size;
+        int height = header.height - y < size ? header.height - y : size;
+        size_t used = decodeTile(data, end - data, width, height,
+                                 screen.data() + (size_t)y * header.width + x, header.width);
+        if (used == 0) return false;
+        data += used;
+    }
+    return data == end;
+}
+
+static void writePpm(const char* path, const std::vector<unsigned int>& screen, int width, int height) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "spectate: can't write %s\n", path);
+        return;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    for (unsigned int pixel : screen) {
+        unsigned char rgb[3] = {(unsigned char)(pixel >> 16), (unsigned char)(pixel >> 8),
+                                (unsigned char)pixel};
+        fwrite(rgb, 1, 3, file);
+    }
+    fclose(file);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: spectate unix:<path>|tcp:<port> [screen.ppm] [frames]\n");
+        return 1;
+    }
+    const char* ppmPath = argc > 2 ? argv[2] : nullptr;
+    int maxFrames = argc > 3 ? atoi(argv[3]) : 0;
+
+    int fd = connectTo(argv[1]);
+    if (fd < 0) {
+        fprintf(stderr, "spectate: can't connect to %s\n", argv[1]);
+        return 1;
+    }
+
+    std::vector<unsigned int> screen;
+    std::vector<uint8_t> payload;
+    int width = 0, height = 0, frames = 0;
+    uint64_t totalBytes = 0;
+    SpectatorHeader header;
+    bool ok = true;
+    while (readFully(fd, &header, sizeof(header))) {
+        if (header.magic != SPECTATOR_MAGIC || header.tileSize == 0) {
+            fprintf(stderr, "spectate: not a spectator stream\n");
+            ok = false;
+            break;
+        }
+        if (header.width != width || header.height != height) {
+            width = header.width;
+            height = header.height;
+            screen.assign((size_t)width * height, 0);
+        }
+        payload.resize(header.payloadBytes);
+        if (!readFully(fd, payload.data(), payload.size())) break;
+        if (!decodeTiles(header, payload.data(), payload.data() + payload.size(), screen)) {
+            fprintf(stderr, "spectate: bad tile data in frame %u\n", header.frame);
+            ok = false;
+            break;
+        }
+
+        size_t bytes = sizeof(header) + header.payloadBytes;
+        totalBytes += bytes;
+        frames++;
+        printf("frame %5u: %3d tiles, %6zu bytes%s\n", header.frame, header.tileCount, bytes,
+               header.flags & SPECTATOR_KEYFRAME ? " (keyframe)" : "");
+        if (maxFrames > 0 && frames >= maxFrames) break;
+    }
+    close(fd);
+
+    if (frames > 0) {
+        printf("%d frames, %.0f bytes per frame\n", frames, (double)totalBytes / frames);
+        if (ppmPath) writePpm(ppmPath, screen, width, height);
+    }
+    return ok ? 0 : 1;
+}
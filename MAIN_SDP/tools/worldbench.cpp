@@ -0,0 +1,119 @@
+// Scrolls around a world the way dragging a biome does and reports what
+// each frame cost, to show that neither memory nor frame time grows with
+// the size of the world. Run it once per world, make bench_world builds a
+// small, a medium and a biggest-allowed one out of the biome images.
+//
+//   worldbench <file.world> [frames]
+//
+// The world gets an animal-sized object every OBJECT_SPACING pixels, so a
+// bigger world has proportionally more things to cull. Frames draw into a
+// headless FEHLCD of its own, nothing is shown.
+
+#include "../world.h"
+#include "../scene.h"
+#include "../hitmap.h"
+#include "../input.h"
+#include <FEHLCD.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <sys/resource.h>
+
+#define DEFAULT_FRAMES 2000
+// Roughly how fast a finger drags, in pixels per frame
+#define SCROLL_X 13
+#define SCROLL_Y 7
+#define OBJECT_SPACING 160
+
+static double peakMegabytes() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1048576.0;
+#else
+    return usage.ru_maxrss / 1024.0;
+#endif
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: worldbench <file.world> [frames]\n");
+        return 1;
+    }
+    int frames = argc > 2 ? atoi(argv[2]) : DEFAULT_FRAMES;
+    if (frames < 1) frames = 1;
+
+    FEHLCD lcd(false);
+    activeLCD = &lcd;
+    Scene scene;
+    HitMap hits;
+    WorldView view;
+    if (!view.open(argv[1])) return 1;
+    World* world = tileCache.openWorld(argv[1]);
+
+    // Spread out over the whole world, a little off the grid
+    int objects = 0;
+    unsigned int seed = 1;
+    for (int y = 0; y + OBJECT_SPACING <= world->height(); y += OBJECT_SPACING) {
+        for (int x = 0; x + OBJECT_SPACING <= world->width(); x += OBJECT_SPACING) {
+            seed = seed * 1103515245u + 12345u;
+            view.addObject((uint16_t)(2 + objects % 60000), {x + (int)(seed >> 16) % 80, y + (int)(seed >> 8) % 60, 66, 60});
+            objects++;
+        }
+    }
+    scene.setWorld(&view);
+    scene.addText("Back", 16, 15, 0xFFFFFF);
+    scene.present();
+
+    std::vector<double> times;
+    times.reserve(frames);
+    int dx = SCROLL_X, dy = SCROLL_Y;
+    long long visible = 0;
+    for (int frame = 0; frame < frames; frame++) {
+        double start = inputClock();
+        // Bounce off the edges so the whole world gets crossed
+        if (!view.scrollBy(dx, 0)) {
+            dx = -dx;
+            view.scrollBy(dx, 0);
+        }
+        if (!view.scrollBy(0, dy)) {
+            dy = -dy;
+            view.scrollBy(0, dy);
+        }
+        // What GameSession::dragBiome does
+        scene.markDirty(Rect{0, 0, 320, 240});
+        hits.clear();
+        hits.addRect(1, 10, 10, 60, 30);
+        view.forEachVisible([&](uint16_t id, const Rect& bounds) {
+            hits.addRect(id, bounds.x, bounds.y, bounds.width, bounds.height);
+            visible++;
+        });
+        scene.present();
+        LCD.Update();
+        times.push_back(inputClock() - start);
+    }
+
+    std::vector<double> sorted = times;
+    std::sort(sorted.begin(), sorted.end());
+    double total = 0;
+    for (double t : times) total += t;
+    // The first and last tenth, to see whether frames get slower over time
+    int tenth = std::max(1, frames / 10);
+    double early = 0, late = 0;
+    for (int i = 0; i < tenth; i++) {
+        early += times[i];
+        late += times[frames - 1 - i];
+    }
+
+    printf("%s: %dx%d, %d objects, %d frames\n", argv[1], world->width(), world->height(), objects, frames);
+    printf("  frame %.3f ms average, %.3f ms median, %.3f ms 99th percentile, %.3f ms max\n",
+           total * 1e3 / frames, sorted[frames / 2] * 1e3, sorted[frames * 99 / 100] * 1e3,
+           sorted.back() * 1e3);
+    printf("  first tenth %.3f ms, last tenth %.3f ms, %.1f objects on screen per frame\n",
+           early * 1e3 / tenth, late * 1e3 / tenth, (double)visible / frames);
+    printf("  tile cache %.1f MB, peak memory %.1f MB\n", tileCache.residentBytes() / 1048576.0,
+           peakMegabytes());
+    tileCache.printStats();
+    return 0;
+}
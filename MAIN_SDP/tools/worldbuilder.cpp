@@ -0,0 +1,111 @@
+// Builds a .world file (see world.h) out of a grid of same-size PNGs.
+//
+//   worldbuilder <out.world> <columns> <rows> <image.png>...
+//
+// The grid is filled row by row, going round the images as many times as
+// it takes, so a single image makes a world of copies of itself. Works a
+// band of tiles at a time, so even the biggest world only ever holds one
+// row of tiles in memory.
+
+#include "../world.h"
+#include "../png.h"
+#include "../tilecodec.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+int main(int argc, char** argv) {
+    if (argc < 5) {
+        fprintf(stderr, "usage: worldbuilder <out.world> <columns> <rows> <image.png>...\n");
+        return 1;
+    }
+    const char* outPath = argv[1];
+    int gridColumns = atoi(argv[2]);
+    int gridRows = atoi(argv[3]);
+
+    std::vector<PngImage> images(argc - 4);
+    for (size_t i = 0; i < images.size(); i++) {
+        if (!loadPng(argv[i + 4], images[i])) {
+            fprintf(stderr, "worldbuilder: can't decode %s\n", argv[i + 4]);
+            return 1;
+        }
+        if (images[i].width != images[0].width || images[i].height != images[0].height) {
+            fprintf(stderr, "worldbuilder: %s isn't the same size as %s\n", argv[i + 4], argv[4]);
+            return 1;
+        }
+    }
+    int cellWidth = images[0].width;
+    int cellHeight = images[0].height;
+    if (gridColumns < 1 || gridRows < 1 || (long)gridColumns * cellWidth > WORLD_MAX_SIZE ||
+        (long)gridRows * cellHeight > WORLD_MAX_SIZE) {
+        fprintf(stderr, "worldbuilder: worlds go up to %dx%d pixels\n", WORLD_MAX_SIZE, WORLD_MAX_SIZE);
+        return 1;
+    }
+
+    WorldHeader header = {};
+    header.magic = WORLD_MAGIC;
+    header.version = WORLD_VERSION;
+    header.width = gridColumns * cellWidth;
+    header.height = gridRows * cellHeight;
+    header.tileSize = WORLD_TILE_SIZE;
+    header.columns = (header.width + WORLD_TILE_SIZE - 1) / WORLD_TILE_SIZE;
+    header.rows = (header.height + WORLD_TILE_SIZE - 1) / WORLD_TILE_SIZE;
+
+    FILE* file = fopen(outPath, "wb");
+    if (!file) {
+        fprintf(stderr, "worldbuilder: can't write %s\n", outPath);
+        return 1;
+    }
+    // Tile data goes after the table, which is filled in at the end
+    std::vector<WorldTile> table((size_t)header.columns * header.rows);
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(table.data(), sizeof(WorldTile), table.size(), file);
+    uint64_t offset = sizeof(header) + table.size() * sizeof(WorldTile);
+
+    std::vector<unsigned int> band((size_t)header.width * WORLD_TILE_SIZE);
+    std::vector<uint8_t> encoded(tileCodecMaxBytes(WORLD_TILE_SIZE, WORLD_TILE_SIZE));
+    bool ok = true;
+    for (uint32_t tileRow = 0; tileRow < header.rows && ok; tileRow++) {
+        int top = tileRow * WORLD_TILE_SIZE;
+        int bandHeight = std::min<int>(WORLD_TILE_SIZE, header.height - top);
+        for (int y = 0; y < bandHeight; y++) {
+            int worldY = top + y;
+            for (int gridColumn = 0; gridColumn < gridColumns; gridColumn++) {
+                const PngImage& image =
+                    images[((size_t)(worldY / cellHeight) * gridColumns + gridColumn) % images.size()];
+                const unsigned int* row = image.pixels.data() + (size_t)(worldY % cellHeight) * cellWidth;
+                std::copy(row, row + cellWidth, band.begin() + (size_t)y * header.width + gridColumn * cellWidth);
+            }
+        }
+        for (uint32_t column = 0; column < header.columns && ok; column++) {
+            int left = column * WORLD_TILE_SIZE;
+            int tileWidth = std::min<int>(WORLD_TILE_SIZE, header.width - left);
+            size_t bytes = encodeTile(band.data() + left, header.width, tileWidth, bandHeight, encoded.data());
+            if (offset + bytes > UINT32_MAX) {
+                fprintf(stderr, "worldbuilder: %s would be over 4 GB\n", outPath);
+                ok = false;
+                break;
+            }
+            WorldTile& tile = table[(size_t)tileRow * header.columns + column];
+            tile.offset = (uint32_t)offset;
+            tile.bytes = (uint32_t)bytes;
+            ok = fwrite(encoded.data(), 1, bytes, file) == bytes;
+            offset += bytes;
+        }
+    }
+    ok = ok && fseek(file, sizeof(header), SEEK_SET) == 0 &&
+         fwrite(table.data(), sizeof(WorldTile), table.size(), file) == table.size();
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        fprintf(stderr, "worldbuilder: can't write %s\n", outPath);
+        remove(outPath);
+        return 1;
+    }
+
+    double raw = (double)header.width * header.height * 4;
+    printf("%s: %ux%u pixels, %ux%u tiles, %.1f MB (%.1f MB decoded)\n", outPath, header.width,
+           header.height, header.columns, header.rows, offset / 1048576.0, raw / 1048576.0);
+    return 0;
+}
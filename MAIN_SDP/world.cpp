@@ -0,0 +1,340 @@
+#include "world.h"
+#include "input.h"
+#include "profiler.h"
+#include "tilecodec.h"
+#include <FEHLCD.h>
+#include <algorithm>
+#include <cstring>
+
+#define TILE_PIXELS (WORLD_TILE_SIZE * WORLD_TILE_SIZE)
+
+TileCache tileCache;
+
+bool isWorldFile(const char* filename) {
+    size_t length = strlen(filename);
+    return length > 6 && strcmp(filename + length - 6, ".world") == 0;
+}
+
+// World
+
+World::World() : file(nullptr) {
+    memset(&header, 0, sizeof(header));
+}
+
+World::~World() {
+    if (file) fclose(file);
+}
+
+bool World::open(const char* filename) {
+    file = fopen(filename, "rb");
+    if (!file) {
+        printf("World: can't open %s\n", filename);
+        return false;
+    }
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+              header.magic == WORLD_MAGIC && header.version == WORLD_VERSION &&
+              header.tileSize == WORLD_TILE_SIZE &&
+              header.width > 0 && header.width <= WORLD_MAX_SIZE &&
+              header.height > 0 && header.height <= WORLD_MAX_SIZE &&
+              header.columns == (header.width + WORLD_TILE_SIZE - 1) / WORLD_TILE_SIZE &&
+              header.rows == (header.height + WORLD_TILE_SIZE - 1) / WORLD_TILE_SIZE;
+    if (!ok) {
+        printf("World: %s isn't a world file\n", filename);
+        fclose(file);
+        file = nullptr;
+        memset(&header, 0, sizeof(header));
+    }
+    return ok;
+}
+
+bool World::readTile(int column, int row, unsigned int* out, std::vector<uint8_t>& scratch) {
+    if (!file || column < 0 || row < 0 || column >= columns() || row >= rows()) return false;
+    int tileWidth = std::min(WORLD_TILE_SIZE, width() - column * WORLD_TILE_SIZE);
+    int tileHeight = std::min(WORLD_TILE_SIZE, height() - row * WORLD_TILE_SIZE);
+
+    WorldTile tile;
+    long entry = (long)sizeof(header) + ((long)row * columns() + column) * (long)sizeof(tile);
+    if (fseek(file, entry, SEEK_SET) != 0 || fread(&tile, sizeof(tile), 1, file) != 1 ||
+        tile.bytes > tileCodecMaxBytes(tileWidth, tileHeight)) {
+        return false;
+    }
+    // Big enough for any tile, so this only ever grows once
+    scratch.resize(tileCodecMaxBytes(WORLD_TILE_SIZE, WORLD_TILE_SIZE));
+    if (fseek(file, (long)tile.offset, SEEK_SET) != 0 ||
+        fread(scratch.data(), 1, tile.bytes, file) != tile.bytes) {
+        return false;
+    }
+    return decodeTile(scratch.data(), tile.bytes, tileWidth, tileHeight, out, WORLD_TILE_SIZE) == tile.bytes;
+}
+
+// TileCache
+
+static uint64_t tileKey(int world, int tile) {
+    return (uint64_t)world << 32 | (uint32_t)tile;
+}
+
+static unsigned int keyHash(uint64_t key) {
+    return (unsigned int)((key * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+TileCache::TileCache(size_t capacityBytes)
+    : capacity(capacityBytes), slotCount(0), newest(-1), oldest(-1), used(0), hits(0), misses(0),
+      evictions(0), failures(0), decodeTime(0), decodeMax(0) {}
+
+void TileCache::setCapacity(size_t bytes) {
+    std::lock_guard<std::mutex> guard(lock);
+    capacity = bytes;
+    slotCount = 0;
+    pixels.clear();
+    pixels.shrink_to_fit();
+    used = 0;
+    newest = oldest = -1;
+}
+
+World* TileCache::openWorld(const char* filename) {
+    std::lock_guard<std::mutex> guard(lock);
+    for (const auto& world : worlds) {
+        if (world.first == filename) return world.second.get();
+    }
+    std::unique_ptr<World> world(new World());
+    if (!world->open(filename)) return nullptr;
+    worlds.emplace_back(filename, std::move(world));
+    return worlds.back().second.get();
+}
+
+int TileCache::findSlot(uint64_t key) const {
+    if (index.empty()) return -1;
+    size_t mask = index.size() - 1;
+    for (size_t i = keyHash(key) & mask; index[i]; i = (i + 1) & mask) {
+        if (keys[index[i] - 1] == key) return index[i] - 1;
+    }
+    return -1;
+}
+
+void TileCache::removeKey(uint64_t key) {
+    size_t mask = index.size() - 1;
+    size_t hole = keyHash(key) & mask;
+    while (keys[index[hole] - 1] != key) hole = (hole + 1) & mask;
+    index[hole] = 0;
+    // Pull back anything after the hole that probed past it
+    for (size_t i = (hole + 1) & mask; index[i]; i = (i + 1) & mask) {
+        size_t home = keyHash(keys[index[i] - 1]) & mask;
+        bool reachable = hole <= i ? (home <= hole || home > i) : (home <= hole && home > i);
+        if (reachable) {
+            index[hole] = index[i];
+            index[i] = 0;
+            hole = i;
+        }
+    }
+}
+
+void TileCache::link(int slot) {
+    older[slot] = newest;
+    newer[slot] = -1;
+    if (newest >= 0) newer[newest] = slot;
+    newest = slot;
+    if (oldest < 0) oldest = slot;
+}
+
+void TileCache::unlink(int slot) {
+    if (newer[slot] >= 0) older[newer[slot]] = older[slot];
+    else newest = older[slot];
+    if (older[slot] >= 0) newer[older[slot]] = newer[slot];
+    else oldest = newer[slot];
+}
+
+void TileCache::drawTile(World& world, int column, int row, const Canvas& canvas, int x, int y) {
+    // Only the part of the tile inside both the canvas and the world
+    int left = std::max(x, canvas.x);
+    int top = std::max(y, canvas.y);
+    int right = std::min({x + WORLD_TILE_SIZE, canvas.x + canvas.width,
+                          x + world.width() - column * WORLD_TILE_SIZE});
+    int bottom = std::min({y + WORLD_TILE_SIZE, canvas.y + canvas.height,
+                           y + world.height() - row * WORLD_TILE_SIZE});
+    if (left >= right || top >= bottom) return;
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (slotCount == 0) {
+        // Always room for one tile, however small the cap
+        slotCount = std::max(1, (int)(capacity / (TILE_PIXELS * sizeof(unsigned int))));
+        pixels.assign((size_t)slotCount * TILE_PIXELS, 0);
+        keys.assign(slotCount, 0);
+        newer.assign(slotCount, -1);
+        older.assign(slotCount, -1);
+        size_t indexSize = 1;
+        while (indexSize < (size_t)slotCount * 2) indexSize *= 2;
+        index.assign(indexSize, 0);
+    }
+
+    int worldNumber = 0;
+    while (worlds[worldNumber].second.get() != &world) worldNumber++;
+    uint64_t key = tileKey(worldNumber, row * world.columns() + column);
+
+    int slot = findSlot(key);
+    if (slot >= 0) {
+        hits++;
+        if (slot != newest) {
+            unlink(slot);
+            link(slot);
+        }
+    } else {
+        misses++;
+        if (used < slotCount) {
+            slot = used++;
+        } else {
+            slot = oldest;
+            unlink(slot);
+            removeKey(keys[slot]);
+            evictions++;
+        }
+        double start = inputClock();
+        unsigned int* tile = pixels.data() + (size_t)slot * TILE_PIXELS;
+        if (!world.readTile(column, row, tile, scratch)) {
+            // Shows up black rather than as whatever the slot held before
+            if (failures++ == 0) printf("TileCache: can't read tile %d, %d\n", column, row);
+            std::fill(tile, tile + TILE_PIXELS, BLACK);
+        }
+        double elapsed = inputClock() - start;
+        decodeTime += elapsed;
+        decodeMax = std::max(decodeMax, elapsed);
+
+        keys[slot] = key;
+        size_t mask = index.size() - 1;
+        size_t i = keyHash(key) & mask;
+        while (index[i]) i = (i + 1) & mask;
+        index[i] = slot + 1;
+        link(slot);
+    }
+
+    const BlitKernels& kernels = blitKernels();
+    const unsigned int* tile = pixels.data() + (size_t)slot * TILE_PIXELS;
+    for (int py = top; py < bottom; py++) {
+        kernels.copy(tile + (size_t)(py - y) * WORLD_TILE_SIZE + (left - x),
+                     canvas.pixels + (size_t)(py - canvas.y) * canvas.width + (left - canvas.x),
+                     right - left);
+    }
+}
+
+size_t TileCache::residentBytes() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return (size_t)used * TILE_PIXELS * sizeof(unsigned int);
+}
+
+void TileCache::printStats() const {
+    std::lock_guard<std::mutex> guard(lock);
+    if (hits + misses == 0) return;
+    printf("TileCache: %lld hits, %lld misses (%.1f%% hit rate), %lld evicted, %d unreadable\n",
+           hits, misses, 100.0 * hits / (hits + misses), evictions, failures);
+    printf("TileCache: %d of %d tiles in use (%.1f of %.1f MB), decoding %.3f ms average, %.3f ms max\n",
+           used, slotCount, used * (double)TILE_PIXELS * sizeof(unsigned int) / (1 << 20),
+           slotCount * (double)TILE_PIXELS * sizeof(unsigned int) / (1 << 20),
+           misses ? decodeTime * 1e3 / misses : 0.0, decodeMax * 1e3);
+}
+
+// WorldView
+
+WorldView::WorldView()
+    : world(nullptr), viewX(0), viewY(0), cellColumns(0), cellRows(0), visitStamp(0) {}
+
+bool WorldView::open(const char* name) {
+    if (world && filename == name) return true;
+    close();
+    world = tileCache.openWorld(name);
+    if (!world) return false;
+    filename = name;
+    cellColumns = (world->width() + WORLD_CELL_SIZE - 1) / WORLD_CELL_SIZE;
+    cellRows = (world->height() + WORLD_CELL_SIZE - 1) / WORLD_CELL_SIZE;
+    cells.assign((size_t)cellColumns * cellRows, std::vector<int>());
+    return true;
+}
+
+void WorldView::close() {
+    world = nullptr;
+    filename.clear();
+    viewX = viewY = 0;
+    clearObjects();
+    cells.clear();
+    cellColumns = cellRows = 0;
+}
+
+bool WorldView::scrollBy(int dx, int dy) {
+    if (!world) return false;
+    int x = std::max(0, std::min(viewX + dx, world->width() - SCREEN_WIDTH));
+    int y = std::max(0, std::min(viewY + dy, world->height() - SCREEN_HEIGHT));
+    bool moved = x != viewX || y != viewY;
+    viewX = x;
+    viewY = y;
+    return moved;
+}
+
+void WorldView::compose(const Canvas& canvas) const {
+    PROFILE_SCOPE("WorldView::compose");
+    if (!world) return;
+    // Worlds smaller than the screen leave the rest black
+    canvasFill(canvas, canvas.x, canvas.y, canvas.width, canvas.height, BLACK);
+
+    // Tiles under the canvas, in world coordinates
+    int firstColumn = std::max(0, (canvas.x + viewX) / WORLD_TILE_SIZE);
+    int firstRow = std::max(0, (canvas.y + viewY) / WORLD_TILE_SIZE);
+    int endColumn = std::min(world->columns(), (canvas.x + canvas.width + viewX - 1) / WORLD_TILE_SIZE + 1);
+    int endRow = std::min(world->rows(), (canvas.y + canvas.height + viewY - 1) / WORLD_TILE_SIZE + 1);
+    for (int row = firstRow; row < endRow; row++) {
+        for (int column = firstColumn; column < endColumn; column++) {
+            tileCache.drawTile(*world, column, row, canvas, column * WORLD_TILE_SIZE - viewX,
+                               row * WORLD_TILE_SIZE - viewY);
+        }
+    }
+}
+
+void WorldView::clearObjects() {
+    objects.clear();
+    for (auto& cell : cells) cell.clear();
+    visible.clear();
+}
+
+void WorldView::addObject(uint16_t id, const Rect& bounds) {
+    if (!world) return;
+    int index = (int)objects.size();
+    objects.push_back({id, bounds});
+    // In every cell it overlaps. Hit boxes include their right and bottom edge.
+    int firstColumn = std::max(0, bounds.x / WORLD_CELL_SIZE);
+    int firstRow = std::max(0, bounds.y / WORLD_CELL_SIZE);
+    int lastColumn = std::min(cellColumns - 1, (bounds.x + bounds.width) / WORLD_CELL_SIZE);
+    int lastRow = std::min(cellRows - 1, (bounds.y + bounds.height) / WORLD_CELL_SIZE);
+    for (int row = firstRow; row <= lastRow; row++) {
+        for (int column = firstColumn; column <= lastColumn; column++) {
+            cells[(size_t)row * cellColumns + column].push_back(index);
+        }
+    }
+    // So culling doesn't have to allocate later
+    visible.reserve(objects.size());
+    seen.resize(objects.size(), 0);
+}
+
+void WorldView::collectVisible() const {
+    visible.clear();
+    if (!world) return;
+    if (++visitStamp == 0) {
+        std::fill(seen.begin(), seen.end(), 0);
+        visitStamp = 1;
+    }
+    int firstColumn = viewX / WORLD_CELL_SIZE;
+    int firstRow = viewY / WORLD_CELL_SIZE;
+    int lastColumn = std::min(cellColumns - 1, (viewX + SCREEN_WIDTH - 1) / WORLD_CELL_SIZE);
+    int lastRow = std::min(cellRows - 1, (viewY + SCREEN_HEIGHT - 1) / WORLD_CELL_SIZE);
+    Rect view = {viewX, viewY, SCREEN_WIDTH, SCREEN_HEIGHT};
+    for (int row = firstRow; row <= lastRow; row++) {
+        for (int column = firstColumn; column <= lastColumn; column++) {
+            for (int i : cells[(size_t)row * cellColumns + column]) {
+                if (seen[i] == visitStamp) continue;
+                seen[i] = visitStamp;
+                const Rect& bounds = objects[i].bounds;
+                if (Rect{bounds.x, bounds.y, bounds.width + 1, bounds.height + 1}.intersects(view)) {
+                    visible.push_back(i);
+                }
+            }
+        }
+    }
+    // Added first wins on the hit map, keep that order
+    std::sort(visible.begin(), visible.end());
+}
@@ -0,0 +1,197 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include "blit.h"
+#include "drawlist.h"
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Biomes bigger than the screen. A world is one huge picture cut into
+// 64x64 tiles, each compressed on its own (tilecodec.h), so a tile can be
+// read and decoded without touching the rest. Only the tiles under the
+// screen are ever decoded, and they're kept in a tile cache of fixed size,
+// so memory and frame time don't depend on how big the world is.
+//
+// A biome uses a world when its image in content/animals.txt ends in
+// .world, and its animals are then placed in world coordinates. Dragging
+// scrolls it. tools/worldbuilder.cpp makes .world files out of PNGs.
+//
+// Layout, in the host's byte order:
+//   WorldHeader
+//   WorldTile[columns * rows]   row by row
+//   tile data, at the offsets the WorldTiles give
+
+#define WORLD_MAGIC 0x44575145  // "EQWD"
+#define WORLD_VERSION 1
+#define WORLD_TILE_SIZE 64
+// Widest and tallest a world can be
+#define WORLD_MAX_SIZE 8192
+
+// Decoded tiles kept for every world together
+#define TILE_CACHE_BYTES (4 << 20)
+
+// Things placed in a world are found through a grid of cells this big
+#define WORLD_CELL_SIZE 256
+
+struct WorldHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t tileSize;  // WORLD_TILE_SIZE
+    uint32_t columns;
+    uint32_t rows;
+    uint32_t reserved;
+};
+
+struct WorldTile {
+    uint32_t offset;  // from the start of the file
+    uint32_t bytes;
+};
+
+// Whether an image name is a world rather than a PNG
+bool isWorldFile(const char* filename);
+
+// One open world file. Tiles are read straight from the file when asked
+// for, nothing but the header is kept in memory.
+class World {
+public:
+    World();
+    ~World();
+    World(const World&) = delete;
+    World& operator=(const World&) = delete;
+
+    bool open(const char* filename);
+
+    int width() const { return (int)header.width; }
+    int height() const { return (int)header.height; }
+    int columns() const { return (int)header.columns; }
+    int rows() const { return (int)header.rows; }
+
+    // Decode one tile into out, WORLD_TILE_SIZE pixels a row. Tiles on the
+    // right and bottom edges only fill the part inside the world.
+    bool readTile(int column, int row, unsigned int* out, std::vector<uint8_t>& scratch);
+
+private:
+    FILE* file;
+    WorldHeader header;
+};
+
+// Decoded world tiles, least recently drawn thrown out first. The memory
+// for every tile it can hold is allocated once on first use, so scrolling
+// never touches the heap. Worlds are opened through the cache and stay
+// open, hosted sessions share it the same way they share the image cache.
+class TileCache {
+public:
+    explicit TileCache(size_t capacityBytes = TILE_CACHE_BYTES);
+
+    // Drops every cached tile
+    void setCapacity(size_t bytes);
+
+    // The world in filename, opened the first time it's asked for. nullptr
+    // if it can't be read.
+    World* openWorld(const char* filename);
+
+    // Copy the part of a tile that's in canvas, with the tile's top left
+    // corner at screen position x, y. Decodes it first if it isn't cached.
+    void drawTile(World& world, int column, int row, const Canvas& canvas, int x, int y);
+
+    size_t residentBytes() const;
+    void printStats() const;
+
+private:
+    int findSlot(uint64_t key) const;
+    void link(int slot);
+    void unlink(int slot);
+    void removeKey(uint64_t key);
+
+    mutable std::mutex lock;
+    std::vector<std::pair<std::string, std::unique_ptr<World>>> worlds;
+
+    size_t capacity;
+    int slotCount;
+    // slotCount tiles, allocated on first use
+    std::vector<unsigned int> pixels;
+    std::vector<uint64_t> keys;  // world << 32 | tile
+    std::vector<int> newer, older;
+    int newest, oldest;
+    int used;
+    // Open addressed key lookup, slot + 1 or 0 for empty
+    std::vector<int> index;
+    std::vector<uint8_t> scratch;
+
+    long long hits, misses, evictions;
+    int failures;
+    double decodeTime, decodeMax;
+};
+
+extern TileCache tileCache;
+
+// What part of a world is on screen. Compose it into the scene's canvas
+// and cull things placed in it to the ones on screen.
+class WorldView {
+public:
+    WorldView();
+
+    // Show the world in filename. Opening the world already showing keeps
+    // the scroll position, so coming back to a biome lands where you were.
+    bool open(const char* filename);
+    void close();
+    bool isOpen() const { return world != nullptr; }
+
+    // Move the view by dx, dy pixels, stopping at the world's edges.
+    // Returns whether it moved at all.
+    bool scrollBy(int dx, int dy);
+    int scrollX() const { return viewX; }
+    int scrollY() const { return viewY; }
+
+    // Everything of the world under canvas
+    void compose(const Canvas& canvas) const;
+
+    // Something at bounds, in world coordinates
+    void clearObjects();
+    void addObject(uint16_t id, const Rect& bounds);
+
+    // visit(id, screenBounds) for each object at least partly on screen, in
+    // the order they were added. Only the grid cells on screen are looked at.
+    template <typename Visit>
+    void forEachVisible(Visit visit) const;
+
+private:
+    void collectVisible() const;
+
+    World* world;
+    std::string filename;
+    int viewX, viewY;
+
+    struct Object {
+        uint16_t id;
+        Rect bounds;
+    };
+    std::vector<Object> objects;
+    int cellColumns, cellRows;
+    std::vector<std::vector<int>> cells;  // object indices in each cell
+
+    // Scratch for forEachVisible, sized when objects are added
+    mutable std::vector<int> visible;
+    mutable std::vector<uint32_t> seen;
+    mutable uint32_t visitStamp;
+};
+
+template <typename Visit>
+void WorldView::forEachVisible(Visit visit) const {
+    collectVisible();
+    for (int i : visible) {
+        const Object& object = objects[i];
+        Rect bounds = object.bounds;
+        bounds.x -= viewX;
+        bounds.y -= viewY;
+        visit(object.id, bounds);
+    }
+}
+
+#endif